@@ -0,0 +1,139 @@
+// arena.h
+//
+// Author: Kendall Auel
+//
+// The class "Arena" is a simple region allocator for the objects of
+// the track network. Objects are carved out of large chunks in the
+// order they are created, so objects of one kind that are created
+// together are also adjacent in memory.
+//
+// A freed block goes on a free list for its size, and the next object
+// of that size takes it, so objects that come and go while the
+// simulation runs keep reusing the same blocks. Once every object in
+// the arena has been freed, the arena rewinds and the chunks are
+// reused, so a network reset followed by a reload does not go back to
+// the heap.
+//
+// ArenaAllocator adapts an arena for std::allocate_shared, which
+// places the shared_ptr control block and the object together:
+//
+//     EdgePtr eptr = std::allocate_shared<Edge>(
+//             ArenaAllocator<Edge>(arena), name);
+//
+// Objects may be allocated and freed from any thread. The arena has
+// one lock, for the chunks and the free lists alike, so the rewind
+// when the last object is freed cannot race with an allocation.
+//
+// To free a whole network at once, hold an Arena::Release while the
+// objects are let go. It takes the lock once, the frees from its thread
+// only count down, and the arena rewinds when it ends.
+
+#ifndef _CS_ARENA_H_
+#define _CS_ARENA_H_
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rrsim {
+
+class Arena
+{
+public:
+    explicit Arena(size_t chunkSize = 64 * 1024);
+    ~Arena();
+
+    void*   allocate(size_t size, size_t align = alignof(std::max_align_t));
+    void    deallocate(void* ptr, size_t size);
+
+    // Return the chunks to the heap. Only possible while nothing in the
+    // arena is allocated; returns false otherwise.
+    bool    trim();
+
+    // Frees from the thread holding a Release skip the lock and the free
+    // lists. Other threads wait for it to end. A block freed while it is
+    // held is not reused until the arena rewinds.
+    class Release
+    {
+    public:
+        explicit Release(Arena& arena);
+        ~Release();
+
+        Release(Release const&)         = delete;
+        void operator=(Release const&)  = delete;
+
+    private:
+        Arena&                          m_arena;
+        std::unique_lock<std::mutex>    m_guard;
+    };
+
+    long    liveCount() const { return m_live.load(std::memory_order_relaxed); }
+    size_t  capacity() const;
+
+    Arena(Arena const&)             = delete;
+    void operator=(Arena const&)    = delete;
+
+private:
+    // Called with the lock held.
+    void    rewind();
+
+    struct Chunk
+    {
+        char*   base;
+        size_t  size;
+    };
+
+    // Freed blocks of one size and alignment, linked through their
+    // first bytes.
+    struct FreeList
+    {
+        size_t  size;
+        size_t  align;
+        void*   head;
+    };
+    void*   takeFree(size_t size, size_t align);   // Lock held.
+
+    std::vector<Chunk>  m_chunks;
+    size_t              m_chunkSize;
+    size_t              m_current;      // Index of the chunk in use.
+    char*               m_next;         // Next free byte in the chunk.
+    char*               m_end;
+    std::atomic<long>   m_live;
+
+    std::vector<FreeList> m_free;
+    mutable std::mutex  m_lock;
+    std::atomic<std::thread::id> m_releasing;   // Thread holding a Release.
+};
+
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t count) {
+        m_arena->deallocate(ptr, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+private:
+    template <typename U> friend class ArenaAllocator;
+    Arena* m_arena;
+};
+
+} // namespace rrsim
+
+#endif // _CS_ARENA_H_
@@ -0,0 +1,147 @@
+// branch.h
+//
+// Author: Kendall Auel
+//
+// The class "Branch" is a what-if future of the simulation: a copy of
+// the running state that is stepped on its own, so that dispatchers
+// can try a switch thrown or a train held and compare what follows,
+// without touching the System.
+//
+// The topology is taken once per topology version, from the
+// transition table, and shared by every branch as it is never changed.
+// The state that does change is kept in copy-on-write pages (see
+// cowpages.h): the occupancy by edge, the switch by junction and the
+// trains by ID. Copying a branch forks it, sharing every page, and a
+// page is copied only when one side changes it, so a fork costs
+// memory for what diverges. The signal aspects follow from the
+// occupancy, so a branch works them out when a train reaches a signal
+// rather than keeping them; the System updates them after every change
+// to the same effect.
+//
+// A branch steps its trains by the rules of the System, in the same
+// order. Rerouting, timetable departures and soak trains are left
+// out: a train keeps the route it had, and only the trains on the
+// track when the branch was taken run. A collision ends the branch.
+//
+// A branch reads nothing of the System once taken, so branches run
+// in parallel on threads of their own. A branch is forked on the
+// thread that runs it.
+
+#ifndef _CS_BRANCH_H_
+#define _CS_BRANCH_H_
+
+#include "common.h"
+#include "cowpages.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rrsim {
+
+class Branch
+{
+public:
+    // Take the state of the System, between steps.
+    Branch();
+
+    long        simStep() const { return m_step; }
+    bool        collided() const { return m_collided >= 0; }
+    int         collidedTrain() const { return m_collided; }
+
+    // What-ifs: set a junction switch, or keep a train where it is for
+    // so many steps from now. Both take IDs, and throw for a node that
+    // is not a junction or a train that is not in the branch.
+    void        setSwitch(int node, eJSwitch jsw);
+    void        hold(int train, long steps);
+
+    // One step of every train. Returns false once no train has more
+    // to do, or after a collision.
+    bool        step();
+
+    // Step up to count times. Returns the steps taken.
+    long        run(long count);
+
+    // Run every branch count steps, on the given number of threads (0
+    // for one per hardware thread).
+    static void runAll(std::vector<Branch>& branches, long count, unsigned threads);
+
+    // The state of the branch, as in the TrainFleet.
+    int32_t     stateOf(int train) const { return m_trains[train].state; }
+    int         destOf(int train) const { return m_trains[train].dest; }
+    int         occupant(int edge) const { return m_occupant[edge]; }
+    eJSwitch    switchOf(int node) const;
+
+    // The step a train reached its destination, -1 if it has not.
+    long        arrivalOf(int train) const { return m_trains[train].arrived; }
+
+    // The trains of the branch, in the order they step.
+    const std::vector<int>& trains() const { return *m_order; }
+
+    // The pages of state this branch has of its own, not shared with
+    // the other, and all its pages.
+    size_t      ownPages(const Branch& other) const;
+    size_t      pages() const;
+
+private:
+    struct Junction
+    {
+        int         node;
+        int32_t     common;     // Edge in slot 1, or -1.
+        int32_t     left;       // Edge in slot 2, or -1.
+    };
+
+    // What every branch of one topology version shares.
+    struct Topology
+    {
+        long                    version = -1;
+        std::vector<int32_t>    branch;     // Two per state.
+        std::vector<uint8_t>    facing;     // Per state, as in the table.
+        std::vector<uint8_t>    signal;     // Per state, 1 if it has one.
+        std::vector<int32_t>    junctionAt; // Per state, or -1.
+        std::vector<int32_t>    junctionOf; // Per node, or -1.
+        std::vector<Junction>   junctions;
+        std::vector<double>     weight;     // Per edge.
+    };
+
+    struct TrainRec
+    {
+        int32_t     state = -1;
+        int32_t     dest = -1;
+        long        depart = 0;
+        long        arrived = -1;
+        double      length = 0.0;
+        std::shared_ptr<const std::vector<uint8_t>> route;
+        uint32_t    routePos = 0;
+        std::vector<int32_t> consist;   // Tail to head.
+        double      weight = 0.0;       // Of the consist.
+    };
+
+    // The topology of the System, shared with the branches taken
+    // before at the same version.
+    static std::shared_ptr<const Topology> topology();
+    static std::shared_ptr<const Topology> s_topology;
+
+    eNodeType   facingType(int32_t state) const { return (eNodeType)(m_topo->facing[state] & 3); }
+    eSlot       facingSlot(int32_t state) const { return (eSlot)(m_topo->facing[state] >> 2); }
+    int32_t     next(int32_t state) const;
+    bool        signalIsRed(int32_t state) const;
+    void        setOccupant(int edge, int train);
+    bool        stepTrain(int train);
+    void        moveTo(int train, int32_t next);
+    void        enter(int train, int32_t next);
+    void        releaseTail(int train, int edge);
+    void        clearPosition(int train);
+
+    std::shared_ptr<const Topology> m_topo;
+    std::shared_ptr<const std::vector<int>> m_order;
+    long                    m_step;
+    int                     m_collided;     // The train, or -1.
+
+    CowPages<int32_t, 256>  m_occupant;
+    CowPages<uint8_t, 256>  m_switch;       // By junction.
+    CowPages<TrainRec, 16>  m_trains;
+};
+
+} // namespace rrsim
+
+#endif // _CS_BRANCH_H_
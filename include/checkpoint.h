@@ -0,0 +1,135 @@
+// checkpoint.h
+//
+// Author: Kendall Auel
+//
+// The class "Checkpoint" saves the network and the trains every so
+// many steps while the simulation runs, without holding it up for the
+// writing. At the end of a step the simulation thread takes a snapshot
+// and a thread of its own writes it to a file in the format of a
+// journal base, segments first, then switches and trains (see
+// journal.h), so the file loads like any saved network.
+//
+// The snapshot keeps a small record per segment and per node, of
+// names and numbers only, in copy-on-write pages (see cowpages.h).
+// The System reports the segments and nodes that change, and only
+// their records are brought up to date before a snapshot, which then
+// shares every page with the records. A page written to while the
+// writer still holds it is copied first. The trains all move, so
+// their records are taken whole. A snapshot thus costs the edits
+// since the last one, the trains and a pointer per page, not a pass
+// over the network. The records are built when the checkpoints start,
+// and again at the next snapshot after the network is replaced.
+//
+// Names are interned for good and never move (see nametable.h), so
+// the records point at them and the writer reads them freely.
+//
+// If the last snapshot is still being written when the next one is
+// due, that one is skipped rather than waited for.
+
+#ifndef _CS_CHECKPOINT_H_
+#define _CS_CHECKPOINT_H_
+
+#include "common.h"
+#include "cowpages.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rrsim {
+
+class Checkpoint
+{
+public:
+    Checkpoint();
+    ~Checkpoint();
+
+    bool        active() const { return m_period > 0; }
+    const std::string& path() const { return m_path; }
+    long        period() const { return m_period; }
+
+    // Write to path every period steps. An empty path or a zero period
+    // stops the checkpoints, once a write under way is done.
+    void        start(const std::string& path, long period);
+    void        stop();
+
+    // Forget every record, as when the whole network is replaced.
+    void        clear();
+
+    // Segments and nodes changed, reported by the System.
+    void        edgeChanged(int edge) {
+        if (active()) { note(m_edges, m_edgeMarks, edge); }
+    }
+    void        nodeChanged(int node) {
+        if (active()) { note(m_nodes, m_nodeMarks, node); }
+    }
+
+    // Take a snapshot if one is due at this step, and start writing it.
+    void        endOfStep(long step);
+
+    // Wait for the write under way, if any. Returns false if the last
+    // write failed.
+    bool        finish();
+
+private:
+    struct EdgeRec
+    {
+        const std::string*  name = nullptr;     // Null if no segment.
+        const std::string*  nodes[eNumEnds] = { nullptr, nullptr };
+        int                 slots[eNumEnds] = { 0, 0 };
+        double              weight = 0.0;
+        bool                signals[eNumEnds] = { false, false };
+    };
+    struct NodeRec
+    {
+        const std::string*  name = nullptr;     // Null if not a junction.
+        bool                right = false;
+    };
+    struct TrainRec
+    {
+        const std::string*  name;
+        const std::string*  edge;               // Null if off the track.
+        eEnd                end;
+        const std::string*  dest;               // Null if none.
+        double              length;
+    };
+    struct Snapshot
+    {
+        CowPages<EdgeRec>       edges;
+        CowPages<NodeRec>       nodes;
+        std::vector<TrainRec>   trains;
+    };
+
+    static void note(std::vector<int>& ids, std::vector<char>& marks, int id) {
+        if ((size_t)id >= marks.size()) { marks.resize(id + 1, 0); }
+        if (!marks[id]) {
+            marks[id] = 1;
+            ids.push_back(id);
+        }
+    }
+
+    void        build();
+    void        refresh();
+    static bool write(const Snapshot& snap, const std::string& path);
+
+    std::string         m_path;
+    long                m_period;
+    bool                m_built;
+
+    // The records, up to date but for the noted segments and nodes.
+    CowPages<EdgeRec>   m_edgeRecs;
+    CowPages<NodeRec>   m_nodeRecs;
+    std::vector<int>    m_edges;
+    std::vector<char>   m_edgeMarks;
+    std::vector<int>    m_nodes;
+    std::vector<char>   m_nodeMarks;
+
+    // The write under way: its thread and how it went.
+    enum eWrite { eWriteIdle, eWriteRunning, eWriteDone, eWriteFailed };
+    std::thread         m_writer;
+    std::atomic<int>    m_writeState;
+};
+
+} // namespace rrsim
+
+#endif // _CS_CHECKPOINT_H_
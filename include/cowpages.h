@@ -0,0 +1,71 @@
+// cowpages.h
+//
+// Author: Kendall Auel
+//
+// The template "CowPages" is an array kept in fixed pages behind
+// shared pointers, so that a copy of it shares every page and costs
+// one pointer per page. Writing to an entry first copies its page if
+// anyone else still holds it, so the copy keeps the entries it was
+// taken with while the original goes on changing, and a page nobody
+// else holds is written in place.
+//
+// A copy may be handed to another thread, which reads it and lets it
+// go. Only the thread that owns the original writes to it.
+
+#ifndef _CS_COWPAGES_H_
+#define _CS_COWPAGES_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace rrsim {
+
+template <typename T, size_t kPageSize = 256>
+class CowPages
+{
+public:
+    using Page = std::array<T, kPageSize>;
+
+    size_t      size() const { return m_pages.size() * kPageSize; }
+    size_t      pages() const { return m_pages.size(); }
+    void        clear() { m_pages.clear(); }
+
+    const T&    operator[](size_t ix) const {
+        return (*m_pages[ix / kPageSize])[ix % kPageSize];
+    }
+
+    // The entry to change, adding default entries up to it, with its
+    // page made this array's own.
+    T&          write(size_t ix) {
+        size_t px = ix / kPageSize;
+        while (m_pages.size() <= px) { m_pages.push_back(std::make_shared<Page>()); }
+        std::shared_ptr<Page>& page = m_pages[px];
+        if (page.use_count() > 1) {
+            page = std::make_shared<Page>(*page);
+        }
+        else {
+            // Another thread's last reads of the page come first.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return (*page)[ix % kPageSize];
+    }
+
+    // The pages still shared with another array.
+    size_t      shared(const CowPages& other) const {
+        size_t count = 0;
+        for (size_t px = 0; (px < m_pages.size()) && (px < other.m_pages.size()); px++) {
+            if (m_pages[px] == other.m_pages[px]) { count++; }
+        }
+        return count;
+    }
+
+private:
+    std::vector<std::shared_ptr<Page>> m_pages;
+};
+
+} // namespace rrsim
+
+#endif // _CS_COWPAGES_H_
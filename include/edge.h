@@ -6,7 +6,8 @@
 // two nodes. The weight of the edge corresponds to the length
 // of track.
 //
-// NOTE: currently, all edges are assumed to have weight = 1.
+// NOTE: routing counts every edge as weight 1. The weight does
+//       measure the length of a train (see fleet.h).
 //
 // A train can travel along the edge (track segment) in either
 // direction, toward node A or toward node B. When the train
@@ -45,32 +46,43 @@ class Train;
 class Edge : public std::enable_shared_from_this<Edge>
 {
 public:
-    Edge(const std::string& name);
+    Edge(NameID name, int id);
     ~Edge();
 
     RRsignal* getSignal(eEnd myEnd);
     void placeSignalLight(eEnd myEnd);
+    void removeSignalLight(eEnd myEnd);
 
-    TrainPtr getTrain() { return m_train; }
-    void setTrain(TrainPtr train) { m_train = train; }
+    // The train on this segment, kept by the TrainFleet.
+    TrainPtr getTrain();
+    void setTrain(TrainPtr train);
 
     NodeSlot getNode(eEnd getEnd);
     NodeSlot getAdjacent(eEnd getEnd);
     void assignNodeSlot(NodeSlot node, eEnd nodeEnd);
 
-    const std::string& name() { return m_name; }
+    const std::string& name() { return sys().nameOf(m_name); }
+    int id() { return m_id; }
+    double weight() { return m_weight; }
+    void setWeight(double weight);
 
     void show(eEnd showEnd = eNumEnds);
 
+    // What show prints beyond one end, as if the switch of a junction
+    // there were set to sw.
+    std::string endText(eEnd textEnd, eJSwitch sw);
+
     std::string serialize();
     void deserialize(const std::string& serialStr);
 
 private:
-    std::string     m_name;
+    eJSwitch switchAt(eEnd atEnd);
+
+    NameID          m_name;
+    int             m_id;
     double          m_weight;
     NodeSlot        m_ends[eNumEnds];
     RRsignal*       m_signals[eNumEnds];
-    TrainPtr        m_train;
 };
 
 } // namespace rrsim
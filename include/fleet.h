@@ -0,0 +1,225 @@
+// fleet.h
+//
+// Author: Kendall Auel
+//
+// The class "TrainFleet" holds the running state of every train in
+// parallel arrays indexed by train ID, and the occupancy of every
+// track segment indexed by edge ID. A Train object is a handle on
+// its entries here.
+//
+// Stepping a train first tries the common case with a few array
+// reads: the transition table has a successor for the train's state,
+// the train is not facing the common track of a junction (where its
+// route may want the switch changed), its signal is green, and the
+// next segment is free. Anything else falls back to
+// Train::stepSimulation. Both paths produce exactly the same result.
+//
+// Positions are kept as a state, edgeID * 2 + end, where end is the
+// end of the segment the train is traveling toward (see transition.h).
+//
+// After an edit to the network, the routes of the trains are checked
+// against the distances kept by RouteRepair, and only a route that no
+// longer leads to its destination, or no longer by a shortest way, is
+// replanned from where the train stands.
+//
+// With rerouting on, a train also keeps a ranked set of alternative
+// routes. When a red signal has held it for more than the patience in
+// steps, it changes to the next alternative that shares its route so
+// far and leaves it where the train stands, if there is one.
+//
+// A train has a length in segment weight and occupies a run of
+// consecutive segments, its consist, kept in a ring of edge IDs from
+// the tail to the head. A move adds the new head segment and releases
+// the tail segments the rest of the train no longer needs, so it costs
+// the same whatever the length. Every segment of the consist is marked
+// with the train in the occupancy, so a signal or a collision check
+// still looks at one segment at a time. A train placed on the track
+// starts on its one segment and draws out behind its head as it
+// moves, like a train leaving a yard.
+
+#ifndef _CS_FLEET_H_
+#define _CS_FLEET_H_
+
+#include "common.h"
+#include "routesearch.h"
+#include <cstdint>
+#include <vector>
+
+namespace rrsim {
+
+class RRsignal;
+
+class TrainFleet
+{
+public:
+    TrainFleet();
+
+    // Keep up to count routes per train, and reroute after a train has
+    // waited more than patience steps. One route turns rerouting off.
+    void    setRerouting(int count, int patience);
+    int     routeCount() const          { return m_rerouteCount; }
+
+    // Make room for a train, initially off the track. A removed train's
+    // ID may be added again.
+    void    addTrain(int train);
+    void    removeTrain(int train);
+    void    clear();
+
+    // Position, -1 when the train is not on the track.
+    int32_t stateOf(int train) const    { return m_state[train]; }
+    int     edgeOf(int train) const     { return m_state[train] >> 1; }
+    eEnd    endOf(int train) const      { return (eEnd)(m_state[train] & 1); }
+    bool    onTrack(int train) const    { return m_state[train] >= 0; }
+    void    setPosition(int train, int edge, eEnd end);
+
+    // Take the train off the track, releasing its whole consist.
+    void    clearPosition(int train);
+
+    // Put the head of the train on an edge, as it is placed.
+    void    enter(int train, int edge);
+
+    // Length in segment weight, 0 for a train that only ever takes
+    // the segment its head is on.
+    double  lengthOf(int train) const   { return m_length[train]; }
+    void    setLength(int train, double length);
+
+    // The segments the train occupies, from the tail to the head.
+    size_t  consistSize(int train) const { return m_consist[train].count; }
+    int     consistEdge(int train, size_t ix) const { return m_consist[train].at(ix); }
+    double  consistWeight(int train) const { return m_consist[train].weight; }
+
+    // Release the tail segments the train no longer covers once its
+    // head enters the edge. Calling it again before the move does
+    // nothing more.
+    void    releaseTail(int train, int edge);
+
+    // Destination edge, -1 for none.
+    int     destOf(int train) const     { return m_dest[train]; }
+    void    setDestination(int train, int edge);
+
+    // The trains bound for an edge, from a list kept per edge.
+    std::vector<int> boundFor(int edge) const;
+
+    // The route is the junction switch positions a train wants, in
+    // the order it reaches the junctions.
+    void    setRoute(int train, const std::vector<eJSwitch>& steps);
+    void    clearRoute(int train) {
+        m_routePos[train] = m_routeEnd[train];
+        m_alts[train].clear();
+    }
+    bool    routeEmpty(int train) const { return m_routePos[train] == m_routeEnd[train]; }
+    eJSwitch routeNext(int train) const { return (eJSwitch)m_routeSteps[m_routePos[train]]; }
+    void    routeAdvance(int train)     { m_routePos[train]++; }
+
+    // The switch positions the route still wants.
+    std::vector<uint8_t> routeAhead(int train) const {
+        return std::vector<uint8_t>(m_routeSteps.begin() + m_routePos[train],
+                                    m_routeSteps.begin() + m_routeEnd[train]);
+    }
+
+    // The simulation step before which the train stays where it is.
+    long    departureOf(int train) const { return m_depart[train]; }
+    void    setDeparture(int train, long step) { m_depart[train] = step; }
+
+    // Set the route from a ranked set of routes, the first is taken.
+    // The train must be at the start of the routes.
+    void    setRoutes(int train, const std::vector<Route>& routes);
+
+    // Move a train to the next state, releasing its tail. The caller
+    // checks the segment is free.
+    void    move(int train, int32_t next);
+
+    // The train was held by a red signal. Returns true if it changed to
+    // an alternative route.
+    bool    blocked(int train);
+
+    // The train on an edge, or -1.
+    int     occupant(int edge) const {
+        return ((size_t)edge < m_occupant.size()) ? m_occupant[edge] : -1;
+    }
+    void    setOccupant(int edge, int train);
+
+    // Replan the routes the network edits since the last call have
+    // broken or made longer than they need to be.
+    void    repairRoutes();
+
+    // Advance a train by one step. Returns false if the train has
+    // nowhere to go. Sets changed if the train moved or set a switch,
+    // i.e. if the signals may need to be updated.
+    bool    step(int train, bool& changed);
+
+private:
+    void    refreshTable();
+    void    appendRoute(int train, const uint8_t* steps, size_t count);
+    bool    reroute(int train);
+
+    // The alternative routes of a train: the states and switch steps
+    // of each, the number of states each pair of routes have in common
+    // from the start, and the route being followed.
+    struct Alternatives
+    {
+        std::vector<int32_t>    states;
+        std::vector<uint32_t>   statePos;   // Per route, plus the end.
+        std::vector<uint8_t>    steps;
+        std::vector<uint32_t>   stepPos;    // Per route, plus the end.
+        std::vector<uint32_t>   shared;     // Routes * routes.
+        int                     current = 0;
+
+        int     count() const { return (int)stepPos.size() - 1; }
+        void    clear();
+    };
+
+    // A ring of the edges a train occupies. The capacity is a power of
+    // two, so an index wraps with a mask.
+    struct Consist
+    {
+        std::vector<int32_t>    ring;
+        uint32_t                tail = 0;
+        uint32_t                count = 0;
+        double                  weight = 0.0;
+
+        int32_t at(size_t ix) const { return ring[(tail + ix) & (ring.size() - 1)]; }
+        void    push(int32_t edge, double w);
+        int32_t pop(double w);
+    };
+
+    // Per train.
+    std::vector<int32_t>    m_state;
+    std::vector<int32_t>    m_dest;
+    std::vector<int32_t>    m_routePos;
+    std::vector<int32_t>    m_routeEnd;
+    std::vector<int32_t>    m_hop;      // Moves since the route was set.
+    std::vector<int32_t>    m_waited;   // Steps held by a red signal.
+    std::vector<long>       m_depart;
+    std::vector<Alternatives> m_alts;
+    std::vector<double>     m_length;
+    std::vector<Consist>    m_consist;
+
+    // The trains bound for each edge, linked through the trains: the
+    // first train by edge, then the next and previous by train, or -1.
+    std::vector<int32_t>    m_boundFirst;
+    std::vector<int32_t>    m_boundNext;
+    std::vector<int32_t>    m_boundPrev;
+
+    int                     m_rerouteCount;
+    int                     m_reroutePatience;
+
+    // Route steps of all trains. A new route is appended, and the
+    // array is compacted when it grows past m_compactAt and most of it
+    // is stale.
+    std::vector<uint8_t>    m_routeSteps;
+    size_t                  m_compactAt;
+
+    // Per edge.
+    std::vector<int32_t>    m_occupant;
+
+    // Per state: the signal at that end, if any. Rebuilt when the
+    // topology changes.
+    std::vector<RRsignal*>  m_signal;
+    long                    m_tableVersion;
+    size_t                  m_logPos;   // In the transition table log.
+};
+
+} // namespace rrsim
+
+#endif // _CS_FLEET_H_
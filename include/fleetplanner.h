@@ -0,0 +1,112 @@
+// fleetplanner.h
+//
+// Author: Kendall Auel
+//
+// The class "FleetPlanner" plans the whole fleet at once, so that the
+// trains do not meet on the way. It works in the manner of cooperative
+// A*: the trains are planned one after another in name order, each
+// with a search over (state, time) pairs that avoids what the trains
+// before it have reserved. A train may wait on its start segment
+// before it departs, but never on the way, so the plan gives each
+// train a route and a departure step.
+//
+// The reservation table holds the segments in use at every step, each
+// kept clear for a step either side, and the windows in which every
+// junction switch must stand a given way. A train that finds the
+// switch the wrong way takes one step to set it, as in the simulation.
+// A train that has arrived stays on its destination for good, and a
+// train that is not planned yet stays on its start segment.
+//
+// The heuristic is the exact distance kept by RouteRepair, so the
+// search only spreads where reservations are in the way.
+
+#ifndef _CS_FLEETPLANNER_H_
+#define _CS_FLEETPLANNER_H_
+
+#include "common.h"
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace rrsim {
+
+class FleetPlanner
+{
+public:
+    // The plan of one train, times in steps from the start of the plan.
+    struct Plan
+    {
+        int                     train = -1;
+        bool                    planned = false;
+        int                     depart = 0;
+        int                     arrive = 0;
+        std::vector<eJSwitch>   steps;
+    };
+
+    // A train may arrive at most slack steps later than it would on an
+    // empty network, counting both the wait to depart and any detour.
+    explicit FleetPlanner(int slack);
+
+    // Plan every train on the track that has a destination.
+    void        plan();
+
+    // Give the trains their planned routes and departure steps. A train
+    // that could not be planned within the slack keeps its route, and
+    // leaves once the planned trains have all arrived.
+    void        apply() const;
+
+    const std::vector<Plan>& plans() const { return m_plans; }
+
+private:
+    // Switch position needed from start to end, and whether the train
+    // sets it at start.
+    struct Window
+    {
+        int32_t     end;
+        eJSwitch    pos;
+        bool        flip;
+    };
+
+    // A search node: a state at a time, and whether the train has left
+    // its start segment.
+    struct Step
+    {
+        int32_t     state;
+        int32_t     time;
+        int32_t     parent;
+        bool        moved;
+    };
+
+    bool        planTrain(Plan& plan);
+    eJSwitch    needed(int32_t state, int32_t next) const;
+    bool        edgeFree(int edge, int32_t time, int train) const;
+    bool        canPark(int edge, int32_t time, int train) const;
+    eJSwitch    switchAt(int node, int32_t time) const;
+    bool        windowFree(int node, int32_t start, int32_t end, eJSwitch pos) const;
+    void        reserve(const Plan& plan, const std::vector<Step>& path);
+
+    int                     m_slack;
+    std::vector<Plan>       m_plans;
+
+    // Per state: the junction it faces, or -1.
+    std::vector<int32_t>    m_junctionAt;
+
+    // Segment reservations by edge * 2^32 + time, holding the train.
+    std::unordered_map<uint64_t, int32_t> m_busy;
+
+    // Per edge: from when a train stays on it, which train, and the last
+    // step any train is on it.
+    std::vector<int32_t>    m_parkedFrom;
+    std::vector<int32_t>    m_parkedBy;
+    std::vector<int32_t>    m_lastUse;
+
+    // Per junction node: switch windows by start time.
+    std::unordered_map<int, std::multimap<int32_t, Window>> m_windows;
+    std::vector<eJSwitch>   m_switch;   // Position at the start of the plan.
+};
+
+} // namespace rrsim
+
+#endif // _CS_FLEETPLANNER_H_
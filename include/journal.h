@@ -0,0 +1,131 @@
+// journal.h
+//
+// Author: Kendall Auel
+//
+// The class "Journal" saves a large network incrementally. The first
+// save to a path writes the whole network, the base, and every later
+// save only appends the lines of what changed since the save before
+// to the journal beside it, the path with ".journal" added:
+//
+//     track: <as Edge::serialize>      A segment added or changed.
+//     untrack: <name>                  A segment removed.
+//     switch: <node>,<L|R>             A junction switch position.
+//     train: <name>,<edge>,<A|B>,<dest>,<length>
+//                                      A train, "-" when off the track.
+//     untrain: <name>                  A train removed.
+//
+// A later line for a name replaces the earlier ones. The System reports
+// the edges whose lines may have changed, the switches that moved and
+// the trains removed, and a save writes their lines from the network
+// as it is then, along with every train. A save costs the edits since
+// the last one and the trains, whatever the size of the network.
+//
+// Once the journal has grown to a share of the base, a thread folds it
+// into a new base by name, from the files alone, while the simulation
+// and the saves go on. The base and the journal start with an epoch
+// line. The fold first writes a mark into the journal, and its base,
+// one epoch on, replaces the old one by a rename; the journal is then
+// cut back to the lines after the mark. Loading a base replays the
+// journal of its epoch, or what follows the mark in the journal of the
+// epoch before, so a crash at any point recovers the last save.
+//
+// A train is put back on the segment its head was on, traveling the
+// same way, and routed anew to its destination. The rest of its
+// consist draws out again as it moves.
+
+#ifndef _CS_JOURNAL_H_
+#define _CS_JOURNAL_H_
+
+#include "common.h"
+#include <atomic>
+#include <iosfwd>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rrsim {
+
+class Journal
+{
+public:
+    Journal();
+    ~Journal();
+
+    bool        attached() const { return !m_path.empty(); }
+    const std::string& path() const { return m_path; }
+    long        epoch() const { return m_epoch; }
+
+    // Stop journaling, as when the whole network is replaced. A fold
+    // under way is finished first. The next save writes a new base.
+    void        detach();
+
+    // Edits since the last save, reported by the System.
+    void        edgeChanged(int edge) {
+        if (attached()) { note(m_edges, m_edgeMarks, edge); }
+    }
+    void        switchChanged(int node) {
+        if (attached()) { note(m_switches, m_switchMarks, node); }
+    }
+    void        edgeRemoved(const std::string& name) {
+        if (attached()) { m_untracked.push_back(name); }
+    }
+    void        trainRemoved(const std::string& name) {
+        if (attached()) { m_untrained.push_back(name); }
+    }
+
+    // Save to the base file at path: the whole network the first time,
+    // or to a new path, and only the edits after that. Returns an errno
+    // value.
+    int         save(const std::string& path);
+
+    // Replay the journal of the base just loaded from path, if it has
+    // one, and go on journaling to it. Returns an errno value.
+    int         recover(const std::string& path);
+
+    // True for a switch, train or untrain line, which a base may hold
+    // after its segments.
+    static bool isState(const std::string& line);
+
+    // Apply switch, train and untrain lines. The trains named are taken
+    // off the track before any is placed. Throws if a line is malformed.
+    static void applyState(const std::vector<std::string>& lines);
+
+private:
+    static void note(std::vector<int>& ids, std::vector<char>& marks, int id) {
+        if ((size_t)id >= marks.size()) { marks.resize(id + 1, 0); }
+        if (!marks[id]) {
+            marks[id] = 1;
+            ids.push_back(id);
+        }
+    }
+
+    void        forget();
+    int         writeBase(const std::string& path);
+    size_t      writeEdits(std::ostream& os, bool all);
+    void        startFold();
+    void        finishFold(bool wait);
+
+    std::string         m_path;         // Of the base, empty if detached.
+    long                m_epoch;
+    size_t              m_lines;        // In the journal.
+    size_t              m_baseLines;
+
+    std::vector<int>    m_edges;        // Changed since the last save.
+    std::vector<char>   m_edgeMarks;
+    std::vector<int>    m_switches;
+    std::vector<char>   m_switchMarks;
+    std::vector<std::string> m_untracked;
+    std::vector<std::string> m_untrained;
+
+    // The fold under way: its thread, how it went, the size of the
+    // journal up to and with the mark, and the lines of the new base.
+    enum eFold { eFoldIdle, eFoldRunning, eFoldDone, eFoldFailed };
+    std::thread         m_fold;
+    std::atomic<int>    m_foldState;
+    long                m_markEnd;
+    size_t              m_foldLines;
+};
+
+} // namespace rrsim
+
+#endif // _CS_JOURNAL_H_
@@ -0,0 +1,102 @@
+// memstat.h
+//
+// Author: Kendall Auel
+//
+// Heap allocation accounting by subsystem.
+//
+// When the project is configured with -DCS_SIGNALING_MEMSTAT=ON, the
+// library replaces the global operator new and delete. Every heap
+// block carries a small header recording its size and the subsystem
+// that allocated it, so that frees are charged back to the same
+// subsystem no matter where they happen. The subsystem is chosen by
+// the innermost MemScope on the allocating thread:
+//
+//     MemScope scope(eMemTopology);
+//     ... every allocation in here is charged to the topology ...
+//
+// Allocations outside of any scope are charged to eMemOther.
+//
+// With the option off the allocator is left alone, the scopes compile
+// to nothing and every count reads zero.
+
+#ifndef _CS_MEMSTAT_H_
+#define _CS_MEMSTAT_H_
+
+#include "config.h"
+#include <cstdint>
+#include <string>
+
+namespace rrsim {
+
+enum eMemTag {
+    eMemOther,          // Not attributed to any subsystem.
+    eMemTopology,       // Edges, nodes, their names and lookup tables.
+    eMemSignals,        // Signal lights and signal evaluation.
+    eMemTrains,         // Trains and their routes.
+    eMemRouting,        // Route search scratch space.
+    eMemIO,             // Save and load buffers.
+
+    eNumMemTags
+};
+
+struct MemUsage
+{
+    int64_t     liveBytes;      // Bytes currently allocated.
+    int64_t     liveObjects;    // Blocks currently allocated.
+    int64_t     peakBytes;      // High water mark of liveBytes.
+    uint64_t    totalAllocs;    // Blocks allocated since start.
+    uint64_t    totalBytes;     // Bytes allocated since start.
+};
+
+class MemStats
+{
+public:
+    // Whether the allocations are accounted for at all.
+    static bool enabled();
+
+    // Current accounting for one subsystem, or all of them summed. The
+    // peak of the sum is the high water mark of the total live bytes,
+    // not the sum of the peaks.
+    static MemUsage usage(eMemTag tag);
+    static MemUsage total();
+
+    // Human readable report. With segments > 0, also reports the bytes
+    // per track segment. The compact form is a single line.
+    static std::string report(long segments, bool compact = false);
+
+    static const char* tagName(eMemTag tag);
+};
+
+#ifdef RRSIM_MEMSTAT
+
+extern thread_local eMemTag g_memTag;
+
+// Charge the allocations of the current thread to a subsystem until the
+// end of the enclosing scope.
+//
+class MemScope
+{
+public:
+    explicit MemScope(eMemTag tag) : m_saved(g_memTag) { g_memTag = tag; }
+    ~MemScope() { g_memTag = m_saved; }
+    MemScope(MemScope const&)       = delete;
+    void operator=(MemScope const&) = delete;
+private:
+    eMemTag m_saved;
+};
+
+#else // RRSIM_MEMSTAT
+
+class MemScope
+{
+public:
+    explicit MemScope(eMemTag) {}
+    MemScope(MemScope const&)       = delete;
+    void operator=(MemScope const&) = delete;
+};
+
+#endif // RRSIM_MEMSTAT
+
+} // namespace rrsim
+
+#endif // _CS_MEMSTAT_H_
@@ -0,0 +1,88 @@
+// nametable.h
+//
+// Author: Kendall Auel
+//
+// Name interning and name lookup for the System tables.
+//
+// The class "NameTable" keeps one copy of every name used by an edge,
+// node or train, and hands out a small dense NameID for it. Objects
+// keep only the NameID, and the System looks objects up through a
+// per-kind IdIndex from NameID to the object's dense ID.
+//
+// Both are open-addressing hash tables with linear probing, kept at
+// most half full. Names are never released, so reloading a network
+// re-uses the names it had before.
+
+#ifndef _CS_NAMETABLE_H_
+#define _CS_NAMETABLE_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace rrsim {
+
+using NameID = uint32_t;
+static const NameID kNoName = 0xffffffff;
+
+class NameTable
+{
+public:
+    NameTable();
+
+    // Return the ID of the name, adding it if necessary.
+    NameID intern(const std::string& str);
+
+    // Return the ID of the name, or kNoName if it was never interned.
+    NameID find(const std::string& str) const;
+
+    // A deque never moves its elements, so these references are stable.
+    const std::string& str(NameID id) const { return m_strings[id]; }
+
+    size_t size() const { return m_strings.size(); }
+
+private:
+    static uint64_t hash(const std::string& str);
+    void grow();
+
+    std::deque<std::string> m_strings;  // By NameID.
+    std::vector<uint64_t>   m_hashes;   // By NameID, to rehash cheaply.
+    std::vector<NameID>     m_slots;    // Power of two, kNoName if empty.
+};
+
+class IdIndex
+{
+public:
+    IdIndex();
+
+    // Return the dense ID stored for the name, or -1.
+    int  find(NameID name) const;
+
+    // Add the name, false if it is already present.
+    bool insert(NameID name, int id);
+
+    // Remove the name, false if it was not present.
+    bool erase(NameID name);
+
+    void clear();
+    void reserve(size_t count);
+    size_t size() const { return m_count; }
+
+private:
+    struct Slot
+    {
+        NameID  name;
+        int     id;
+    };
+
+    static size_t hash(NameID name) { return (size_t)name * 0x9E3779B97F4A7C15ull; }
+    void rehash(size_t slots);
+
+    std::vector<Slot>   m_slots;    // Power of two, name kNoName if empty.
+    size_t              m_count;
+};
+
+} // namespace rrsim
+
+#endif // _CS_NAMETABLE_H_
@@ -0,0 +1,81 @@
+// netbuilder.h
+//
+// Author: Kendall Auel
+//
+// The class "NetBuilder" constructs a track network in bulk. It is
+// the fast path for generators and importers, where the network is
+// large and known to be well formed.
+//
+// Compared to System::createEdge and System::connectSegments:
+// - A node is created only when an end is first connected, or by
+//   finish() for an end that was never connected. There are no
+//   throwaway terminator nodes.
+// - Names are taken from the system's monotonic counters.
+// - Errors (duplicate names, connecting to an occupied end) do not
+//   stop construction. The offending call is skipped, and finish()
+//   reports every error at once after a single validation pass.
+//   Connecting an end to itself is a mistake of the caller, not of
+//   the data, and throws at once.
+//
+// The network is not usable until finish() has been called. Until
+// then, an unconnected end of a new edge has no node at all.
+//
+//     NetBuilder nb(count);
+//     EdgePtr e1 = nb.addEdge();
+//     EdgePtr e2 = nb.addEdge();
+//     nb.connect(EdgeEnd(e1, eEndB), EdgeEnd(e2, eEndA));
+//     nb.finish();
+
+#ifndef _CS_NETBUILDER_H_
+#define _CS_NETBUILDER_H_
+
+#include "common.h"
+#include "system.h"
+#include <string>
+#include <vector>
+
+namespace rrsim {
+
+class NetBuilder
+{
+public:
+    // The hint is the number of edges expected, for reserving storage.
+    explicit NetBuilder(size_t edgeHint = 0);
+    ~NetBuilder();
+
+    // Create an edge with the given name, or the next unique name.
+    EdgePtr addEdge(const std::string& name = System::emptyStr);
+
+    // Connect two edge ends, by the same rules as connectSegments: the
+    // end of s2 must be unconnected, the end of s1 may be unconnected
+    // (continuation) or a continuation (junction, s1 is the common).
+    void connect(const EdgeEnd& s1, const EdgeEnd& s2);
+
+    // Node type at an edge end. An end that has not been connected yet
+    // is reported as a terminator.
+    eNodeType endType(const EdgeEnd& ee);
+
+    // Place terminators on the ends that were never connected, and
+    // validate the edges built. Throws if anything went wrong.
+    void finish();
+
+    size_t edgeCount() { return m_edges.size(); }
+    size_t errorCount() { return m_errors; }
+
+    NetBuilder(NetBuilder const&)       = delete;
+    void operator=(NetBuilder const&)   = delete;
+
+private:
+    NodePtr newNode();
+    void    closeEnds();
+    void    error(const std::string& msg);
+
+    std::vector<EdgePtr>    m_edges;
+    size_t                  m_errors;
+    std::string             m_firstError;
+    bool                    m_finished;
+};
+
+} // namespace rrsim
+
+#endif // _CS_NETBUILDER_H_
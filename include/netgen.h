@@ -0,0 +1,74 @@
+// netgen.h
+//
+// Author: Kendall Auel
+//
+// The class "NetGenerator" builds synthetic track networks of
+// arbitrary size in the System singleton. The network is constructed
+// with a NetBuilder, so it obeys the same connection rules as a
+// network built by hand, and can be serialized and loaded back.
+//
+// Supported topologies:
+//   mainline - a single long chain of track segments.
+//   ladder   - two parallel lines joined by crossovers.
+//   grid     - several parallel lines joined by staggered crossovers,
+//              so every interior node is a junction.
+//   tree     - a random tree that grows by extension and branching,
+//              with occasional loops and yard fans.
+
+#ifndef _CS_NETGEN_H_
+#define _CS_NETGEN_H_
+
+#include "common.h"
+#include "netbuilder.h"
+#include <string>
+#include <vector>
+#include <random>
+
+namespace rrsim {
+
+struct GenOptions
+{
+    std::string topology    = "mainline";
+    long        segments    = 1000;
+    unsigned    seed        = 1;
+    std::string signals     = "none";   // none, junctions or all.
+    int         spacing     = 4;        // Segments between crossovers.
+    int         rows        = 8;        // Parallel lines in a grid.
+};
+
+class NetGenerator
+{
+public:
+    explicit NetGenerator(const GenOptions& opts);
+
+    // Build the requested topology and place signals. Throws on an
+    // unknown topology or signal placement, or a malformed network.
+    void build();
+
+    // All segments created so far, in creation order.
+    const std::vector<EdgePtr>& edges() { return m_edges; }
+
+private:
+    EdgePtr newSegment();
+    void connect(EdgePtr s1, eEnd e1, EdgePtr s2, eEnd e2);
+    std::vector<EdgePtr> chain(long count);
+    void crossover(std::vector<EdgePtr>& from, std::vector<EdgePtr>& to, long ix);
+
+    void buildMainline();
+    void buildLadder();
+    void buildGrid();
+    void buildTree();
+    void buildFan(const EdgeEnd& lead, std::vector<EdgeEnd>& open);
+    void placeSignals();
+
+    size_t pick(size_t count);
+
+    GenOptions              m_opts;
+    std::mt19937            m_rng;
+    NetBuilder              m_builder;
+    std::vector<EdgePtr>    m_edges;
+};
+
+} // namespace rrsim
+
+#endif // _CS_NETGEN_H_
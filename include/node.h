@@ -23,6 +23,7 @@
 #define _CS_NODE_H_
 
 #include "common.h"
+#include "system.h"
 #include <string>
 #include <map>
 
@@ -35,10 +36,12 @@ namespace rrsim {
 class Node
 {
 public:
-    Node(const std::string& name);
+    Node(NameID name, int id);
     ~Node();
 
-    eNodeType getNodeType();
+    // The type follows from the slots in use. It is kept up to date by
+    // the System whenever the slots change (see System::reindexNode).
+    eNodeType getNodeType() { return m_type; }
 
     // Make this node a terminator by setting the EdgeEnd into the first
     // slot. This assumes that all slots are currently empty.
@@ -68,21 +71,36 @@ public:
     // switched, the EdgeEnd will also be empty.
     EdgeEnd getNext(eSlot slot);
 
-    const std::string& name() { return m_name; }
+    const std::string& name() { return sys().nameOf(m_name); }
+    int id() { return m_id; }
 
     eJSwitch    getSwitchPos()              { return m_switchState; }
-    void        setSwitchPos(eJSwitch jsw)  { m_switchState = jsw; }
+    void        setSwitchPos(eJSwitch jsw) {
+        m_switchState = jsw;
+        sys().switchChanged(m_id, jsw);
+    }
     void        toggleSwitchPos() {
-        m_switchState = (m_switchState == eSwitchLeft) ? eSwitchRight
-                                                       : eSwitchLeft;
+        setSwitchPos((m_switchState == eSwitchLeft) ? eSwitchRight
+                                                    : eSwitchLeft);
     }
 
     void show();
 
 private:
-    std::string     m_name;
+    friend class System;
+
+    NameID          m_name;
+    int             m_id;
     EdgeEnd         m_slots[3];
     eJSwitch        m_switchState;
+
+    // Find the type from the slots in use.
+    eNodeType       probeType();
+
+    // The node type, and where the System's node type index has this
+    // node.
+    eNodeType       m_type;
+    int             m_typePos;
 };
 
 } // namespace rrsim
@@ -0,0 +1,80 @@
+// nodekind.h
+//
+// Author: Kendall Auel
+//
+// Compile-time descriptions of the node kinds. Each kind has a
+// constexpr slot transition table: for every switch position and
+// every slot a train can enter by, the slot it leaves by, or
+// eNumSlots if it cannot pass. A terminator and a continuation
+// ignore the switch.
+//
+// visitNodeKind branches on the node type once and calls a generic
+// function with the NodeKind, so code written against a NodeKind is
+// compiled once per kind with its tables and slot count as constants.
+
+#ifndef _CS_NODEKIND_H_
+#define _CS_NODEKIND_H_
+
+#include "common.h"
+#include <stdexcept>
+
+namespace rrsim {
+
+static constexpr int kNumSwitch = eSwitchRight + 1;
+
+template <eNodeType Kind>
+struct NodeKind;
+
+template <>
+struct NodeKind<eTerminator>
+{
+    static constexpr eNodeType  kType = eTerminator;
+    static constexpr int        kSlots = 1;
+    static constexpr eSlot      kExit[kNumSwitch][eNumSlots] = {
+        { eNumSlots, eNumSlots, eNumSlots },
+        { eNumSlots, eNumSlots, eNumSlots },
+        { eNumSlots, eNumSlots, eNumSlots },
+    };
+};
+
+template <>
+struct NodeKind<eContinuation>
+{
+    static constexpr eNodeType  kType = eContinuation;
+    static constexpr int        kSlots = 2;
+    static constexpr eSlot      kExit[kNumSwitch][eNumSlots] = {
+        { eSlot2, eSlot1, eNumSlots },
+        { eSlot2, eSlot1, eNumSlots },
+        { eSlot2, eSlot1, eNumSlots },
+    };
+};
+
+template <>
+struct NodeKind<eJunction>
+{
+    static constexpr eNodeType  kType = eJunction;
+    static constexpr int        kSlots = 3;
+    static constexpr eSlot      kExit[kNumSwitch][eNumSlots] = {
+        { eNumSlots, eNumSlots, eNumSlots },    // Not switched.
+        { eSlot2,    eSlot1,    eNumSlots },    // Left.
+        { eSlot3,    eNumSlots, eSlot1    },    // Right.
+    };
+};
+
+// Call f(NodeKind<type>()) and return its result. There is no kind
+// for an empty node.
+template <typename F>
+auto visitNodeKind(eNodeType type, F&& f)
+{
+    switch (type) {
+    case eTerminator:   return f(NodeKind<eTerminator>());
+    case eContinuation: return f(NodeKind<eContinuation>());
+    case eJunction:     return f(NodeKind<eJunction>());
+    default:
+        throw std::runtime_error("visitNodeKind: node has no kind");
+    }
+}
+
+} // namespace rrsim
+
+#endif // _CS_NODEKIND_H_
@@ -0,0 +1,52 @@
+// reachability.h
+//
+// Author: Kendall Auel
+//
+// The class "ReachIndex" is a union-find over the directed states of
+// the track network, edgeID * 2 + end (see transition.h). The state of
+// a segment facing a node is joined with every state a train can enter
+// through that node, whatever the switch positions. A junction joins
+// its common track with each fork, never the two forks.
+//
+// Two segments in different components can never be joined by a
+// route, so a route search can be refused at once. The converse does
+// not hold: the index knows nothing about reversing, so being in the
+// same component only means a search is worth doing.
+//
+// Links are only ever added. Nodes whose slots changed are queued by
+// System::reindexNode and linked at the next query, once their slots
+// are settled.
+
+#ifndef _CS_REACHABILITY_H_
+#define _CS_REACHABILITY_H_
+
+#include "common.h"
+#include <cstdint>
+#include <vector>
+
+namespace rrsim {
+
+class ReachIndex
+{
+public:
+    void        clear();
+
+    // The slots of the node changed.
+    void        nodeChanged(int node) { m_pending.push_back(node); }
+
+    // False if no route can lead from one edge to the other.
+    bool        mayReach(int fromEdge, int toEdge);
+
+private:
+    void        linkPending();
+    int32_t     find(int32_t state);
+    void        join(int32_t s1, int32_t s2);
+
+    std::vector<int32_t>    m_parent;
+    std::vector<uint8_t>    m_rank;
+    std::vector<int>        m_pending;
+};
+
+} // namespace rrsim
+
+#endif // _CS_REACHABILITY_H_
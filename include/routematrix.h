@@ -0,0 +1,74 @@
+// routematrix.h
+//
+// Author: Kendall Auel
+//
+// The class "RouteMatrix" holds the shortest route between every pair
+// of a set of track segments, usually the terminator segments and any
+// named stations: the travel cost in segments, the end of the start
+// segment to set off toward, and the junction switch positions.
+//
+// One RouteSearch runs per origin, covering every destination at once,
+// and the origins are shared out over a pool of threads.
+//
+// The matrix remembers the topology version it was computed for, and
+// while that is current it answers the route searches of the trains.
+
+#ifndef _CS_ROUTEMATRIX_H_
+#define _CS_ROUTEMATRIX_H_
+
+#include "common.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace rrsim {
+
+class RouteMatrix
+{
+public:
+    RouteMatrix();
+
+    // The segments with a terminator at either end, sorted by name.
+    static std::vector<EdgePtr> terminatorEdges();
+
+    // Compute the routes between all pairs of the given segments, on
+    // the given number of threads (0 for one per hardware thread).
+    void        compute(const std::vector<EdgePtr>& ends, unsigned threads);
+    void        clear();
+
+    size_t      size() const { return m_edges.size(); }
+
+    // Travel cost from one segment of the matrix to another by index,
+    // or -1 if there is no route.
+    int         cost(size_t from, size_t to) const { return m_cost[from * size() + to]; }
+
+    // One line per ordered pair: from,to,cost,toward,switches, where
+    // toward is the end of the start segment (A or B) and switches is
+    // a string of L and R. An unreachable pair has cost -1.
+    void        writeCSV(std::ostream& ostr) const;
+
+    // The route between two segments, if the matrix is current and has
+    // one. Also gives the states of the route in travel order (see
+    // RouteSearch::route).
+    bool        lookup(int fromEdge, int toEdge, eEnd& startEnd,
+                       std::vector<eJSwitch>& steps,
+                       std::vector<int32_t>& path) const;
+
+private:
+    long                    m_version;
+    std::vector<int>        m_edges;        // Edge IDs by index.
+    std::vector<int32_t>    m_indexOf;      // Index by edge ID, or -1.
+
+    // Per pair, from * size() + to.
+    std::vector<int32_t>    m_cost;
+    std::vector<uint8_t>    m_startEnd;
+    std::vector<uint32_t>   m_stepPos;
+    std::vector<uint32_t>   m_stepLen;
+
+    // The switch steps of the routes from each origin.
+    std::vector<std::vector<uint8_t>> m_steps;
+};
+
+} // namespace rrsim
+
+#endif // _CS_ROUTEMATRIX_H_
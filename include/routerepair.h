@@ -0,0 +1,86 @@
+// routerepair.h
+//
+// Author: Kendall Auel
+//
+// The class "RouteRepair" keeps the routes of placed trains valid when
+// the track network is edited under them. It holds one incremental
+// planner per destination, shared by all trains headed there, in the
+// manner of LPA* run backward from the destination: every state (see
+// transition.h) knows its distance in moves to the destination
+// segment, and an edit only revisits the states whose distance it
+// changes.
+//
+// The edits are found from the log of patched states of the transition
+// table, or, after the table was rebuilt, by comparing its branches
+// with a copy taken at the last sync, so any change to the network is
+// covered however it was made. The branches do not depend on the
+// junction switches, and neither do the routes, so moving a switch
+// never calls for a repair.
+//
+// The states leading into a state are found from the branches of its
+// reverse: a train can pass a node one way exactly when it can pass
+// it the other way, so t leads into s when s ^ 1 leads into t ^ 1.
+
+#ifndef _CS_ROUTEREPAIR_H_
+#define _CS_ROUTEREPAIR_H_
+
+#include "common.h"
+#include "transition.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace rrsim {
+
+class RouteRepair
+{
+public:
+    static constexpr int32_t kUnreachable = INT32_MAX / 2;
+
+    RouteRepair();
+
+    void        clear();
+
+    // Catch up with the table. Returns true if any branches changed
+    // since the last sync, in which case the routes of the trains may
+    // need repair. The first sync only takes a copy of the table.
+    bool        sync(const TransitionTable& table);
+
+    // Moves from the state to the target edge, or kUnreachable.
+    int32_t     distance(int target, int32_t state);
+
+    // The switch steps of a shortest route from the state to the
+    // target edge. Returns false if there is none.
+    bool        route(int target, int32_t state, std::vector<eJSwitch>& steps);
+
+    // Forget the planners of destinations not in the list.
+    void        retain(const std::vector<int>& targets);
+
+private:
+    // The distances to one target. A state is consistent when its
+    // distance g equals rhs, the best distance its branches offer;
+    // the others wait in the heap keyed by the smaller of the two.
+    struct Planner
+    {
+        std::vector<int32_t>    g;
+        std::vector<int32_t>    rhs;
+        std::vector<std::pair<int32_t, int32_t>> heap;
+    };
+
+    Planner&    plannerFor(int target);
+    void        update(Planner& plan, int target, int32_t state);
+    void        settle(Planner& plan, int target);
+
+    const TransitionTable*  m_table;
+    long                    m_version;
+    size_t                  m_logPos;
+
+    // The branches at the last sync, by state.
+    std::vector<int32_t>    m_branch;
+
+    std::map<int, Planner>  m_planners;
+};
+
+} // namespace rrsim
+
+#endif // _CS_ROUTEREPAIR_H_
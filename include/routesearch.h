@@ -0,0 +1,108 @@
+// routesearch.h
+//
+// Author: Kendall Auel
+//
+// The class "RouteSearch" is the breadth-first route search of the
+// trains. It visits states (see transition.h), starting from both ends
+// of the start segment, and follows the branches of each state, so a
+// train may take either side of a junction but never pass from one
+// fork to the other. Every segment weighs the same, so the first time
+// a segment is reached is by a shortest route.
+//
+// Alternative routes are found in the manner of Yen's k shortest paths:
+// each new route leaves a route already found at one of its states,
+// with the states before it and the branches taken there by the routes
+// sharing that beginning ruled out, and the shortest of the candidates
+// is taken next.
+//
+// The search only reads the TransitionTable, so any number of searches
+// may run at once on different threads, each with its own RouteSearch,
+// as long as the network does not change meanwhile.
+
+#ifndef _CS_ROUTESEARCH_H_
+#define _CS_ROUTESEARCH_H_
+
+#include "common.h"
+#include "transition.h"
+#include <cstdint>
+#include <vector>
+
+namespace rrsim {
+
+// A route as a list of states in travel order, from the start to the
+// state entering the target, and the switch positions wanted on it.
+struct Route
+{
+    std::vector<int32_t>    states;
+    std::vector<eJSwitch>   steps;
+
+    eEnd    startEnd() const { return (eEnd)(states.front() & 1); }
+    int     cost() const { return (int)states.size() - 1; }
+};
+
+class RouteSearch
+{
+public:
+    // The table must cover the network for the life of the search.
+    explicit RouteSearch(const TransitionTable& table);
+
+    // Search from the start edge until the target edge is reached, or
+    // through everything reachable if target is -1. Returns whether the
+    // target was reached.
+    bool        search(int start, int target);
+
+    // Results of the last search, for any edge it reached.
+    bool        reached(int edge) const {
+        return ((size_t)edge < m_hitFrom.size()) && (m_hitFrom[edge] >= 0);
+    }
+
+    // The number of segments a train moves through to get there.
+    int         cost(int edge) const;
+
+    // The end of the start segment the train sets off toward, and the
+    // junction switch positions it needs, in travel order. If path is
+    // given, it receives the states of the route in travel order,
+    // including the start but not the target.
+    eEnd        route(int edge, std::vector<eJSwitch>& steps,
+                      std::vector<int32_t>* path = nullptr) const;
+
+    // Up to count routes from the start edge to the target edge, the
+    // shortest first, which is the route found by search. Returns the
+    // number found.
+    int         alternatives(int start, int target, int count,
+                             std::vector<Route>& routes);
+
+private:
+    void        reset();
+    void        visit(int32_t state, int32_t parent, uint8_t via);
+
+    // Run the queued search. The branches from spur to any state in
+    // banned are skipped.
+    bool        expand(int target, int32_t spur,
+                       const std::vector<int32_t>& banned);
+
+    // The route of the last search to the target, as its states, after
+    // the given root states.
+    void        makeRoute(int target, const int32_t* root, size_t rootLen,
+                          Route& route) const;
+
+    const TransitionTable&  m_table;
+
+    // Per state: the state it was reached from (-1 for a start, -2 if
+    // not visited), the branch taken, and the depth.
+    std::vector<int32_t>    m_parent;
+    std::vector<uint8_t>    m_via;
+    std::vector<int32_t>    m_depth;
+
+    // Per edge: the state it was first reached from, and the branch.
+    std::vector<int32_t>    m_hitFrom;
+    std::vector<uint8_t>    m_hitVia;
+
+    std::vector<int32_t>    m_queue;
+    std::vector<int>        m_hitEdges;
+    std::vector<int32_t>    m_closed;   // States ruled out of a search.
+};
+
+} // namespace rrsim
+
+#endif // _CS_ROUTESEARCH_H_
@@ -21,6 +21,7 @@
 #define _CS_RRSIGNAL_H_
 
 #include "common.h"
+#include <cstdint>
 
 namespace rrsim {
 
@@ -33,9 +34,16 @@ public:
     void updateSignal();
     bool signalIsRed() { return m_isRed; }
 
+    // Signals are allocated from the signal arena of the System.
+    static void* operator new(size_t size);
+    static void  operator delete(void* ptr, size_t size);
+
 private:
+    // Evaluate the track beyond the signal, true if it must be red.
+    bool checkForRed();
+
     bool        m_isRed;
-    EdgeEnd     m_edge;
+    int32_t     m_state;    // Edge ID * 2 + end (see transition.h).
 };
 
 } // namespace rrsim
@@ -0,0 +1,63 @@
+// soak.h
+//
+// Author: Kendall Auel
+//
+// The class "SoakMode" runs the simulation as an open system for soak
+// testing: new trains spawn on a set of segments, by default the
+// terminator segments, at a steady rate, each bound for another of
+// them, and a train that has arrived is retired. Retired trains give
+// back their table slot, their arena block, their name and their
+// route storage, so memory and the cost of a step stay flat for as
+// long as the run goes on.
+//
+// Spawns, arrivals and the steps every trip took are counted in the
+// simulation statistics, which can be dumped periodically (see
+// System::setStatsDump) or printed by System::runSoak.
+
+#ifndef _CS_SOAK_H_
+#define _CS_SOAK_H_
+
+#include "common.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace rrsim {
+
+class SoakMode
+{
+public:
+    SoakMode();
+
+    // Spawn rate trains per step, on and between the given edges.
+    void        start(const std::vector<int>& ends, double rate, unsigned seed);
+    void        stop();
+    bool        active() const { return m_rate > 0.0; }
+    void        clear();
+
+    // Retire the trains that arrived and spawn the new ones due at this
+    // step. Returns true if any train came or went.
+    bool        tick(long step);
+
+    size_t      liveTrains() const { return m_live.size(); }
+
+    // A train was removed from the System, by the soak or from the
+    // menu. A soak train is no longer tracked, so its ID may be reused.
+    void        trainRemoved(int train);
+
+private:
+    void        spawn(long step);
+
+    std::vector<int>    m_ends;
+    double              m_rate;
+    double              m_credit;   // Spawns owed, whole ones are due.
+    std::mt19937        m_rng;
+
+    std::vector<int>    m_live;     // IDs of the soak trains.
+    std::vector<int>    m_livePos;  // Index in m_live by train ID, or -1.
+    std::vector<long>   m_born;     // Spawn step by train ID.
+};
+
+} // namespace rrsim
+
+#endif // _CS_SOAK_H_
@@ -0,0 +1,168 @@
+// stateview.h
+//
+// Author: Kendall Auel
+//
+// The class "StateView" is a picture of the running state taken at the
+// end of a step: the occupancy by segment, the switch by node, the
+// signal aspect by edge end and the position of every train. Once
+// published it never changes, so any thread may read it while the
+// simulation goes on.
+//
+// The class "ViewPublisher" publishes a view after every step, and
+// readers take the latest without locks. A reader holds its view for as
+// long as it keeps its Reader, and the simulation thread never waits
+// for it: a view that is replaced is retired, and freed by a later
+// publication once every reader that could have taken it is gone.
+// Each reader marks a slot of its own with the epoch it started in,
+// and a view retired at epoch R is freed when no slot is marked below
+// R (epoch-based reclamation).
+//
+// The state is kept in copy-on-write pages (see cowpages.h). The
+// System reports the occupancy, switches and signals that change, and
+// only their pages are copied, so a publication costs the changes of
+// the step, the trains and a pointer per page. Every page is copied,
+// shared and let go by the thread that publishes; readers only read.
+//
+// The topology is not in the view. It does not change while the
+// simulation runs, so readers take it from the System beforehand.
+// Names are interned for good and never move (see nametable.h), so
+// the view points at the names of the trains.
+
+#ifndef _CS_STATEVIEW_H_
+#define _CS_STATEVIEW_H_
+
+#include "common.h"
+#include "cowpages.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rrsim {
+
+class StateView
+{
+public:
+    struct TrainPos
+    {
+        const std::string*  name = nullptr;     // Null if no train.
+        int32_t             state = -1;         // Head state, -1 if off the track.
+        int32_t             dest = -1;          // Edge, or -1.
+    };
+
+    // The simulation step the view was taken at.
+    long        step() const { return m_step; }
+
+    // The train on a segment, or -1.
+    int         occupant(int edge) const {
+        return ((size_t)edge < m_occupant.size()) ? m_occupant[edge] - 1 : -1;
+    }
+    eJSwitch    switchOf(int node) const {
+        return ((size_t)node < m_switch.size()) ? (eJSwitch)m_switch[node] : eSwitchNone;
+    }
+
+    // The signal at an edge end (edge ID * 2 + end).
+    bool        hasSignal(int32_t state) const { return aspect(state) != eAspectNone; }
+    bool        signalIsRed(int32_t state) const { return aspect(state) == eAspectRed; }
+
+    // The trains by ID.
+    const std::vector<TrainPos>& trains() const { return m_trains; }
+
+private:
+    friend class ViewPublisher;
+
+    enum eAspect { eAspectNone, eAspectGreen, eAspectRed };
+
+    uint8_t     aspect(int32_t state) const {
+        return ((state >= 0) && ((size_t)state < m_aspect.size())) ? m_aspect[state] : (uint8_t)eAspectNone;
+    }
+
+    long                    m_step = 0;
+    CowPages<int32_t>       m_occupant;     // Train ID + 1, 0 if none.
+    CowPages<uint8_t>       m_switch;       // By node.
+    CowPages<uint8_t>       m_aspect;       // By edge end.
+    std::vector<TrainPos>   m_trains;
+};
+
+class ViewPublisher
+{
+public:
+    // Readers at once. A reader beyond these waits for a slot.
+    static constexpr size_t kReaders = 64;
+
+    ViewPublisher();
+    ~ViewPublisher();
+
+    bool        active() const { return m_active; }
+
+    // Take the whole state and publish it, then publish after every
+    // step until stopped. The last view stays published.
+    void        start();
+    void        stop();
+
+    // Changes to the running state, reported by the System.
+    void        occupantChanged(int edge, int train) {
+        if (m_active) { m_next.m_occupant.write(edge) = train + 1; }
+    }
+    void        switchChanged(int node, eJSwitch jsw) {
+        if (m_active) { m_next.m_switch.write(node) = (uint8_t)jsw; }
+    }
+    void        signalChanged(int32_t state, bool red) {
+        if (m_active) {
+            m_next.m_aspect.write(state) = red ? StateView::eAspectRed : StateView::eAspectGreen;
+        }
+    }
+
+    // Publish the state at the end of a step.
+    void        endOfStep(long step);
+
+    // The latest view, held until the reader goes. Any thread.
+    class Reader
+    {
+    public:
+        explicit Reader(ViewPublisher& publisher);
+        ~Reader();
+
+        // Null if nothing has been published.
+        const StateView* view() const { return m_view; }
+
+        Reader(Reader const&)           = delete;
+        void operator=(Reader const&)   = delete;
+
+    private:
+        std::atomic<uint64_t>*  m_slot;
+        const StateView*        m_view;
+    };
+
+    ViewPublisher(ViewPublisher const&) = delete;
+    void operator=(ViewPublisher const&) = delete;
+
+private:
+    static constexpr uint64_t kFree = 0;
+
+    void        publish(long step);
+    void        reclaim();
+
+    bool                    m_active;
+    StateView               m_next;         // Kept up to date, but the trains.
+
+    std::atomic<StateView*> m_current;
+    std::atomic<uint64_t>   m_epoch;
+
+    // The epoch each reader started in, or kFree. A line each, as the
+    // readers write them.
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{kFree};
+    };
+    std::array<Slot, kReaders> m_slots;
+
+    // Replaced views and the epoch they were retired at.
+    std::vector<std::pair<StateView*, uint64_t>> m_retired;
+};
+
+} // namespace rrsim
+
+#endif // _CS_STATEVIEW_H_
@@ -0,0 +1,184 @@
+// stats.h
+//
+// Author: Kendall Auel
+//
+// Hot-path counters and latency histograms for the simulation.
+//
+// Each thread that records statistics accumulates them in its own
+// StatBlock, so the simulation thread never contends with anyone
+// while counting. Only the thread that owns a block writes to it;
+// readers merge all blocks into a snapshot on demand. Blocks outlive
+// their threads, so the totals survive the end of a simulation run.
+//
+// Latencies are recorded in nanoseconds into log-linear histograms
+// (in the style of HdrHistogram): exact below 32 ns, then 16 buckets
+// per power of two, which keeps the relative error under 7% over the
+// whole 64-bit range with a fixed amount of memory.
+
+#ifndef _CS_STATS_H_
+#define _CS_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace rrsim {
+
+// Event counters.
+//
+enum eStatCounter {
+    eStatTicks,             // Simulation steps of the whole system.
+    eStatTrainsMoved,       // Train advanced to the next segment.
+    eStatBlockedSignal,     // Train held by a red signal.
+    eStatBlockedSwitch,     // Train held by a junction switch position.
+    eStatSwitchFlips,       // Junction switch moved by a train.
+    eStatSignalFlips,       // Signal changed between red and green.
+    eStatReroutes,          // Train switched to an alternative route.
+    eStatRouteRepairs,      // Train route replanned after a network edit.
+    eStatDepartures,        // Train placed from the timetable.
+    eStatDeparturesHeld,    // Timetable departure held, start segment taken.
+    eStatTrainsSpawned,     // Soak train placed.
+    eStatSpawnsMissed,      // Soak spawn skipped, no free start segment.
+    eStatTrainsArrived,     // Soak train retired at its destination.
+    eStatTripSteps,         // Steps taken by the retired soak trains.
+    eStatCheckpoints,       // Checkpoint written in the background.
+    eStatCheckpointsSkipped, // Checkpoint skipped, the last still writing.
+    eStatViewsPublished,    // Read view published for other threads.
+
+    eNumStatCounters
+};
+
+// Latency histograms.
+//
+enum eStatTimer {
+    eTimeTick,              // One simulation step of the whole system.
+    eTimeTrainStep,         // Train::stepSimulation.
+    eTimeSignalUpdate,      // System::updateAllSignals.
+    eTimeRoutePlan,         // Train::getOptimalRoute.
+    eTimeCheckpoint,        // Checkpoint snapshot, on the simulation thread.
+    eTimePublish,           // Read view publication, on the simulation thread.
+
+    eNumStatTimers
+};
+
+class Histogram
+{
+public:
+    static const int kSubBits = 5;
+    static const int kNumBuckets = (1 << kSubBits) + (64 - kSubBits) * (1 << (kSubBits - 1));
+
+    Histogram() { clear(); }
+
+    // Record one value. Only called by the owning thread.
+    void record(uint64_t value) {
+        bump(m_buckets[bucketOf(value)]);
+        bump(m_count);
+        m_total.store(m_total.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+        if (value > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void clear();
+    void merge(const Histogram& other);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t total() const { return m_total.load(std::memory_order_relaxed); }
+    uint64_t max() const   { return m_max.load(std::memory_order_relaxed); }
+    double   mean() const  { return count() ? (double)total() / count() : 0.0; }
+
+    // Value at the given percentile (0..100), to bucket precision.
+    uint64_t percentile(double pct) const;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketLow(int index);
+    static uint64_t bucketHigh(int index);
+
+private:
+    static void bump(std::atomic<uint64_t>& cell) {
+        cell.store(cell.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t>   m_buckets[kNumBuckets];
+    std::atomic<uint64_t>   m_count;
+    std::atomic<uint64_t>   m_total;
+    std::atomic<uint64_t>   m_max;
+};
+
+struct StatBlock
+{
+    std::atomic<uint64_t>   counters[eNumStatCounters];
+    Histogram               timers[eNumStatTimers];
+
+    StatBlock() { clear(); }
+    void clear();
+    void merge(const StatBlock& other);
+};
+
+class SimStats
+{
+public:
+    static SimStats& instance();
+
+    // The calling thread's block, created on first use.
+    static StatBlock& local();
+
+    static void count(eStatCounter ctr, uint64_t n = 1) {
+        std::atomic<uint64_t>& cell = local().counters[ctr];
+        cell.store(cell.load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+    }
+    static void time(eStatTimer tmr, uint64_t ns) {
+        local().timers[tmr].record(ns);
+    }
+
+    // Merge every thread's block into out.
+    void snapshot(StatBlock& out);
+    void reset();
+
+    std::string toText();
+    std::string toJson();
+
+    // Write the current statistics to a file, as JSON if the path ends
+    // in ".json" and as text otherwise. Returns 0 or an errno value.
+    int dump(const std::string& path);
+
+    // Disallow copying the SimStats singleton.
+    SimStats(SimStats const&)       = delete;
+    void operator=(SimStats const&) = delete;
+
+private:
+    SimStats();
+    ~SimStats();
+
+    StatBlock* acquireBlock();
+    void releaseBlock(StatBlock* block);
+
+    friend struct StatBlockHandle;
+    struct Registry;
+    Registry* m_registry;
+};
+
+// Scoped latency measurement.
+//
+class StatTimer
+{
+public:
+    explicit StatTimer(eStatTimer tmr)
+        : m_timer(tmr), m_start(std::chrono::steady_clock::now()) {}
+    ~StatTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_start).count();
+        SimStats::time(m_timer, (uint64_t)ns);
+    }
+private:
+    eStatTimer                              m_timer;
+    std::chrono::steady_clock::time_point   m_start;
+};
+
+} // namespace rrsim
+
+#endif // _CS_STATS_H_
@@ -12,23 +12,31 @@
 #define _CS_SYSTEM_H_
 
 #include "common.h"
+#include "arena.h"
+#include "nametable.h"
+#include "fleet.h"
+#include "transition.h"
+#include "reachability.h"
+#include "routesearch.h"
+#include "routematrix.h"
+#include "routerepair.h"
+#include "timetable.h"
+#include "soak.h"
+#include "journal.h"
+#include "checkpoint.h"
+#include "stateview.h"
 #include <string>
-#include <map>
 #include <memory>
+#include <queue>
 #include <vector>
 #include <fstream>
+#include <functional>
 
 namespace rrsim {
 
-using EdgeMap   = std::map<std::string, EdgePtr>;
-using NodeMap   = std::map<std::string, NodePtr>;
-using TrainMap  = std::map<std::string, TrainPtr>;
-
-using EdgeItem  = EdgeMap::value_type;
-using NodeItem  = NodeMap::value_type;
-using TrainItem = TrainMap::value_type;
-
+using EdgeVec   = std::vector<EdgePtr>;
 using NodeVec   = std::vector<NodePtr>;
+using TrainVec  = std::vector<TrainPtr>;
 
 class System
 {
@@ -39,14 +47,29 @@ public:
     static const std::string emptyStr;
 
     void        resetTrackNetwork();
-    int         edgeCount() { return (int)m_edgeMap.size(); }
+    int         edgeCount() { return (int)m_edges.count; }
+    int         nodeCount(eNodeType type) { return (int)m_nodesByType[type].size(); }
+
+    // The IDs of the nodes of one type, in no particular order.
+    const std::vector<int>& nodesOfType(eNodeType type) { return m_nodesByType[type]; }
+
+    // Edits may be made between simulation steps. The derived tables
+    // follow them at the cost of the edit, and the IDs and names of
+    // removed objects are reused. Every so many edits the derived
+    // tables are rebuilt to drop what the edits left behind.
 
     EdgePtr     createEdge(const std::string& name = emptyStr);
     EdgePtr     getEdge(const std::string& name);
+
+    // Cut the segment from its nodes and remove it, along with a node
+    // it leaves without segments. Throws if a train is on it.
     void        removeEdge(const std::string& name);
 
     NodePtr     createNode(const std::string& name = emptyStr);
     NodePtr     getNode(const std::string& name);
+
+    // Give every segment at the node a terminator of its own, and
+    // remove the node.
     void        removeNode(const std::string& name);
 
     TrainPtr    createTrain(const std::string& name = emptyStr);
@@ -56,20 +79,135 @@ public:
     int         connectSegments(const EdgeEnd& s1, const EdgeEnd& s2);
     int         stepSimulation();
     int         runSimulation();
+
+    // Step the simulation without showing the trains, printing a line
+    // of soak statistics every report steps (never if 0).
+    int         runSoak(long steps, long report);
     int         showEdges();
     int         showNodes();
 
     void        addSignalsToAllJunctions();
     void        updateAllSignals();
-    NodeVec     getAllJunctions();
+    NodeVec     getAllJunctions();    // Sorted by name.
     int         serialize(std::ofstream& ofstr);
     int         deserialize(std::ifstream& ifstr);
 
+    // Bring the network in line with a saved one by editing only the
+    // segments whose connections, weight or signals differ, matching
+    // segments by name. Trains on the segments removed, reconnected
+    // or reweighed are taken off the track, the others keep running.
+    // The file is checked before anything is changed.
+    int         reload(std::ifstream& ifstr);
+
+    // Apply the segments in the lines as reload does, but remove only
+    // the named segments rather than those not in the lines.
+    int         patch(std::istream& istr, const std::vector<std::string>& removed);
+
+    // Write the simulation statistics to path every period steps
+    // (see stats.h). An empty path or a zero period stops the dumps.
+    void        setStatsDump(const std::string& path, int period);
+
+    // Signal lights are allocated here (see RRsignal::operator new).
+    Arena&      signalArena() { return m_signalArena; }
+
+    // Train positions, routes and segment occupancy.
+    TrainFleet& fleet() { return m_fleet; }
+
+    // Simulation steps taken since the program started.
+    long        simStep() { return m_simStep; }
+
+    // Incremented by every change to the track network, including
+    // signal placement, so that derived tables know to rebuild.
+    long        topologyVersion() { return m_topoVersion; }
+    void        touchTopology() { m_topoVersion++; }
+
+    // An edge was added, removed or had a signal placed.
+    void        edgeChanged(int edge) {
+        m_transitions.edgeChanged(edge);
+        m_journal.edgeChanged(edge);
+        m_checkpoint.edgeChanged(edge);
+        touchTopology();
+    }
+
+    // Rebuild the derived tables and trim the object tables. Called by
+    // the edits every so often.
+    void        compact();
+
+    // Successors of every edge end (see transition.h), rebuilt here if
+    // the topology changed. Junctions report switch changes.
+    const TransitionTable& transitions() {
+        if (!m_transitions.current(m_topoVersion)) {
+            m_transitions.update(m_topoVersion);
+        }
+        return m_transitions;
+    }
+    // Which segments can possibly be joined by a route.
+    ReachIndex& reach() { return m_reach; }
+
+    // The route search of the trains, on the current transitions.
+    RouteSearch& routeSearch() { transitions(); return m_search; }
+
+    // Routes between terminators and stations, computed on request. It
+    // also serves the trains while the topology is unchanged.
+    RouteMatrix& routeMatrix() { return m_routeMatrix; }
+
+    // Distances to the destinations of the trains, kept up to date
+    // across network edits (see TrainFleet::repairRoutes).
+    RouteRepair& routeRepair() { return m_repair; }
+
+    // Departures still to come, placed at the start of every step.
+    Timetable&  timetable() { return m_timetable; }
+
+    // Open-system soak testing, ticked at the start of every step.
+    SoakMode&   soak() { return m_soak; }
+
+    // Incremental saves (see journal.h).
+    Journal&    journal() { return m_journal; }
+
+    // Saves in the background while the simulation runs (see
+    // checkpoint.h), taken at the end of a step.
+    Checkpoint& checkpoint() { return m_checkpoint; }
+
+    // The running state published for other threads (see stateview.h),
+    // after every step of a run.
+    ViewPublisher& views() { return m_views; }
+
+    // Whether trains print their routes as they are placed.
+    bool        verbose() { return m_verbose; }
+    void        setVerbose(bool verbose) { m_verbose = verbose; }
+    void        switchChanged(int node, eJSwitch jsw) {
+        m_transitions.switchChanged(node, jsw, m_topoVersion);
+        m_journal.switchChanged(node);
+        m_checkpoint.nodeChanged(node);
+        m_views.switchChanged(node, jsw);
+    }
+
+    // Every object keeps the ID of its name in this table.
+    const std::string& nameOf(NameID name) { return m_names.str(name); }
+
+    // Objects by dense ID, in creation order. An object that has been
+    // removed leaves a null entry.
+    const EdgeVec&  edges()     { return m_edges.items; }
+    const NodeVec&  nodes()     { return m_nodes.items; }
+    const TrainVec& trains()    { return m_trains.items; }
+
+    // The same objects without the null entries, sorted by name. Use
+    // these wherever the order is visible to the user.
+    const EdgeVec&  sortedEdges();
+    const NodeVec&  sortedNodes();
+    const TrainVec& sortedTrains();
+
+    // Move a node to the index of its current type. Called by the Node
+    // whenever its slots change.
+    void        reindexNode(Node& node);
+
     // Disallow copying the System singleton.
     System(System const&)           = delete;
     void operator=(System const&)   = delete;
 
 private:
+    friend class NetBuilder;
+
     System();
     ~System();
 
@@ -77,9 +215,116 @@ private:
     std::string getUniqueNodeName();
     std::string getUniqueTrainName();
 
-    EdgeMap     m_edgeMap;
-    NodeMap     m_nodeMap;
-    TrainMap    m_trainMap;
+    // One step of the whole system: soak trains and timetable
+    // departures are placed, then every train moves in name order with
+    // the signals updated after each move. afterTrain, if given, is
+    // called after each train with whether it has more to do.
+    // moreSteps is set if any train or departure has more to do.
+    using TrainStepFn = std::function<void(const TrainPtr&, bool)>;
+    void        tick(bool& moreSteps, const TrainStepFn& afterTrain = TrainStepFn());
+    void        endOfStep();
+
+    // Take an edge end out of its node, moving the later slots down,
+    // and remove the node if that leaves it empty.
+    void        detachEnd(Edge& edge, eEnd end);
+    void        dropNode(Node& node);
+
+    // Remove the terminator an end had before it was connected.
+    void        dropTerminator(Node& node);
+
+    // Remove an edge already cut from its nodes.
+    void        dropEdge(Edge& edge);
+
+    // Reload or patch: the lines compared with the segments, and with
+    // no removals given, the segments not in the lines removed.
+    int         applyTracks(std::istream& istr, const std::vector<std::string>* removals);
+
+    // Count edits toward the next compaction.
+    void        noteEdit(long count = 1);
+
+    // The numbers of the unique names of one kind: where the search
+    // for the next one resumes, and the numbers given back by removed
+    // objects, lowest first.
+    struct NameSeq
+    {
+        long    next = 1;
+        std::priority_queue<long, std::vector<long>, std::greater<long>> freed;
+
+        void    clear();
+    };
+    void        releaseName(NameSeq& seq, const std::string& name, const char* format);
+
+    // The objects of one kind: a dense table by ID, and an index from
+    // the interned name to the ID.
+    template <typename T>
+    struct Table
+    {
+        std::vector<std::shared_ptr<T>> items;
+        IdIndex                         byName;
+        size_t                          count = 0;
+        std::vector<std::shared_ptr<T>> sorted;
+        bool                            sortedValid = false;
+        std::vector<int>                freeIds;    // Null entries to reuse.
+
+        void clear();
+    };
+
+    template <typename T>
+    std::shared_ptr<T> findObject(Table<T>& table, const std::string& name);
+    template <typename T>
+    std::shared_ptr<T> addObject(Table<T>& table, Arena& arena,
+                                 const std::string& name);
+    template <typename T>
+    void        removeObject(Table<T>& table, int id);
+    template <typename T>
+    void        trimTable(Table<T>& table);
+    template <typename T>
+    std::string uniqueName(Table<T>& table, NameSeq& seq, const char* format);
+    template <typename T>
+    const std::vector<std::shared_ptr<T>>& sortedView(Table<T>& table);
+
+    // Create an object with a name known to be unique, or return null
+    // if it is not.
+    EdgePtr     addEdge(const std::string& name);
+    NodePtr     addNode(const std::string& name);
+
+    // Edges, nodes and trains live in an arena per kind, in creation
+    // order. The arenas must outlive the tables, so they come first.
+    Arena       m_edgeArena;
+    Arena       m_nodeArena;
+    Arena       m_trainArena;
+    Arena       m_signalArena;
+
+    NameTable       m_names;
+    Table<Edge>     m_edges;
+    Table<Node>     m_nodes;
+    Table<Train>    m_trains;
+
+    // Node IDs by node type.
+    std::vector<int> m_nodesByType[eJunction + 1];
+
+    TrainFleet  m_fleet;
+    TransitionTable m_transitions;
+    ReachIndex  m_reach;
+    RouteSearch m_search;
+    RouteMatrix m_routeMatrix;
+    RouteRepair m_repair;
+    Timetable   m_timetable;
+    SoakMode    m_soak;
+    Journal     m_journal;
+    Checkpoint  m_checkpoint;
+    ViewPublisher m_views;
+    long        m_topoVersion;
+    long        m_edits;        // Since the last compaction.
+
+    NameSeq     m_edgeNames;
+    NameSeq     m_nodeNames;
+    NameSeq     m_trainNames;
+
+    long        m_simStep;
+    bool        m_verbose;
+    std::string m_statsPath;
+    int         m_statsPeriod;
 };
 
 } // namespace rrsim
@@ -0,0 +1,72 @@
+// timetable.h
+//
+// Author: Kendall Auel
+//
+// The class "Timetable" holds the departures still to come: a train,
+// the segment it starts from, its destination and the simulation step
+// it is due. The pending departures wait in a priority queue by step,
+// so each tick only looks at the departures that are due, and placing
+// a train costs O(log n) whatever the size of the timetable.
+//
+// A train whose start segment is taken when it is due waits for the
+// next step, keeping its place ahead of later departures.
+
+#ifndef _CS_TIMETABLE_H_
+#define _CS_TIMETABLE_H_
+
+#include "common.h"
+#include <cstdint>
+#include <istream>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace rrsim {
+
+class Timetable
+{
+public:
+    Timetable();
+
+    void        clear();
+
+    // Read departures, one per line as "train,origin,destination,step",
+    // with the step counted from now, optionally followed by ",length"
+    // (see fleet.h). An empty train name means a new train. Blank lines
+    // and lines starting with '#' are skipped.
+    // Returns the number read, or throws on a bad line.
+    size_t      load(std::istream& istr, long now);
+
+    // A length of 0 leaves the length of the train as it is.
+    void        add(const std::string& train, int origin, int dest, long step,
+                    double length = 0.0);
+    size_t      pending() const { return m_queue.size(); }
+
+    // Place the trains due by the given step whose start segments are
+    // free. Returns the number placed.
+    int         inject(long step);
+
+private:
+    struct Departure
+    {
+        long        step;
+        uint32_t    seq;        // Order of the timetable among equals.
+        int         origin;
+        int         dest;
+        double      length;
+        std::string train;
+    };
+    struct Later
+    {
+        bool operator()(const Departure& a, const Departure& b) const {
+            return (a.step != b.step) ? (a.step > b.step) : (a.seq > b.seq);
+        }
+    };
+
+    std::priority_queue<Departure, std::vector<Departure>, Later> m_queue;
+    uint32_t    m_seq;
+};
+
+} // namespace rrsim
+
+#endif // _CS_TIMETABLE_H_
@@ -0,0 +1,92 @@
+// trace.h
+//
+// Author: Kendall Auel
+//
+// Compile-time tracepoints for timeline analysis of the simulation.
+//
+// When the project is configured with -DCS_SIGNALING_TRACE=ON, the
+// macros below record scoped spans and instant events, which are
+// written to a trace-event JSON file (rrsim_trace.json, or the path
+// in the RRSIM_TRACE_FILE environment variable) that can be opened
+// in chrome://tracing or https://ui.perfetto.dev. Otherwise the
+// macros compile to nothing and their arguments are not evaluated.
+//
+//   RRSIM_TRACE_SCOPE("name");             span until the end of scope
+//   RRSIM_TRACE_INSTANT("name", detail);   single event, detail is a
+//                                          std::string expression
+//   RRSIM_TRACE_THREAD("name");            label the calling thread
+
+#ifndef _CS_TRACE_H_
+#define _CS_TRACE_H_
+
+#include "config.h"
+
+#ifdef RRSIM_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace rrsim {
+
+class Tracer
+{
+public:
+    static Tracer& instance();
+
+    static uint64_t now() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void span(const char* name, uint64_t start, uint64_t end);
+    void instant(const char* name, const std::string& detail);
+    void threadName(const char* name);
+
+    // Write out everything recorded so far.
+    void flush();
+
+    // Disallow copying the Tracer singleton.
+    Tracer(Tracer const&)           = delete;
+    void operator=(Tracer const&)   = delete;
+
+private:
+    Tracer();
+    ~Tracer();
+
+    struct Impl;
+    Impl* m_impl;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : m_name(name), m_start(Tracer::now()) {}
+    ~TraceScope() { Tracer::instance().span(m_name, m_start, Tracer::now()); }
+private:
+    const char* m_name;
+    uint64_t    m_start;
+};
+
+} // namespace rrsim
+
+#define RRSIM_TRACE_CONCAT2(a, b) a##b
+#define RRSIM_TRACE_CONCAT(a, b) RRSIM_TRACE_CONCAT2(a, b)
+
+#define RRSIM_TRACE_SCOPE(name) \
+    rrsim::TraceScope RRSIM_TRACE_CONCAT(rrsimTraceScope, __LINE__)(name)
+#define RRSIM_TRACE_INSTANT(name, detail) \
+    rrsim::Tracer::instance().instant((name), (detail))
+#define RRSIM_TRACE_THREAD(name) \
+    rrsim::Tracer::instance().threadName(name)
+
+#else
+
+#define RRSIM_TRACE_SCOPE(name)             ((void)0)
+#define RRSIM_TRACE_INSTANT(name, detail)   ((void)0)
+#define RRSIM_TRACE_THREAD(name)            ((void)0)
+
+#endif // RRSIM_TRACE
+
+#endif // _CS_TRACE_H_
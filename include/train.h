@@ -15,30 +15,37 @@
 // If the train encounters a terminator at the end of a track
 // segment, it will stop permanently. The train has a specific
 // direction of travel, and will not reverse direction.
+//
+// The position, destination and route of the train are kept in the
+// TrainFleet of the System (see fleet.h), by train ID.
 
 #ifndef _CS_TRAIN_H_
 #define _CS_TRAIN_H_
 
 #include "common.h"
+#include "system.h"
 #include <string>
-#include <stack>
 
 namespace rrsim {
 
-using Route = std::stack<eJSwitch>;
-
 class Train : public std::enable_shared_from_this<Train>
 {
 public:
-    Train(const std::string& name);
+    Train(NameID name, int id);
     ~Train();
 
-    EdgeEnd getPosition() { return m_edge; }
+    EdgeEnd getPosition();
     void placeOnTrack(EdgePtr start, EdgePtr end);
 
-    const std::string& name() { return m_name; }
+    // Put the train back where a save found it, traveling toward the
+    // given end, and route it to the destination if there is a way.
+    void restore(EdgePtr edge, eEnd toward, EdgePtr end);
 
-    // Returns false when the train has reached a terminator.
+    const std::string& name() { return sys().nameOf(m_name); }
+    int id() { return m_id; }
+
+    // Returns false when the train has reached a terminator. This is
+    // the general case; TrainFleet::step handles the common case.
     bool stepSimulation();
 
     void show();
@@ -46,11 +53,16 @@ public:
 private:
 
     void getOptimalRoute();
+    void showRoute(EdgePtr end, const std::vector<eJSwitch>& route,
+                   const std::vector<int32_t>& path,
+                   const std::vector<Route>& routes);
+
+    // Move the head to the next state (see transition.h), the tail
+    // follows.
+    void moveTo(int32_t next);
 
-    std::string m_name;
-    EdgeEnd     m_edge;
-    EdgeRef     m_destination;
-    Route       m_route;
+    NameID      m_name;
+    int         m_id;
 };
 
 } // namespace rrsim
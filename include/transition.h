@@ -0,0 +1,130 @@
+// transition.h
+//
+// Author: Kendall Auel
+//
+// The class "TransitionTable" answers "where does this end of the
+// segment lead" with one indexed load. A state is edgeID * 2 + end,
+// a train on that edge traveling toward that end. The table maps each
+// state to the state entered on the far side of the node at that end,
+// or to kBlocked or kTerminal.
+//
+// Most entries only depend on the topology. When the topology version
+// of the System changes, only the states facing the nodes whose slots
+// changed, and the states of edges added or removed, are patched; the
+// table is rebuilt when there are many of them. The entries of the
+// three states facing a junction also depend on its switch. The
+// successors for every switch position are kept with the junction, so
+// a switch change patches just those three entries.
+//
+// Every patched state is appended to a log, so that tables derived
+// from this one (see RouteRepair and TrainFleet) can follow an edit at
+// the cost of the edit. A rebuild starts the log over.
+//
+// The table also keeps the branches of every state: its successors
+// under any switch position, for route searches. A state facing the
+// common track of a junction has two, left then right.
+//
+// The rebuild walks the nodes of each kind in turn, using the slot
+// transition table of the kind (see nodekind.h).
+
+#ifndef _CS_TRANSITION_H_
+#define _CS_TRANSITION_H_
+
+#include "common.h"
+#include "nodekind.h"
+#include <cstdint>
+#include <vector>
+
+namespace rrsim {
+
+class TransitionTable
+{
+public:
+    // The node is a junction not switched toward this state.
+    static constexpr int32_t kBlocked = -1;
+    // The node is a terminator, or the end is not connected.
+    static constexpr int32_t kTerminal = -2;
+
+    TransitionTable();
+
+    bool        current(long version) const { return m_version == version; }
+    long        version() const { return m_version; }
+    void        rebuild(long version);
+
+    // Bring the table up to the version by patching the changed nodes
+    // and edges, or by a rebuild.
+    void        update(long version);
+
+    // Force the next update to rebuild, e.g. after a reset.
+    void        invalidate() { m_version = -1; }
+
+    // The slots of a node changed, or an edge was added, removed or had
+    // a signal placed.
+    void        nodeChanged(int node) { m_dirtyNodes.push_back(node); }
+    void        edgeChanged(int edge) { m_dirtyEdges.push_back(edge); }
+
+    // The log of patched states. A reader keeps the position it has
+    // read up to; a position before logStart() means the table was
+    // rebuilt since, and the reader must start over.
+    size_t      logStart() const { return m_logBase; }
+    size_t      logEnd() const { return m_logBase + m_log.size(); }
+    int32_t     logAt(size_t pos) const { return m_log[pos - m_logBase]; }
+
+    // The number of states, twice the number of edge IDs.
+    size_t      states() const { return m_next.size(); }
+
+    int32_t     next(int32_t state) const { return m_next[state]; }
+
+    // Successor k (0 or 1) under any switch position, or kTerminal.
+    int32_t     branch(int32_t state, int k) const { return m_branch[state * 2 + k]; }
+
+    // The node at the end of a state, and the slot the edge uses.
+    eNodeType   facingType(int32_t state) const {
+        return (eNodeType)(m_facing[state] & 3);
+    }
+    eSlot       facingSlot(int32_t state) const {
+        return (eSlot)(m_facing[state] >> 2);
+    }
+
+    // The state of a train on the edge heading toward the given end,
+    // and of a train entering the edge at that end. kTerminal if the
+    // edge is gone.
+    static int32_t facingState(const EdgeEnd& edge);
+    static int32_t enterState(const EdgeEnd& edge);
+
+    // Patch the entries of a junction after its switch changed. Does
+    // nothing if the table is stale, the rebuild reads the switch.
+    void        switchChanged(int node, eJSwitch jsw, long version);
+
+private:
+    struct Junction
+    {
+        int32_t facing[eNumSlots];              // The state facing the
+                                                // node, per slot.
+        int32_t next[kNumSwitch][eNumSlots];    // Its successor, per
+                                                // switch position.
+    };
+
+    template <typename Kind>
+    void        addNodes(Kind);
+    template <typename Kind>
+    void        addNode(Kind, Node& node);
+    void        setJunction(const Junction& jct, eJSwitch jsw);
+
+    std::vector<int32_t>    m_next;
+    std::vector<int32_t>    m_branch;
+    std::vector<uint8_t>    m_facing;
+    std::vector<Junction>   m_junctions;
+    std::vector<int32_t>    m_junctionOf;   // By node ID, or -1.
+    std::vector<int32_t>    m_freeJunctions;
+    long                    m_version;
+
+    std::vector<int>        m_dirtyNodes;
+    std::vector<int>        m_dirtyEdges;
+    std::vector<int32_t>    m_log;
+    size_t                  m_logBase;
+};
+
+} // namespace rrsim
+
+#endif // _CS_TRANSITION_H_
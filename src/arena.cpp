@@ -0,0 +1,147 @@
+// arena.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the Arena class.
+
+#include "arena.h"
+#include <cstdint>
+#include <new>
+
+namespace rrsim {
+
+Arena::Arena(size_t chunkSize)
+    : m_chunkSize(chunkSize), m_current(0),
+      m_next(nullptr), m_end(nullptr), m_live(0), m_releasing(std::thread::id())
+{
+}
+
+Arena::~Arena()
+{
+    for (Chunk& chunk: m_chunks) {
+        ::operator delete(chunk.base);
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    void* free = takeFree(size, align);
+    if (free) {
+        m_live.fetch_add(1, std::memory_order_relaxed);
+        return free;
+    }
+    for (;;) {
+        if (m_next) {
+            uintptr_t addr = (reinterpret_cast<uintptr_t>(m_next) + align - 1)
+                           & ~(uintptr_t)(align - 1);
+            char* ptr = reinterpret_cast<char*>(addr);
+            if (ptr + size <= m_end) {
+                m_next = ptr + size;
+                m_live.fetch_add(1, std::memory_order_relaxed);
+                return ptr;
+            }
+            m_current++;
+        }
+        // Move on to the next chunk, reusing one left from before the
+        // last rewind if it is large enough.
+        while ((m_current < m_chunks.size()) &&
+               (m_chunks[m_current].size < size + align)) {
+            m_current++;
+        }
+        if (m_current >= m_chunks.size()) {
+            size_t chunkSize = (size + align > m_chunkSize) ? size + align
+                                                            : m_chunkSize;
+            m_chunks.push_back({ static_cast<char*>(::operator new(chunkSize)),
+                                 chunkSize });
+            m_current = m_chunks.size() - 1;
+        }
+        m_next = m_chunks[m_current].base;
+        m_end = m_next + m_chunks[m_current].size;
+    }
+}
+
+void* Arena::takeFree(size_t size, size_t align)
+{
+    for (FreeList& list: m_free) {
+        if ((list.size == size) && (list.align >= align) && list.head) {
+            void* ptr = list.head;
+            list.head = *static_cast<void**>(ptr);
+            return ptr;
+        }
+    }
+    return nullptr;
+}
+
+void Arena::deallocate(void* ptr, size_t size)
+{
+    if (m_releasing.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+        m_live.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (m_live.fetch_sub(1, std::memory_order_relaxed) == 1) {
+        rewind();
+        return;
+    }
+    if (size < sizeof(void*)) { return; }
+
+    // The alignment is not passed back, so keep blocks by the largest
+    // alignment their address allows, up to what allocate is asked for.
+    size_t align = alignof(std::max_align_t);
+    while (reinterpret_cast<uintptr_t>(ptr) & (align - 1)) { align >>= 1; }
+    FreeList* found = nullptr;
+    for (FreeList& list: m_free) {
+        if ((list.size == size) && (list.align == align)) { found = &list; break; }
+    }
+    if (!found) {
+        m_free.push_back(FreeList{size, align, nullptr});
+        found = &m_free.back();
+    }
+    *static_cast<void**>(ptr) = found->head;
+    found->head = ptr;
+}
+
+void Arena::rewind()
+{
+    m_current = 0;
+    m_next = nullptr;
+    m_end = nullptr;
+    m_free.clear();
+}
+
+Arena::Release::Release(Arena& arena)
+    : m_arena(arena), m_guard(arena.m_lock)
+{
+    m_arena.m_releasing.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+Arena::Release::~Release()
+{
+    m_arena.m_releasing.store(std::thread::id(), std::memory_order_relaxed);
+    if (m_arena.liveCount() == 0) { m_arena.rewind(); }
+}
+
+bool Arena::trim()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (liveCount() != 0) { return false; }
+    for (Chunk& chunk: m_chunks) {
+        ::operator delete(chunk.base);
+    }
+    m_chunks.clear();
+    rewind();
+    return true;
+}
+
+size_t Arena::capacity() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    size_t total = 0;
+    for (const Chunk& chunk: m_chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
+
+} // namespace rrsim
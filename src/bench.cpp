@@ -0,0 +1,520 @@
+// bench.cpp
+//
+// Author: Kendall Auel
+// Description:
+//     Microbenchmark suite for the simulation core. Each case runs at
+//     several network sizes on reproducible (seeded) networks built by
+//     NetGenerator, and reports time and heap allocations per operation
+//     along with the scaling exponent between successive sizes.
+//
+//     Cases:
+//       create  - System::createEdge, per segment.
+//       connect - System::connectSegments, per connection.
+//       route   - Train::placeOnTrack (i.e. getOptimalRoute), per route.
+//       signals - System::updateAllSignals, per call.
+//       step    - System::stepSimulation with one train per 50 segments.
+//       save    - System::serialize of the whole network.
+//       load    - System::deserialize of the whole network.
+//
+
+#include "netgen.h"
+#include "memstat.h"
+#include "edge.h"
+#include "train.h"
+#include "system.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+namespace {
+
+using rrsim::EdgePtr;
+using rrsim::TrainPtr;
+using Clock = std::chrono::steady_clock;
+
+// Swallow the console output of the library while it is being measured.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int ch) override { return ch; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class Quiet
+{
+public:
+    Quiet()  { m_saved = std::cout.rdbuf(&s_null); }
+    ~Quiet() { std::cout.rdbuf(m_saved); }
+private:
+    static NullBuffer   s_null;
+    std::streambuf*     m_saved;
+};
+NullBuffer Quiet::s_null;
+
+struct BenchOptions
+{
+    std::vector<long>           sizes = { 250, 500, 1000, 2000 };
+    std::vector<std::string>    cases = { "create", "connect", "route",
+                                          "signals", "step", "save", "load" };
+    std::string                 topology = "grid";
+    unsigned                    seed = 1;
+    long                        minTimeMs = 200;
+    std::string                 json;
+};
+
+struct BenchResult
+{
+    std::string name;
+    long        size;
+    long        ops;
+    double      nsPerOp;
+    double      allocsPerOp;
+    double      bytesPerOp;
+    double      slope;      // d log(ns/op) / d log(size), from previous size.
+};
+
+// Accumulates elapsed time and allocations across start/stop pairs, so
+// untimed setup can be interleaved with the measured operations.
+class Meter
+{
+public:
+    void start() {
+        rrsim::MemUsage mem = rrsim::MemStats::total();
+        m_allocs0 = mem.totalAllocs;
+        m_bytes0 = mem.totalBytes;
+        m_t0 = Clock::now();
+    }
+    void stop(long ops = 1) {
+        m_elapsed += Clock::now() - m_t0;
+        rrsim::MemUsage mem = rrsim::MemStats::total();
+        m_allocs += mem.totalAllocs - m_allocs0;
+        m_bytes += mem.totalBytes - m_bytes0;
+        m_ops += ops;
+    }
+    // Cases whose untimed setup rebuilds the network give up after
+    // maxRounds, rather than spending most of the run on setup.
+    bool done(long minTimeMs, long maxRounds = 0) {
+        if (maxRounds && (++m_rounds > maxRounds)) { return true; }
+        return (m_ops >= 3) &&
+            (std::chrono::duration_cast<std::chrono::milliseconds>(m_elapsed)
+                .count() >= minTimeMs);
+    }
+    BenchResult result(const std::string& name, long size) {
+        double ops = (double)std::max(1L, m_ops);
+        double ns = (double)std::chrono::duration_cast<
+                std::chrono::nanoseconds>(m_elapsed).count();
+        return { name, size, m_ops, ns / ops,
+                 (double)m_allocs / ops, (double)m_bytes / ops, 0.0 };
+    }
+private:
+    Clock::time_point   m_t0;
+    Clock::duration     m_elapsed = Clock::duration::zero();
+    unsigned long       m_allocs0 = 0;
+    unsigned long       m_bytes0 = 0;
+    unsigned long       m_allocs = 0;
+    unsigned long       m_bytes = 0;
+    long                m_ops = 0;
+    long                m_rounds = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Benchmark cases
+// -----------------------------------------------------------------------------
+
+class Bench
+{
+public:
+    explicit Bench(const BenchOptions& opts) : m_opts(opts) {}
+
+    void runSize(long size);
+    const std::vector<BenchResult>& results() { return m_results; }
+
+private:
+    bool wanted(const std::string& name) {
+        for (auto& c: m_opts.cases) { if (c == name) return true; }
+        return false;
+    }
+    void record(const BenchResult& res);
+
+    void buildNetwork(long size);
+    int  placeTrains(long count, std::mt19937& rng);
+
+    BenchResult benchCreate(long size);
+    BenchResult benchConnect(long size);
+    BenchResult benchRoute(long size);
+    BenchResult benchSignals(long size);
+    BenchResult benchStep(long size);
+    BenchResult benchSave(long size);
+    BenchResult benchLoad(long size);
+
+    const BenchOptions&         m_opts;
+    std::vector<BenchResult>    m_results;
+    std::vector<EdgePtr>        m_edges;
+    std::vector<TrainPtr>       m_trains;
+    std::string                 m_file;
+};
+
+void Bench::record(const BenchResult& res)
+{
+    BenchResult rec = res;
+    for (auto it = m_results.rbegin(); it != m_results.rend(); ++it) {
+        if ((it->name == rec.name) && (it->size < rec.size) &&
+                (it->nsPerOp > 0.0) && (rec.nsPerOp > 0.0)) {
+            rec.slope = std::log(rec.nsPerOp / it->nsPerOp)
+                      / std::log((double)rec.size / (double)it->size);
+            break;
+        }
+    }
+    m_results.push_back(rec);
+
+    std::cout << std::setw(8) << std::left << rec.name
+              << std::setw(9) << std::right << rec.size
+              << std::setw(9) << rec.ops
+              << std::setw(14) << std::fixed << std::setprecision(1) << rec.nsPerOp;
+    if (rrsim::MemStats::enabled()) {
+        std::cout << std::setw(12) << std::setprecision(2) << rec.allocsPerOp
+                  << std::setw(12) << std::setprecision(1) << rec.bytesPerOp;
+    }
+    else {
+        std::cout << std::setw(12) << "n/a" << std::setw(12) << "n/a";
+    }
+    if (rec.slope != 0.0) {
+        std::cout << std::setw(9) << std::setprecision(2) << rec.slope;
+    }
+    std::cout << std::endl;
+}
+
+void Bench::buildNetwork(long size)
+{
+    Quiet quiet;
+    sys().resetTrackNetwork();
+    rrsim::GenOptions gopt;
+    gopt.topology = m_opts.topology;
+    gopt.segments = size;
+    gopt.seed = m_opts.seed;
+    gopt.signals = "junctions";
+    rrsim::NetGenerator gen(gopt);
+    gen.build();
+    m_edges = gen.edges();
+    m_trains.clear();
+    sys().updateAllSignals();
+}
+
+// Place count trains at random free segments with reachable random
+// destinations, reusing the trains placed by the previous call. Returns
+// the number actually placed.
+int Bench::placeTrains(long count, std::mt19937& rng)
+{
+    for (TrainPtr tptr: m_trains) {
+        tptr->placeOnTrack(nullptr, nullptr);
+    }
+    while ((long)m_trains.size() < count) {
+        m_trains.push_back(sys().createTrain());
+    }
+    std::uniform_int_distribution<size_t> pick(0, m_edges.size() - 1);
+    int placed = 0;
+    for (long tx = 0; tx < count; tx++) {
+        TrainPtr tptr = m_trains[tx];
+        for (int attempt = 0; attempt < 10; attempt++) {
+            EdgePtr start = m_edges[pick(rng)];
+            EdgePtr end = m_edges[pick(rng)];
+            if (start->getTrain() || (start == end)) continue;
+            try {
+                tptr->placeOnTrack(start, end);
+                placed++;
+                break;
+            }
+            catch (std::exception&) {
+                tptr->placeOnTrack(nullptr, nullptr);
+            }
+        }
+    }
+    sys().updateAllSignals();
+    return placed;
+}
+
+BenchResult Bench::benchCreate(long size)
+{
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs, 5)) {
+        Quiet quiet;
+        sys().resetTrackNetwork();
+        meter.start();
+        for (long ix = 0; ix < size; ix++) {
+            sys().createEdge();
+        }
+        meter.stop(size);
+    }
+    return meter.result("create", size);
+}
+
+BenchResult Bench::benchConnect(long size)
+{
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs, 5)) {
+        Quiet quiet;
+        sys().resetTrackNetwork();
+        std::vector<EdgePtr> line;
+        for (long ix = 0; ix < size; ix++) {
+            line.push_back(sys().createEdge());
+        }
+        meter.start();
+        for (long ix = 1; ix < size; ix++) {
+            sys().connectSegments(rrsim::EdgeEnd(line[ix - 1], rrsim::eEndB),
+                                  rrsim::EdgeEnd(line[ix], rrsim::eEndA));
+        }
+        meter.stop(size - 1);
+    }
+    return meter.result("connect", size);
+}
+
+BenchResult Bench::benchRoute(long size)
+{
+    Quiet quiet;
+    std::mt19937 rng(m_opts.seed);
+    std::uniform_int_distribution<size_t> pick(0, m_edges.size() - 1);
+    TrainPtr tptr = sys().createTrain();
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs)) {
+        EdgePtr start = m_edges[pick(rng)];
+        EdgePtr end = m_edges[pick(rng)];
+        if (start->getTrain()) continue;
+        meter.start();
+        try {
+            tptr->placeOnTrack(start, end);
+        }
+        catch (std::exception&) {
+            // Unreachable destination, the search covered the whole
+            // reachable network.
+        }
+        meter.stop();
+    }
+    tptr->placeOnTrack(nullptr, nullptr);
+    return meter.result("route", size);
+}
+
+BenchResult Bench::benchSignals(long size)
+{
+    Quiet quiet;
+    std::mt19937 rng(m_opts.seed);
+    placeTrains(std::max(1L, size / 50), rng);
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs)) {
+        meter.start();
+        sys().updateAllSignals();
+        meter.stop();
+    }
+    return meter.result("signals", size);
+}
+
+BenchResult Bench::benchStep(long size)
+{
+    Quiet quiet;
+    std::mt19937 rng(m_opts.seed);
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs)) {
+        // Start each round with freshly placed trains, so the measured
+        // steps are not dominated by trains that already arrived.
+        placeTrains(std::max(1L, size / 50), rng);
+        for (int step = 0; step < 10; step++) {
+            meter.start();
+            sys().stepSimulation();
+            meter.stop();
+        }
+    }
+    return meter.result("step", size);
+}
+
+BenchResult Bench::benchSave(long size)
+{
+    Quiet quiet;
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs)) {
+        meter.start();
+        std::ofstream ofstr(m_file, std::ofstream::trunc);
+        sys().serialize(ofstr);
+        ofstr.close();
+        meter.stop();
+    }
+    return meter.result("save", size);
+}
+
+BenchResult Bench::benchLoad(long size)
+{
+    Quiet quiet;
+    {
+        std::ofstream ofstr(m_file, std::ofstream::trunc);
+        sys().serialize(ofstr);
+    }
+    Meter meter;
+    while (!meter.done(m_opts.minTimeMs)) {
+        meter.start();
+        std::ifstream ifstr(m_file);
+        sys().deserialize(ifstr);
+        meter.stop();
+    }
+    return meter.result("load", size);
+}
+
+void Bench::runSize(long size)
+{
+    m_file = "bench_network_" + std::to_string(size) + ".txt";
+
+    if (wanted("create"))  { record(benchCreate(size)); }
+    if (wanted("connect")) { record(benchConnect(size)); }
+
+    buildNetwork(size);
+    if (wanted("route"))   { record(benchRoute(size)); }
+    if (wanted("signals")) { record(benchSignals(size)); }
+    if (wanted("step"))    { record(benchStep(size)); }
+    if (wanted("save"))    { record(benchSave(size)); }
+    if (wanted("load"))    { record(benchLoad(size)); }
+
+    std::remove(m_file.c_str());
+    Quiet quiet;
+    m_edges.clear();
+    m_trains.clear();
+    sys().resetTrackNetwork();
+}
+
+// -----------------------------------------------------------------------------
+// Command line and output
+// -----------------------------------------------------------------------------
+
+void usage(const char* prog)
+{
+    std::cout <<
+        "Usage: " << prog << " [options]"                                  << std::endl <<
+        "  --sizes N,N,...    network sizes in segments (250,500,1000,2000)" << std::endl <<
+        "  --cases C,C,...    create,connect,route,signals,step,save,load"   << std::endl <<
+        "  --topology T       mainline | ladder | grid | tree (grid)"        << std::endl <<
+        "  --seed S           random seed (1)"                               << std::endl <<
+        "  --min-time MS      minimum measured time per case (200)"          << std::endl <<
+        "  --json FILE        also write the results as JSON"                << std::endl;
+}
+
+std::vector<std::string> splitList(const std::string& str)
+{
+    std::vector<std::string> rval;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) { rval.push_back(item); }
+    }
+    return rval;
+}
+
+bool parseArgs(int argc, char** argv, BenchOptions& opts)
+{
+    for (int ix = 1; ix < argc; ix++) {
+        std::string arg = argv[ix];
+        if (arg == "-h" || arg == "--help") { return false; }
+        if (ix + 1 >= argc) {
+            std::cout << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string val = argv[++ix];
+        if (arg == "--sizes") {
+            opts.sizes.clear();
+            for (auto& s: splitList(val)) { opts.sizes.push_back(std::stol(s)); }
+        }
+        else if (arg == "--cases")    { opts.cases = splitList(val); }
+        else if (arg == "--topology") { opts.topology = val; }
+        else if (arg == "--seed")     { opts.seed = (unsigned)std::stoul(val); }
+        else if (arg == "--min-time") { opts.minTimeMs = std::stol(val); }
+        else if (arg == "--json")     { opts.json = val; }
+        else {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return !opts.sizes.empty();
+}
+
+int writeJson(const BenchOptions& opts, const std::vector<BenchResult>& results)
+{
+    std::ofstream ofstr(opts.json, std::ofstream::trunc);
+    if (!ofstr.good()) {
+        std::cout << "Unable to open file " << opts.json << std::endl;
+        return ENOENT;
+    }
+    ofstr << "{\n  \"topology\": \"" << opts.topology << "\",\n"
+          << "  \"seed\": " << opts.seed << ",\n"
+          << "  \"results\": [\n";
+    for (size_t ix = 0; ix < results.size(); ix++) {
+        const BenchResult& r = results[ix];
+        ofstr << "    {\"case\": \"" << r.name << "\", \"size\": " << r.size
+              << ", \"ops\": " << r.ops
+              << ", \"ns_per_op\": " << r.nsPerOp;
+        if (rrsim::MemStats::enabled()) {
+            ofstr << ", \"allocs_per_op\": " << r.allocsPerOp
+                  << ", \"bytes_per_op\": " << r.bytesPerOp;
+        }
+        else {
+            ofstr << ", \"allocs_per_op\": null, \"bytes_per_op\": null";
+        }
+        ofstr
+              << ", \"slope\": " << r.slope << "}"
+              << ((ix + 1 < results.size()) ? ",\n" : "\n");
+    }
+    ofstr << "  ]\n}\n";
+    return 0;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// main -- Entry point
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    BenchOptions opts;
+    try {
+        if (!parseArgs(argc, argv, opts)) {
+            usage(argv[0]);
+            return EINVAL;
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: invalid argument (" << ex.what() << ")" << std::endl;
+        usage(argv[0]);
+        return EINVAL;
+    }
+
+    std::cout << std::setw(8) << std::left << "case"
+              << std::setw(9) << std::right << "size"
+              << std::setw(9) << "ops"
+              << std::setw(14) << "ns/op"
+              << std::setw(12) << "allocs/op"
+              << std::setw(12) << "bytes/op"
+              << std::setw(9) << "slope" << std::endl;
+    if (!rrsim::MemStats::enabled()) {
+        std::cout << "memory accounting disabled (build with CS_SIGNALING_MEMSTAT=ON)"
+                  << std::endl;
+    }
+
+    Bench bench(opts);
+    try {
+        for (long size: opts.sizes) {
+            bench.runSize(size);
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EFAULT;
+    }
+
+    if (!opts.json.empty()) {
+        return writeJson(opts, bench.results());
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+// branch.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the Branch class.
+
+#include "branch.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "memstat.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+namespace rrsim {
+
+std::shared_ptr<const Branch::Topology> Branch::s_topology;
+
+std::shared_ptr<const Branch::Topology> Branch::topology()
+{
+    if (s_topology && (s_topology->version == sys().topologyVersion())) {
+        return s_topology;
+    }
+
+    MemScope mem(eMemTopology);
+    const TransitionTable& table = sys().transitions();
+    const EdgeVec& edges = sys().edges();
+    const NodeVec& nodes = sys().nodes();
+    auto topo = std::make_shared<Topology>();
+    size_t states = table.states();
+    topo->version = sys().topologyVersion();
+    topo->branch.resize(states * 2);
+    topo->facing.resize(states);
+    topo->signal.assign(states, 0);
+    topo->junctionAt.assign(states, -1);
+    topo->junctionOf.assign(nodes.size(), -1);
+    topo->weight.assign(edges.size(), 0.0);
+    for (size_t state = 0; state < states; state++) {
+        topo->branch[state * 2] = table.branch((int32_t)state, 0);
+        topo->branch[state * 2 + 1] = table.branch((int32_t)state, 1);
+        topo->facing[state] = (uint8_t)(table.facingType((int32_t)state) |
+                                        (table.facingSlot((int32_t)state) << 2));
+    }
+    for (const EdgePtr& eptr: edges) {
+        if (!eptr) continue;
+        topo->weight[eptr->id()] = eptr->weight();
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            if (eptr->getSignal((eEnd)ix)) { topo->signal[eptr->id() * 2 + ix] = 1; }
+        }
+    }
+    for (int id: sys().nodesOfType(eJunction)) {
+        Node& node = *nodes[id];
+        int32_t jx = (int32_t)topo->junctions.size();
+        topo->junctionOf[id] = jx;
+        for (int sx = 0; sx < eNumSlots; sx++) {
+            int32_t state = TransitionTable::facingState(node.getEdgeEnd((eSlot)sx));
+            if (state >= 0) { topo->junctionAt[state] = jx; }
+        }
+        EdgePtr common = node.getEdgeEnd(eSlot1).eeEdge.lock();
+        EdgePtr left = node.getEdgeEnd(eSlot2).eeEdge.lock();
+        topo->junctions.push_back({ id, common ? common->id() : -1, left ? left->id() : -1 });
+    }
+    s_topology = topo;
+    return topo;
+}
+
+Branch::Branch() : m_topo(topology()), m_step(sys().simStep()), m_collided(-1)
+{
+    MemScope mem(eMemTrains);
+    const TrainFleet& fleet = sys().fleet();
+    const NodeVec& nodes = sys().nodes();
+    size_t edgeCount = m_topo->weight.size();
+    for (size_t ex = 0; ex < edgeCount; ex++) {
+        m_occupant.write(ex) = fleet.occupant((int)ex);
+    }
+    for (size_t jx = 0; jx < m_topo->junctions.size(); jx++) {
+        m_switch.write(jx) = (uint8_t)nodes[m_topo->junctions[jx].node]->getSwitchPos();
+    }
+
+    auto order = std::make_shared<std::vector<int>>();
+    for (const TrainPtr& tptr: sys().sortedTrains()) {
+        int id = tptr->id();
+        order->push_back(id);
+        TrainRec& rec = m_trains.write(id);
+        rec.state = fleet.stateOf(id);
+        rec.dest = fleet.destOf(id);
+        rec.depart = fleet.departureOf(id);
+        rec.length = fleet.lengthOf(id);
+        rec.route = std::make_shared<const std::vector<uint8_t>>(fleet.routeAhead(id));
+        for (size_t cx = 0; cx < fleet.consistSize(id); cx++) {
+            rec.consist.push_back(fleet.consistEdge(id, cx));
+        }
+        rec.weight = fleet.consistWeight(id);
+        if ((rec.state >= 0) && ((rec.state >> 1) == rec.dest)) { rec.arrived = m_step; }
+    }
+    m_order = order;
+}
+
+eJSwitch Branch::switchOf(int node) const
+{
+    int32_t jx = ((size_t)node < m_topo->junctionOf.size()) ? m_topo->junctionOf[node] : -1;
+    return (jx < 0) ? eSwitchNone : (eJSwitch)m_switch[jx];
+}
+
+void Branch::setSwitch(int node, eJSwitch jsw)
+{
+    int32_t jx = ((size_t)node < m_topo->junctionOf.size()) ? m_topo->junctionOf[node] : -1;
+    if (jx < 0) {
+        throw std::runtime_error("Branch::setSwitch not a junction");
+    }
+    m_switch.write(jx) = (uint8_t)jsw;
+}
+
+void Branch::hold(int train, long steps)
+{
+    if ((size_t)train >= m_trains.size() || (m_trains[train].state < 0)) {
+        throw std::runtime_error("Branch::hold no such train on the track");
+    }
+    TrainRec& rec = m_trains.write(train);
+    rec.depart = std::max(rec.depart, m_step + steps);
+}
+
+// The state entered past the node, as TransitionTable::next with the
+// branch's own switches.
+int32_t Branch::next(int32_t state) const
+{
+    const int32_t* branch = &m_topo->branch[state * 2];
+    if (facingType(state) != eJunction) { return branch[0]; }
+    eJSwitch jsw = (eJSwitch)m_switch[m_topo->junctionAt[state]];
+    switch (facingSlot(state)) {
+    case eSlot1:
+        if (jsw == eSwitchLeft) { return branch[0]; }
+        if (jsw == eSwitchRight) { return branch[1]; }
+        return TransitionTable::kBlocked;
+    case eSlot2:
+        return (jsw == eSwitchLeft) ? branch[0] : TransitionTable::kBlocked;
+    case eSlot3:
+        return (jsw == eSwitchRight) ? branch[0] : TransitionTable::kBlocked;
+    default:
+        return TransitionTable::kBlocked;
+    }
+}
+
+// As RRsignal::checkForRed, on the branch's occupancy.
+bool Branch::signalIsRed(int32_t state) const
+{
+    int32_t walk = next(state);
+    if (walk < 0) { return true; }
+    if (occupant(walk >> 1) >= 0) { return true; }
+    int first = walk >> 1;
+    while (facingType(walk) != eJunction) {
+        walk = next(walk);
+        if (walk < 0) { return false; }
+        if ((walk >> 1) == first) { return false; }
+        int train = occupant(walk >> 1);
+        if ((train >= 0) && (m_trains[train].state == (walk ^ 1))) { return true; }
+    }
+    return false;
+}
+
+void Branch::setOccupant(int edge, int train)
+{
+    if (m_occupant[edge] != train) { m_occupant.write(edge) = train; }
+}
+
+bool Branch::step()
+{
+    if (collided()) { return false; }
+    bool running = false;
+    for (int train: *m_order) {
+        if (stepTrain(train)) { running = true; }
+        if (collided()) { return false; }
+    }
+    m_step++;
+    return running;
+}
+
+long Branch::run(long count)
+{
+    long steps = 0;
+    while ((steps < count) && !collided()) {
+        steps++;
+        if (!step()) { break; }
+    }
+    return steps;
+}
+
+void Branch::runAll(std::vector<Branch>& branches, long count, unsigned threads)
+{
+    std::atomic<size_t> nextBranch(0);
+    auto worker = [&]() {
+        for (size_t bx = nextBranch++; bx < branches.size(); bx = nextBranch++) {
+            branches[bx].run(count);
+        }
+    };
+    if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(branches.size(), 1));
+    std::vector<std::thread> pool;
+    for (unsigned tx = 1; tx < threads; tx++) { pool.emplace_back(worker); }
+    worker();
+    for (std::thread& thr: pool) { thr.join(); }
+}
+
+// As TrainFleet::step and Train::stepSimulation together.
+bool Branch::stepTrain(int train)
+{
+    const TrainRec& rec = m_trains[train];
+    int32_t state = rec.state;
+    if (state < 0) { return false; }
+    if ((state >> 1) == rec.dest) { return false; }
+    if (rec.depart > m_step) { return true; }
+
+    int32_t nx = next(state);
+    bool advance = !(m_topo->signal[state] && signalIsRed(state));
+    bool routeEmpty = (rec.routePos >= rec.route->size());
+    eJSwitch want = routeEmpty ? eSwitchNone : (eJSwitch)(*rec.route)[rec.routePos];
+    int32_t jx;
+    eJSwitch jsw;
+
+    switch (facingType(state)) {
+    default:
+    case eEmpty:
+    case eTerminator: return false;
+
+    case eContinuation:
+        if (advance && (nx >= 0)) { moveTo(train, nx); }
+        break;
+
+    case eJunction:
+        jx = m_topo->junctionAt[state];
+        jsw = (eJSwitch)m_switch[jx];
+        switch (facingSlot(state)) {
+        case eSlot1:
+            if (!routeEmpty && (want != jsw)) {
+                m_switch.write(jx) = (uint8_t)want;
+            }
+            else if (advance && (nx >= 0)) {
+                moveTo(train, nx);
+                if (!routeEmpty && !collided()) { m_trains.write(train).routePos++; }
+            }
+            break;
+
+        case eSlot2:
+            if (jsw != eSwitchLeft) {
+                int32_t common = m_topo->junctions[jx].common;
+                if ((common >= 0) && (occupant(common) < 0)) {
+                    m_switch.write(jx) = (uint8_t)eSwitchLeft;
+                }
+            }
+            else if (advance && (nx >= 0)) { moveTo(train, nx); }
+            break;
+
+        case eSlot3:
+            if (jsw != eSwitchRight) {
+                int32_t common = m_topo->junctions[jx].common;
+                int32_t left = m_topo->junctions[jx].left;
+                if ((common >= 0) && (occupant(common) < 0) &&
+                    (left >= 0) && (occupant(left) < 0)) {
+                    m_switch.write(jx) = (uint8_t)eSwitchRight;
+                }
+            }
+            else if (advance && (nx >= 0)) { moveTo(train, nx); }
+            break;
+
+        default:
+            break;
+        }
+        break;
+    }
+    return true;
+}
+
+// As Train::moveTo, or the fast path of TrainFleet::step where it
+// would have been taken: off the common track of a junction, into a
+// free segment.
+void Branch::moveTo(int train, int32_t next)
+{
+    int edge = next >> 1;
+    bool fast = ((facingType(m_trains[train].state) != eJunction) ||
+                 (facingSlot(m_trains[train].state) != eSlot1)) && (occupant(edge) < 0);
+    if (!fast) {
+        releaseTail(train, edge);
+        if (occupant(edge) >= 0) {
+            clearPosition(train);
+            m_collided = train;
+            return;
+        }
+    }
+    enter(train, next);
+}
+
+// As TrainFleet::move.
+void Branch::enter(int train, int32_t next)
+{
+    int edge = next >> 1;
+    releaseTail(train, edge);
+    setOccupant(edge, train);
+    TrainRec& rec = m_trains.write(train);
+    rec.consist.push_back(edge);
+    rec.weight += m_topo->weight[edge];
+    rec.state = next;
+    if (edge == rec.dest) { rec.arrived = m_step; }
+}
+
+// As TrainFleet::releaseTail.
+void Branch::releaseTail(int train, int edge)
+{
+    const TrainRec& rec = m_trains[train];
+    double total = rec.weight + m_topo->weight[edge];
+    size_t drop = 0;
+    while (drop < rec.consist.size()) {
+        double w = m_topo->weight[rec.consist[drop]];
+        if (total - w < rec.length) { break; }
+        total -= w;
+        drop++;
+    }
+    if (drop == 0) { return; }
+    TrainRec& own = m_trains.write(train);
+    for (size_t cx = 0; cx < drop; cx++) {
+        int tail = own.consist[cx];
+        own.weight = (own.consist.size() > cx + 1) ? (own.weight - m_topo->weight[tail]) : 0.0;
+        if (occupant(tail) == train) { setOccupant(tail, -1); }
+    }
+    own.consist.erase(own.consist.begin(), own.consist.begin() + drop);
+}
+
+void Branch::clearPosition(int train)
+{
+    TrainRec& rec = m_trains.write(train);
+    for (int edge: rec.consist) {
+        if (occupant(edge) == train) { setOccupant(edge, -1); }
+    }
+    rec.consist.clear();
+    rec.weight = 0.0;
+    rec.state = -1;
+}
+
+size_t Branch::ownPages(const Branch& other) const
+{
+    return pages() - m_occupant.shared(other.m_occupant) -
+           m_switch.shared(other.m_switch) - m_trains.shared(other.m_trains);
+}
+
+size_t Branch::pages() const
+{
+    return m_occupant.pages() + m_switch.pages() + m_trains.pages();
+}
+
+} // namespace rrsim
@@ -0,0 +1,201 @@
+// checkpoint.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the Checkpoint class.
+
+#include "checkpoint.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "stats.h"
+#include "memstat.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace rrsim {
+
+Checkpoint::Checkpoint() :
+    m_period(0), m_built(false), m_writeState(eWriteIdle)
+{
+}
+
+Checkpoint::~Checkpoint()
+{
+    finish();
+}
+
+void Checkpoint::start(const std::string& path, long period)
+{
+    finish();
+    m_path = path;
+    m_period = path.empty() ? 0 : std::max(period, 0L);
+    if (!active()) { clear(); }
+    else if (!m_built) { build(); }
+}
+
+void Checkpoint::stop()
+{
+    start(std::string(), 0);
+}
+
+void Checkpoint::clear()
+{
+    m_edgeRecs.clear();
+    m_nodeRecs.clear();
+    m_edges.clear();
+    m_edgeMarks.clear();
+    m_nodes.clear();
+    m_nodeMarks.clear();
+    m_built = false;
+}
+
+bool Checkpoint::finish()
+{
+    if (m_writeState == eWriteIdle) { return true; }
+    m_writer.join();
+    bool written = (m_writeState == eWriteDone);
+    m_writeState = eWriteIdle;
+    return written;
+}
+
+// The records of every segment and node, once, before the run where
+// it can be helped.
+void Checkpoint::build()
+{
+    clear();
+    for (const EdgePtr& eptr: sys().edges()) {
+        if (eptr) { note(m_edges, m_edgeMarks, eptr->id()); }
+    }
+    for (const NodePtr& nptr: sys().nodes()) {
+        if (nptr) { note(m_nodes, m_nodeMarks, nptr->id()); }
+    }
+    refresh();
+    m_built = true;
+}
+
+// Bring the records of the noted segments and nodes up to date.
+void Checkpoint::refresh()
+{
+    MemScope mem(eMemIO);
+    const EdgeVec& edges = sys().edges();
+    const NodeVec& nodes = sys().nodes();
+    for (int id: m_edges) {
+        m_edgeMarks[id] = 0;
+        EdgeRec& rec = m_edgeRecs.write(id);
+        rec = EdgeRec();
+        const EdgePtr& eptr = ((size_t)id < edges.size()) ? edges[id] : EdgePtr();
+        if (!eptr) continue;
+        rec.name = &eptr->name();
+        rec.weight = eptr->weight();
+        for (int ex = 0; ex < eNumEnds; ex++) {
+            NodeSlot ns = eptr->getNode((eEnd)ex);
+            rec.nodes[ex] = ns.nsNode ? &ns.nsNode->name() : nullptr;
+            rec.slots[ex] = (int)ns.nsSlot;
+            rec.signals[ex] = (eptr->getSignal((eEnd)ex) != nullptr);
+        }
+    }
+    for (int id: m_nodes) {
+        m_nodeMarks[id] = 0;
+        NodeRec& rec = m_nodeRecs.write(id);
+        rec = NodeRec();
+        const NodePtr& nptr = ((size_t)id < nodes.size()) ? nodes[id] : NodePtr();
+        if (!nptr || (nptr->getNodeType() != eJunction)) continue;
+        rec.name = &nptr->name();
+        rec.right = (nptr->getSwitchPos() == eSwitchRight);
+    }
+    m_edges.clear();
+    m_nodes.clear();
+}
+
+void Checkpoint::endOfStep(long step)
+{
+    if (!active() || ((step % m_period) != 0)) { return; }
+    if (m_writeState == eWriteRunning) {
+        SimStats::count(eStatCheckpointsSkipped);
+        return;
+    }
+    if (!finish()) {
+        std::cout << "ERROR: Unable to write checkpoint " << m_path << std::endl;
+        m_period = 0;
+        clear();
+        return;
+    }
+
+    RRSIM_TRACE_SCOPE("checkpoint");
+    StatTimer timer(eTimeCheckpoint);
+    if (!m_built) { build(); }
+    refresh();
+    auto snap = std::make_shared<Snapshot>();
+    snap->edges = m_edgeRecs;
+    snap->nodes = m_nodeRecs;
+    const EdgeVec& edges = sys().edges();
+    const TrainFleet& fleet = sys().fleet();
+    for (const TrainPtr& tptr: sys().trains()) {
+        if (!tptr) continue;
+        int id = tptr->id();
+        TrainRec rec = { &tptr->name(), nullptr, eEndA, nullptr, fleet.lengthOf(id) };
+        if (fleet.onTrack(id)) {
+            rec.edge = &edges[fleet.edgeOf(id)]->name();
+            rec.end = fleet.endOf(id);
+        }
+        if (fleet.destOf(id) >= 0) { rec.dest = &edges[fleet.destOf(id)]->name(); }
+        snap->trains.push_back(rec);
+    }
+
+    m_writeState = eWriteRunning;
+    std::string path = m_path;
+    m_writer = std::thread([this, snap, path]() {
+        bool written = write(*snap, path);
+        if (written) { SimStats::count(eStatCheckpoints); }
+        m_writeState = written ? eWriteDone : eWriteFailed;
+    });
+}
+
+// Segments, switches and trains, each sorted by name, to a file beside
+// the path that then takes its place.
+bool Checkpoint::write(const Snapshot& snap, const std::string& path)
+{
+    MemScope mem(eMemIO);
+    auto byName = [](const auto* a, const auto* b) { return *a->name < *b->name; };
+    std::vector<const EdgeRec*> edges;
+    for (size_t ix = 0; ix < snap.edges.size(); ix++) {
+        if (snap.edges[ix].name) { edges.push_back(&snap.edges[ix]); }
+    }
+    std::sort(edges.begin(), edges.end(), byName);
+    std::vector<const NodeRec*> nodes;
+    for (size_t ix = 0; ix < snap.nodes.size(); ix++) {
+        if (snap.nodes[ix].name) { nodes.push_back(&snap.nodes[ix]); }
+    }
+    std::sort(nodes.begin(), nodes.end(), byName);
+    std::vector<const TrainRec*> trains;
+    for (const TrainRec& rec: snap.trains) { trains.push_back(&rec); }
+    std::sort(trains.begin(), trains.end(), byName);
+
+    std::string tmp = path + ".tmp";
+    std::ofstream os(tmp, std::ofstream::trunc);
+    for (const EdgeRec* rec: edges) {
+        os << "track: " << *rec->name << ',' << rec->weight << ','
+           << *rec->nodes[0] << ',' << rec->slots[0] << ','
+           << *rec->nodes[1] << ',' << rec->slots[1] << ','
+           << "sigA:" << (rec->signals[0] ? "Y" : "N") << ','
+           << "sigB:" << (rec->signals[1] ? "Y" : "N") << '\n';
+    }
+    for (const NodeRec* rec: nodes) {
+        os << "switch: " << *rec->name << ',' << (rec->right ? 'R' : 'L') << '\n';
+    }
+    for (const TrainRec* rec: trains) {
+        os << "train: " << *rec->name << ',';
+        if (rec->edge) { os << *rec->edge << ',' << ((rec->end == eEndA) ? 'A' : 'B') << ','; }
+        else { os << "-,-,"; }
+        os << (rec->dest ? *rec->dest : std::string("-")) << ',' << rec->length << '\n';
+    }
+    os.close();
+    return os.good() && (std::rename(tmp.c_str(), path.c_str()) == 0);
+}
+
+} // namespace rrsim
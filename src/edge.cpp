@@ -9,16 +9,15 @@
 #include "rrsignal.h"
 #include "train.h"
 #include "system.h"
+#include "memstat.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 
 namespace rrsim {
 
-Edge::Edge(const std::string& name) : m_name(name), m_weight(1.0)
+Edge::Edge(NameID name, int id) : m_name(name), m_id(id), m_weight(1.0)
 {
-    // TODO: Weighted edges
-
     // Initialize node slots as invalid.
     m_ends[eEndA].nsSlot = eNumSlots;
     m_ends[eEndB].nsSlot = eNumSlots;
@@ -54,7 +53,38 @@ void Edge::placeSignalLight(eEnd myEnd)
         throw std::runtime_error("Signal has already been placed here");
     }
     EdgePtr eptr = shared_from_this();
+    MemScope mem(eMemSignals);
     m_signals[myEnd] = new RRsignal(eptr, myEnd);
+    sys().edgeChanged(m_id);
+}
+
+void Edge::removeSignalLight(eEnd myEnd)
+{
+    if ((myEnd != eEndA) && (myEnd != eEndB)) {
+        throw std::runtime_error("Invalid enum passed to removeSignalLight");
+    }
+    if (m_signals[myEnd]) {
+        delete m_signals[myEnd];
+        m_signals[myEnd] = nullptr;
+        sys().edgeChanged(m_id);
+    }
+}
+
+void Edge::setWeight(double weight)
+{
+    m_weight = weight;
+    sys().edgeChanged(m_id);
+}
+
+TrainPtr Edge::getTrain()
+{
+    int train = sys().fleet().occupant(m_id);
+    return (train < 0) ? nullptr : sys().trains()[train];
+}
+
+void Edge::setTrain(TrainPtr train)
+{
+    sys().fleet().setOccupant(m_id, train ? train->id() : -1);
 }
 
 NodeSlot Edge::getNode(eEnd getEnd)
@@ -79,34 +109,78 @@ void Edge::assignNodeSlot(NodeSlot node, eEnd nodeEnd)
         throw std::runtime_error("Invalid enum passed to assignNodeSlot");
     }
     m_ends[nodeEnd] = node;
+    sys().touchTopology();
 }
 
 void Edge::show(eEnd showEnd)
 {
-    eJSwitch sw;
     std::string msg;
     if ((showEnd == eEndA) || (showEnd == eNumEnds)) {
-        NodeSlot node = m_ends[eEndA];
-        EdgeEnd edge;
-        EdgePtr eptr;
-        eSlot slot;
-        if (node.nsNode == nullptr) {
-            throw std::runtime_error("Edge has null end node");
+        msg += endText(eEndA, switchAt(eEndA));
+        if (m_signals[eEndA]) {
+            msg += (m_signals[eEndA]->signalIsRed() ? "R " : "G ");
+        }
+        else {
+            msg += "_ ";
+        }
+    }
+
+    msg += name();
+
+    if ((showEnd == eEndB) || (showEnd == eNumEnds)) {
+        if (m_signals[eEndB]) {
+            msg += (m_signals[eEndB]->signalIsRed() ? " R" : " G");
+        }
+        else {
+            msg += " _";
         }
-        switch (node.nsNode->getNodeType()) {
+        msg += endText(eEndB, switchAt(eEndB));
+    }
+    TrainPtr train = getTrain();
+    if (train) {
+        if (train->getPosition().eeEnd == eEndA) {
+            msg += "  /[o==o]-[o==o]  ";
+        }
+        else {
+            msg += "   [o==o]-[o==o]\\ ";
+        }
+        msg += train->name();
+    }
+    std::cout << msg << std::endl;
+}
+
+eJSwitch Edge::switchAt(eEnd atEnd)
+{
+    NodePtr node = m_ends[atEnd].nsNode;
+    return node ? node->getSwitchPos() : eSwitchNone;
+}
+
+std::string Edge::endText(eEnd textEnd, eJSwitch sw)
+{
+    const TransitionTable& table = sys().transitions();
+    int32_t next;
+    std::string msg;
+    NodeSlot node = m_ends[textEnd];
+    EdgeEnd edge;
+    EdgePtr eptr;
+    eSlot slot;
+    if (node.nsNode == nullptr) {
+        throw std::runtime_error("Edge has null end node");
+    }
+    int32_t state = m_id * 2 + textEnd;
+    if (textEnd == eEndA) {
+        switch (table.facingType(state)) {
         case eEmpty: // TODO: exception?
         case eTerminator:
             msg += "<term-> ||== ";
             break;
         case eContinuation:
-            edge = node.nsNode->getNext(node.nsSlot);
-            eptr = edge.eeEdge.lock();
-            if (eptr) { msg += eptr->name() + " <==> "; }
+            next = table.next(state);
+            if (next >= 0) { msg += sys().edges()[next >> 1]->name() + " <==> "; }
             // TODO: else: exception?
             break;
 
         case eJunction:
-            sw = node.nsNode->getSwitchPos();
             slot = (sw == eSwitchRight) ? eSlot3 : eSlot2;
             if (node.nsSlot == eSlot1) {
                 edge = node.nsNode->getEdgeEnd(slot);
@@ -134,44 +208,20 @@ void Edge::show(eEnd showEnd)
             }
             break;
         }
-        if (m_signals[eEndA]) {
-            msg += (m_signals[eEndA]->signalIsRed() ? "R " : "G ");
-        }
-        else {
-            msg += "_ ";
-        }
     }
-
-    msg += m_name;
-
-    if ((showEnd == eEndB) || (showEnd == eNumEnds)) {
-        if (m_signals[eEndB]) {
-            msg += (m_signals[eEndB]->signalIsRed() ? " R" : " G");
-        }
-        else {
-            msg += " _";
-        }
-        NodeSlot node = m_ends[eEndB];
-        EdgeEnd edge;
-        EdgePtr eptr;
-        eSlot slot;
-        if (node.nsNode == nullptr) {
-            throw std::runtime_error("Edge has null end node");
-        }
-        switch (node.nsNode->getNodeType()) {
+    else {
+        switch (table.facingType(state)) {
         case eEmpty: // TODO: exception?
         case eTerminator:
             msg += " ==|| <-term>";
             break;
         case eContinuation:
-            edge = node.nsNode->getNext(node.nsSlot);
-            eptr = edge.eeEdge.lock();
-            if (eptr) { msg += " <==> " + eptr->name(); }
+            next = table.next(state);
+            if (next >= 0) { msg += " <==> " + sys().edges()[next >> 1]->name(); }
             // TODO: else: exception?
             break;
 
         case eJunction:
-            sw = node.nsNode->getSwitchPos();
             slot = (sw == eSwitchRight) ? eSlot3 : eSlot2;
             if (node.nsSlot == eSlot1) {
                 msg += " <=";
@@ -200,22 +250,14 @@ void Edge::show(eEnd showEnd)
             break;
         }
     }
-    if (m_train) {
-        if (m_train->getPosition().eeEnd == eEndA) {
-            msg += "  /[o==o]-[o==o]  ";
-        }
-        else {
-            msg += "   [o==o]-[o==o]\\ ";
-        }
-        msg += m_train->name();
-    }
-    std::cout << msg << std::endl;
+    return msg;
 }
 
 std::string Edge::serialize()
 {
+    MemScope mem(eMemIO);
     std::stringstream ss;
-    ss << "track: " << m_name << ',' << m_weight << ','
+    ss << "track: " << name() << ',' << m_weight << ','
        << m_ends[0].nsNode->name() << ',' << m_ends[0].nsSlot << ','
        << m_ends[1].nsNode->name() << ',' << m_ends[1].nsSlot << ','
        << "sigA:" << (m_signals[0] ? "Y" : "N") << ','
@@ -235,10 +277,10 @@ void Edge::deserialize(const std::string& serialStr)
     size_t pos1 = 7;
     size_t pos2 = serialStr.find(',', pos1);
     name = serialStr.substr(pos1, pos2-pos1);
-    if (name != m_name) {
-        throw std::runtime_error("deserialize " + m_name + " != " + name);
+    if (name != this->name()) {
+        throw std::runtime_error("deserialize " + this->name() + " != " + name);
     }
-    std::cout << "Name: " << m_name;
+    std::cout << "Name: " << name;
     pos1 = pos2 + 1;
     pos2 = serialStr.find(',', pos1);
     token = serialStr.substr(pos1, pos2-pos1);
@@ -296,7 +338,7 @@ void Edge::deserialize(const std::string& serialStr)
     }
     std::cout << std::endl;
 
-    m_train = nullptr;
+    setTrain(nullptr);
 }
 
 } // namespace rrsim
@@ -0,0 +1,437 @@
+// fleet.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the TrainFleet class.
+
+#include "fleet.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "rrsignal.h"
+#include "stats.h"
+#include <algorithm>
+
+namespace rrsim {
+
+static const size_t kMinCompact = 4096;
+
+TrainFleet::TrainFleet()
+    : m_rerouteCount(1), m_reroutePatience(0),
+      m_compactAt(kMinCompact), m_tableVersion(-1), m_logPos(0)
+{
+}
+
+void TrainFleet::Alternatives::clear()
+{
+    states.clear();
+    statePos.clear();
+    steps.clear();
+    stepPos.clear();
+    shared.clear();
+    current = 0;
+}
+
+void TrainFleet::Consist::push(int32_t edge, double w)
+{
+    if (count == ring.size()) {
+        // Unwrap into a ring twice the size.
+        std::vector<int32_t> grown(std::max<size_t>(4, 2 * ring.size()));
+        for (uint32_t ix = 0; ix < count; ix++) { grown[ix] = at(ix); }
+        ring.swap(grown);
+        tail = 0;
+    }
+    ring[(tail + count) & (ring.size() - 1)] = edge;
+    count++;
+    weight += w;
+}
+
+int32_t TrainFleet::Consist::pop(double w)
+{
+    int32_t edge = ring[tail];
+    tail = (tail + 1) & (ring.size() - 1);
+    count--;
+    weight = count ? (weight - w) : 0.0;
+    return edge;
+}
+
+void TrainFleet::setRerouting(int count, int patience)
+{
+    m_rerouteCount = std::max(1, count);
+    m_reroutePatience = std::max(0, patience);
+}
+
+void TrainFleet::addTrain(int train)
+{
+    if ((size_t)train >= m_state.size()) {
+        m_state.resize(train + 1, -1);
+        m_dest.resize(train + 1, -1);
+        m_routePos.resize(train + 1, 0);
+        m_routeEnd.resize(train + 1, 0);
+        m_hop.resize(train + 1, 0);
+        m_waited.resize(train + 1, 0);
+        m_depart.resize(train + 1, 0);
+        m_alts.resize(train + 1);
+        m_length.resize(train + 1, 0.0);
+        m_consist.resize(train + 1);
+        m_boundNext.resize(train + 1, -1);
+        m_boundPrev.resize(train + 1, -1);
+    }
+    m_state[train] = -1;
+    setDestination(train, -1);
+    m_routePos[train] = m_routeEnd[train] = 0;
+    m_hop[train] = m_waited[train] = 0;
+    m_depart[train] = 0;
+    m_alts[train].clear();
+    m_length[train] = 0.0;
+    m_consist[train] = Consist();
+}
+
+void TrainFleet::setDestination(int train, int edge)
+{
+    int old = m_dest[train];
+    if (old == edge) { return; }
+    if (old >= 0) {
+        int next = m_boundNext[train];
+        int prev = m_boundPrev[train];
+        if (prev >= 0) { m_boundNext[prev] = next; }
+        else { m_boundFirst[old] = next; }
+        if (next >= 0) { m_boundPrev[next] = prev; }
+    }
+    m_dest[train] = edge;
+    m_boundNext[train] = m_boundPrev[train] = -1;
+    if (edge >= 0) {
+        if ((size_t)edge >= m_boundFirst.size()) { m_boundFirst.resize(edge + 1, -1); }
+        int next = m_boundFirst[edge];
+        m_boundNext[train] = next;
+        if (next >= 0) { m_boundPrev[next] = train; }
+        m_boundFirst[edge] = train;
+    }
+}
+
+std::vector<int> TrainFleet::boundFor(int edge) const
+{
+    std::vector<int> trains;
+    if ((size_t)edge >= m_boundFirst.size()) { return trains; }
+    for (int train = m_boundFirst[edge]; train >= 0; train = m_boundNext[train]) {
+        trains.push_back(train);
+    }
+    return trains;
+}
+
+void TrainFleet::removeTrain(int train)
+{
+    clearPosition(train);
+    setDestination(train, -1);
+    m_routePos[train] = m_routeEnd[train] = 0;
+    m_alts[train].clear();
+}
+
+void TrainFleet::clear()
+{
+    m_state.clear();
+    m_dest.clear();
+    m_boundFirst.clear();
+    m_boundNext.clear();
+    m_boundPrev.clear();
+    m_routePos.clear();
+    m_routeEnd.clear();
+    m_hop.clear();
+    m_waited.clear();
+    m_depart.clear();
+    m_alts.clear();
+    m_length.clear();
+    m_consist.clear();
+    m_routeSteps.clear();
+    m_compactAt = kMinCompact;
+    m_occupant.clear();
+    m_signal.clear();
+    m_tableVersion = -1;
+    m_logPos = 0;
+}
+
+void TrainFleet::setPosition(int train, int edge, eEnd end)
+{
+    m_state[train] = edge * 2 + end;
+}
+
+void TrainFleet::clearPosition(int train)
+{
+    Consist& consist = m_consist[train];
+    while (consist.count > 0) {
+        int edge = consist.pop(0.0);
+        if (occupant(edge) == train) { setOccupant(edge, -1); }
+    }
+    m_state[train] = -1;
+}
+
+void TrainFleet::enter(int train, int edge)
+{
+    setOccupant(edge, train);
+    m_consist[train].push(edge, sys().edges()[edge]->weight());
+}
+
+void TrainFleet::setLength(int train, double length)
+{
+    m_length[train] = std::max(0.0, length);
+}
+
+void TrainFleet::releaseTail(int train, int edge)
+{
+    Consist& consist = m_consist[train];
+    const EdgeVec& edges = sys().edges();
+    double total = consist.weight + edges[edge]->weight();
+    while (consist.count > 0) {
+        double w = edges[consist.at(0)]->weight();
+        if (total - w < m_length[train]) { break; }
+        total -= w;
+        int tail = consist.pop(w);
+        if (occupant(tail) == train) { setOccupant(tail, -1); }
+    }
+}
+
+void TrainFleet::setOccupant(int edge, int train)
+{
+    if ((size_t)edge >= m_occupant.size()) {
+        if (train < 0) { return; }
+        m_occupant.resize(edge + 1, -1);
+    }
+    m_occupant[edge] = train;
+    sys().views().occupantChanged(edge, train);
+}
+
+void TrainFleet::setRoute(int train, const std::vector<eJSwitch>& steps)
+{
+    std::vector<uint8_t> packed(steps.begin(), steps.end());
+    appendRoute(train, packed.data(), packed.size());
+    m_hop[train] = m_waited[train] = 0;
+    m_alts[train].clear();
+}
+
+void TrainFleet::setRoutes(int train, const std::vector<Route>& routes)
+{
+    Alternatives& alts = m_alts[train];
+    alts.clear();
+    if (routes.empty()) {
+        appendRoute(train, nullptr, 0);
+    }
+    else {
+        for (const Route& route: routes) {
+            alts.statePos.push_back((uint32_t)alts.states.size());
+            alts.states.insert(alts.states.end(), route.states.begin(), route.states.end());
+            alts.stepPos.push_back((uint32_t)alts.steps.size());
+            for (eJSwitch jsw: route.steps) { alts.steps.push_back((uint8_t)jsw); }
+        }
+        alts.statePos.push_back((uint32_t)alts.states.size());
+        alts.stepPos.push_back((uint32_t)alts.steps.size());
+
+        // The routes all start on the same segment, so the states they
+        // share from the start say where one can take over from another.
+        size_t count = routes.size();
+        alts.shared.assign(count * count, 0);
+        for (size_t r1 = 0; r1 < count; r1++) {
+            for (size_t r2 = r1; r2 < count; r2++) {
+                const std::vector<int32_t>& s1 = routes[r1].states;
+                const std::vector<int32_t>& s2 = routes[r2].states;
+                size_t len = 0;
+                while ((len < s1.size()) && (len < s2.size()) && (s1[len] == s2[len])) {
+                    len++;
+                }
+                alts.shared[r1 * count + r2] = alts.shared[r2 * count + r1] = (uint32_t)len;
+            }
+        }
+        appendRoute(train, alts.steps.data(), alts.stepPos[1]);
+    }
+    m_hop[train] = m_waited[train] = 0;
+}
+
+void TrainFleet::appendRoute(int train, const uint8_t* steps, size_t count)
+{
+    if (m_routeSteps.size() + count > m_compactAt) {
+        size_t live = count;
+        for (size_t tx = 0; tx < m_state.size(); tx++) {
+            if (tx != (size_t)train) { live += m_routeEnd[tx] - m_routePos[tx]; }
+        }
+        if (2 * live < m_routeSteps.size()) {
+            std::vector<uint8_t> packed;
+            packed.reserve(2 * live);
+            for (size_t tx = 0; tx < m_state.size(); tx++) {
+                int32_t pos = (int32_t)packed.size();
+                if (tx != (size_t)train) {
+                    packed.insert(packed.end(), m_routeSteps.begin() + m_routePos[tx],
+                                  m_routeSteps.begin() + m_routeEnd[tx]);
+                }
+                m_routePos[tx] = pos;
+                m_routeEnd[tx] = (int32_t)packed.size();
+            }
+            m_routeSteps.swap(packed);
+        }
+        m_compactAt = std::max(kMinCompact, 2 * (m_routeSteps.size() + count));
+    }
+    m_routePos[train] = (int32_t)m_routeSteps.size();
+    m_routeSteps.insert(m_routeSteps.end(), steps, steps + count);
+    m_routeEnd[train] = (int32_t)m_routeSteps.size();
+}
+
+void TrainFleet::move(int train, int32_t next)
+{
+    releaseTail(train, next >> 1);
+    enter(train, next >> 1);
+    m_state[train] = next;
+    m_hop[train]++;
+    m_waited[train] = 0;
+    SimStats::count(eStatTrainsMoved);
+}
+
+bool TrainFleet::blocked(int train)
+{
+    SimStats::count(eStatBlockedSignal);
+    if (++m_waited[train] <= m_reroutePatience) { return false; }
+    return reroute(train);
+}
+
+bool TrainFleet::reroute(int train)
+{
+    Alternatives& alts = m_alts[train];
+    int count = alts.count();
+    if (count < 2) { return false; }
+
+    // The train must still be on its route, at the state of its hop.
+    int cur = alts.current;
+    uint32_t hop = (uint32_t)m_hop[train];
+    if ((alts.statePos[cur] + hop >= alts.statePos[cur + 1]) ||
+        (alts.states[alts.statePos[cur] + hop] != m_state[train])) {
+        return false;
+    }
+
+    // Take the next route in rank order that runs through the states
+    // the train has come by and the one it is in.
+    for (int kx = 1; kx < count; kx++) {
+        int cand = (cur + kx) % count;
+        if (alts.shared[cur * count + cand] <= hop) continue;
+
+        // The routes agree on the junctions passed so far.
+        uint32_t consumed = (alts.stepPos[cur + 1] - alts.stepPos[cur]) -
+                            (uint32_t)(m_routeEnd[train] - m_routePos[train]);
+        uint32_t from = alts.stepPos[cand] + consumed;
+        appendRoute(train, alts.steps.data() + from, alts.stepPos[cand + 1] - from);
+        alts.current = cand;
+        m_waited[train] = 0;
+        SimStats::count(eStatReroutes);
+        return true;
+    }
+    return false;
+}
+
+bool TrainFleet::step(int train, bool& changed)
+{
+    changed = false;
+    int32_t state = m_state[train];
+    if (state >= 0) {
+        if (m_tableVersion != sys().topologyVersion()) { refreshTable(); }
+        int edge = state >> 1;
+        if (edge == m_dest[train]) { return false; }
+        if (m_depart[train] > sys().simStep()) { return true; }
+
+        const TransitionTable& table = sys().transitions();
+        int32_t next = table.next(state);
+        if ((next >= 0) && ((table.facingType(state) != eJunction) ||
+                            (table.facingSlot(state) != eSlot1))) {
+            RRsignal* light = m_signal[state];
+            if (light && light->signalIsRed()) {
+                blocked(train);
+                return true;
+            }
+            if (m_occupant[next >> 1] < 0) {
+                move(train, next);
+                changed = true;
+                return true;
+            }
+            // The next segment is occupied, which the slow path reports
+            // as a collision.
+        }
+    }
+
+    // Everything else is handled by the Train. Watch the switch at the
+    // end the train is facing, the only one it may set.
+    NodePtr node;
+    eJSwitch jsw = eSwitchNone;
+    if (state >= 0) {
+        node = sys().edges()[state >> 1]->getNode((eEnd)(state & 1)).nsNode;
+        if (node) { jsw = node->getSwitchPos(); }
+    }
+    bool rval = sys().trains()[train]->stepSimulation();
+    changed = (m_state[train] != state) || (node && (node->getSwitchPos() != jsw));
+    return rval;
+}
+
+void TrainFleet::repairRoutes()
+{
+    const TransitionTable& table = sys().transitions();
+    RouteRepair& repair = sys().routeRepair();
+    if (!repair.sync(table)) { return; }
+
+    std::vector<int> targets;
+    std::vector<eJSwitch> steps;
+    for (size_t tx = 0; tx < m_state.size(); tx++) {
+        int32_t state = m_state[tx];
+        int dest = m_dest[tx];
+        if ((state < 0) || (dest < 0) || ((state >> 1) == dest)) continue;
+        targets.push_back(dest);
+
+        // Follow the route as it stands.
+        int32_t cost = 0;
+        int32_t pos = m_routePos[tx];
+        int32_t walk = state;
+        while ((walk >= 0) && ((walk >> 1) != dest) && (cost < (int32_t)table.states())) {
+            int kx = 0;
+            if ((table.facingType(walk) == eJunction) && (table.facingSlot(walk) == eSlot1)) {
+                if (pos == m_routeEnd[tx]) { walk = -1; break; }
+                kx = (m_routeSteps[pos++] == eSwitchLeft) ? 0 : 1;
+            }
+            walk = table.branch(walk, kx);
+            cost++;
+        }
+        if ((walk >= 0) && ((walk >> 1) == dest) && (cost <= repair.distance(dest, state))) {
+            continue;
+        }
+        if (repair.route(dest, state, steps)) {
+            setRoute((int)tx, steps);
+            SimStats::count(eStatRouteRepairs);
+        }
+    }
+    repair.retain(targets);
+}
+
+void TrainFleet::refreshTable()
+{
+    repairRoutes();
+    const TransitionTable& table = sys().transitions();
+    const EdgeVec& edges = sys().edges();
+    if (m_occupant.size() < edges.size()) {
+        m_occupant.resize(edges.size(), -1);
+    }
+    if ((m_logPos < table.logStart()) || (m_signal.size() > edges.size() * 2)) {
+        m_signal.assign(edges.size() * 2, nullptr);
+        for (const EdgePtr& eptr: edges) {
+            if (!eptr) continue;
+            for (int ix = 0; ix < eNumEnds; ix++) {
+                m_signal[eptr->id() * 2 + ix] = eptr->getSignal((eEnd)ix);
+            }
+        }
+    }
+    else {
+        // Only the states of the edits since the last refresh.
+        m_signal.resize(edges.size() * 2, nullptr);
+        for (size_t pos = m_logPos; pos < table.logEnd(); pos++) {
+            int32_t state = table.logAt(pos);
+            const EdgePtr& eptr = edges[state >> 1];
+            m_signal[state] = eptr ? eptr->getSignal((eEnd)(state & 1)) : nullptr;
+        }
+    }
+    m_logPos = table.logEnd();
+    m_tableVersion = sys().topologyVersion();
+}
+
+} // namespace rrsim
@@ -0,0 +1,283 @@
+// fleetplanner.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the FleetPlanner class.
+
+#include "fleetplanner.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "memstat.h"
+#include "trace.h"
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+
+namespace rrsim {
+
+static const int32_t kNever = INT32_MAX / 2;
+
+static uint64_t busyKey(int edge, int32_t time)
+{
+    return ((uint64_t)(uint32_t)edge << 32) | (uint32_t)time;
+}
+
+FleetPlanner::FleetPlanner(int slack) : m_slack(std::max(0, slack))
+{
+}
+
+void FleetPlanner::plan()
+{
+    RRSIM_TRACE_SCOPE("planFleet");
+    MemScope mem(eMemRouting);
+    TrainFleet& fleet = sys().fleet();
+
+    // The distances must match the network as it is now.
+    fleet.repairRoutes();
+    const TransitionTable& table = sys().transitions();
+    const EdgeVec& edges = sys().edges();
+
+    m_plans.clear();
+    m_busy.clear();
+    m_windows.clear();
+    m_junctionAt.assign(table.states(), -1);
+    for (size_t sx = 0; sx < table.states(); sx++) {
+        if ((table.facingType((int32_t)sx) != eJunction) || !edges[sx >> 1]) continue;
+        NodePtr node = edges[sx >> 1]->getNode((eEnd)(sx & 1)).nsNode;
+        if (node) { m_junctionAt[sx] = node->id(); }
+    }
+    m_switch.assign(sys().nodes().size(), eSwitchNone);
+    for (int id: sys().nodesOfType(eJunction)) {
+        m_switch[id] = sys().nodes()[id]->getSwitchPos();
+    }
+
+    // Every train stays where it is until it is planned.
+    m_parkedFrom.assign(edges.size(), kNever);
+    m_parkedBy.assign(edges.size(), -1);
+    m_lastUse.assign(edges.size(), -1);
+    for (const TrainPtr& tptr: sys().sortedTrains()) {
+        int train = tptr->id();
+        if (!fleet.onTrack(train)) continue;
+        m_parkedFrom[fleet.edgeOf(train)] = 0;
+        m_parkedBy[fleet.edgeOf(train)] = train;
+        if ((fleet.destOf(train) >= 0) && (fleet.edgeOf(train) != fleet.destOf(train))) {
+            Plan plan;
+            plan.train = train;
+            m_plans.push_back(plan);
+        }
+    }
+
+    // A train may fail for want of the departure time of a train after
+    // it, so go round again while the passes make progress.
+    for (bool progress = true; progress; ) {
+        progress = false;
+        for (Plan& plan: m_plans) {
+            if (!plan.planned && planTrain(plan)) { progress = true; }
+        }
+    }
+}
+
+void FleetPlanner::apply() const
+{
+    TrainFleet& fleet = sys().fleet();
+    int last = 0;
+    for (const Plan& plan: m_plans) {
+        if (plan.planned) { last = std::max(last, plan.arrive); }
+    }
+    for (const Plan& plan: m_plans) {
+        if (plan.planned) {
+            fleet.setRoute(plan.train, plan.steps);
+            fleet.setDeparture(plan.train, sys().simStep() + plan.depart);
+        }
+        else {
+            // Out of the way of the planned trains.
+            fleet.setDeparture(plan.train, sys().simStep() + last);
+        }
+    }
+}
+
+eJSwitch FleetPlanner::needed(int32_t state, int32_t next) const
+{
+    const TransitionTable& table = sys().transitions();
+    switch (table.facingSlot(state)) {
+    case eSlot1: return (table.branch(state, 0) == next) ? eSwitchLeft : eSwitchRight;
+    case eSlot2: return eSwitchLeft;
+    case eSlot3: return eSwitchRight;
+    default:     return eSwitchNone;
+    }
+}
+
+bool FleetPlanner::planTrain(Plan& plan)
+{
+    TrainFleet& fleet = sys().fleet();
+    const TransitionTable& table = sys().transitions();
+    RouteRepair& repair = sys().routeRepair();
+    int train = plan.train;
+    int dest = fleet.destOf(train);
+    int32_t start = fleet.stateOf(train);
+    int32_t best = repair.distance(dest, start);
+    if (best >= RouteRepair::kUnreachable) { return false; }
+    int32_t limit = best + m_slack;
+
+    // The train's own start segment is only held by its own steps.
+    int origin = start >> 1;
+    m_parkedFrom[origin] = kNever;
+    m_parkedBy[origin] = -1;
+
+    // Open nodes by arrival estimate, later times first among equals.
+    std::vector<Step> nodes;
+    using Entry = std::pair<int32_t, int32_t>;     // Estimate, node.
+    auto later = [&](const Entry& a, const Entry& b) {
+        if (a.first != b.first) { return a.first > b.first; }
+        return nodes[a.second].time < nodes[b.second].time;
+    };
+    std::priority_queue<Entry, std::vector<Entry>, decltype(later)> open(later);
+    std::unordered_set<uint64_t> closed;
+
+    nodes.push_back(Step{start, 0, -1, false});
+    open.emplace(best, 0);
+    int32_t found = -1;
+    while (!open.empty()) {
+        int32_t ix = open.top().second;
+        open.pop();
+        Step cur = nodes[ix];
+        uint64_t key = busyKey(cur.state, cur.time * 2 + cur.moved);
+        if (!closed.insert(key).second) continue;
+        if ((cur.state >> 1) == dest) {
+            found = ix;
+            break;
+        }
+
+        // Wait on the start segment.
+        if (!cur.moved && (cur.time + 1 + best <= limit) &&
+            edgeFree(origin, cur.time + 1, train)) {
+            nodes.push_back(Step{cur.state, cur.time + 1, ix, false});
+            open.emplace(cur.time + 1 + best, (int32_t)nodes.size() - 1);
+        }
+
+        for (int kx = 0; kx < 2; kx++) {
+            int32_t next = table.branch(cur.state, kx);
+            if (next < 0) continue;
+            int32_t togo = repair.distance(dest, next);
+            if (togo >= RouteRepair::kUnreachable) continue;
+
+            // A switch the wrong way costs a step to set.
+            int32_t move = cur.time;
+            int node = m_junctionAt[cur.state];
+            if (node >= 0) {
+                eJSwitch pos = needed(cur.state, next);
+                bool flip = (switchAt(node, cur.time) != pos);
+                move += flip;
+                if (!windowFree(node, cur.time, move, pos)) continue;
+                if (flip && !edgeFree(cur.state >> 1, move, train)) continue;
+            }
+            int32_t arrive = move + 1;
+            if (arrive + togo > limit) continue;
+            if (!edgeFree(next >> 1, arrive, train)) continue;
+            if (((next >> 1) == dest) && !canPark(dest, arrive, train)) continue;
+            nodes.push_back(Step{next, arrive, ix, true});
+            open.emplace(arrive + togo, (int32_t)nodes.size() - 1);
+        }
+    }
+    if (found < 0) {
+        // Keep holding the start segment.
+        m_parkedFrom[origin] = 0;
+        m_parkedBy[origin] = train;
+        return false;
+    }
+
+    std::vector<Step> path;
+    for (int32_t ix = found; ix >= 0; ix = nodes[ix].parent) { path.push_back(nodes[ix]); }
+    std::reverse(path.begin(), path.end());
+
+    plan.planned = true;
+    plan.depart = 0;
+    plan.arrive = path.back().time;
+    plan.steps.clear();
+    for (size_t px = 0; px + 1 < path.size(); px++) {
+        const Step& from = path[px];
+        const Step& to = path[px + 1];
+        if (!to.moved) { plan.depart = to.time; continue; }
+        if ((table.facingType(from.state) == eJunction) &&
+            (table.facingSlot(from.state) == eSlot1)) {
+            plan.steps.push_back(needed(from.state, to.state));
+        }
+    }
+    reserve(plan, path);
+    return true;
+}
+
+bool FleetPlanner::edgeFree(int edge, int32_t time, int train) const
+{
+    if ((m_parkedFrom[edge] <= time + 1) && (m_parkedBy[edge] != train)) { return false; }
+    for (int32_t tx = time - 1; tx <= time + 1; tx++) {
+        auto found = m_busy.find(busyKey(edge, tx));
+        if ((found != m_busy.end()) && (found->second != train)) { return false; }
+    }
+    return true;
+}
+
+bool FleetPlanner::canPark(int edge, int32_t time, int train) const
+{
+    // Nobody may come by once the train has stopped there.
+    return (m_lastUse[edge] < time - 1) &&
+           ((m_parkedFrom[edge] == kNever) || (m_parkedBy[edge] == train));
+}
+
+eJSwitch FleetPlanner::switchAt(int node, int32_t time) const
+{
+    auto found = m_windows.find(node);
+    if (found != m_windows.end()) {
+        auto it = found->second.lower_bound(time);
+        if (it != found->second.begin()) { return (--it)->second.pos; }
+    }
+    return m_switch[node];
+}
+
+bool FleetPlanner::windowFree(int node, int32_t start, int32_t end, eJSwitch pos) const
+{
+    auto found = m_windows.find(node);
+    if (found == m_windows.end()) { return true; }
+    const std::multimap<int32_t, Window>& windows = found->second;
+
+    // Another position wanted at the same time.
+    auto it = windows.begin();
+    for ( ; (it != windows.end()) && (it->first <= end); ++it) {
+        if ((it->second.pos != pos) && (start <= it->second.end)) { return false; }
+    }
+    // The next train counted on finding the switch its way.
+    for (auto next = it; (next != windows.end()) && (next->first == it->first); ++next) {
+        if ((next->second.pos != pos) && !next->second.flip) { return false; }
+    }
+    return true;
+}
+
+void FleetPlanner::reserve(const Plan& plan, const std::vector<Step>& path)
+{
+    for (size_t px = 0; px < path.size(); px++) {
+        int edge = path[px].state >> 1;
+        int32_t until = (px + 1 < path.size()) ? path[px + 1].time - 1 : path[px].time;
+        for (int32_t tx = path[px].time; tx <= until; tx++) {
+            m_busy[busyKey(edge, tx)] = plan.train;
+        }
+        m_lastUse[edge] = std::max(m_lastUse[edge], until);
+
+        if ((px + 1 < path.size()) && path[px + 1].moved) {
+            int node = m_junctionAt[path[px].state];
+            if (node >= 0) {
+                Window win;
+                win.end = path[px + 1].time - 1;
+                win.pos = needed(path[px].state, path[px + 1].state);
+                win.flip = (win.end > path[px].time);
+                m_windows[node].emplace(path[px].time, win);
+            }
+        }
+    }
+    int dest = path.back().state >> 1;
+    m_parkedFrom[dest] = path.back().time;
+    m_parkedBy[dest] = plan.train;
+}
+
+} // namespace rrsim
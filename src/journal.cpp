@@ -0,0 +1,447 @@
+// journal.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the Journal class.
+
+#include "journal.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "memstat.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace rrsim {
+
+// The journal is folded once it has more lines than this share of the
+// base, and this many at the least.
+static const size_t kFoldShare = 4;
+static const size_t kFoldLines = 1024;
+
+static std::string journalPath(const std::string& path)
+{
+    return path + ".journal";
+}
+
+// The kind of a line, up to ": ", and its key, up to the first comma.
+static bool splitLine(const std::string& line, std::string& kind, std::string& key)
+{
+    size_t colon = line.find(": ");
+    if (colon == std::string::npos) { return false; }
+    kind.assign(line, 0, colon);
+    size_t comma = std::min(line.find(',', colon + 2), line.size());
+    key.assign(line, colon + 2, comma - colon - 2);
+    return true;
+}
+
+// The epoch from the first line of a base or a journal, 0 for a file
+// without one, such as a base saved whole (see System::serialize).
+static long epochOf(const std::string& path)
+{
+    std::ifstream is(path);
+    std::string line;
+    if (!std::getline(is, line) || (line.compare(0, 7, "epoch: ") != 0)) { return 0; }
+    try { return std::stol(line.substr(7)); } catch (...) { return 0; }
+}
+
+namespace {
+
+// Base and journal lines folded together by name.
+struct Folded
+{
+    std::map<std::string, std::string> tracks;
+    std::map<std::string, std::string> switches;
+    std::map<std::string, std::string> trains;
+    std::set<std::string>   untracked;
+    std::set<std::string>   untrained;
+
+    // Returns false for a line of no known kind.
+    bool    add(const std::string& line);
+};
+
+bool Folded::add(const std::string& line)
+{
+    std::string kind, key;
+    if (!splitLine(line, kind, key)) { return false; }
+    if (kind == "track") { tracks[key] = line; }
+    else if (kind == "untrack") {
+        tracks.erase(key);
+        untracked.insert(key);
+    }
+    else if (kind == "switch") { switches[key] = line; }
+    else if (kind == "train") { trains[key] = line; }
+    else if (kind == "untrain") {
+        trains.erase(key);
+        untrained.insert(key);
+    }
+    else if ((kind != "epoch") && (kind != "mark")) { return false; }
+    return true;
+}
+
+// Fold the journal up to the mark of the epoch into a new base, and put
+// it in place of the old one. Only the files are read, so this runs
+// beside the simulation. Returns the lines of the new base, 0 if the
+// fold failed.
+size_t foldFiles(const std::string& path, long epoch)
+{
+    MemScope mem(eMemIO);
+    Folded folded;
+    std::string line;
+    std::ifstream base(path);
+    while (std::getline(base, line)) {
+        if (!line.empty() && !folded.add(line)) { return 0; }
+    }
+    std::ifstream journal(journalPath(path));
+    std::string mark = "mark: " + std::to_string(epoch);
+    bool marked = false;
+    while (!marked && std::getline(journal, line)) {
+        if (line == mark) { marked = true; }
+        else if (!line.empty() && !folded.add(line)) { return 0; }
+    }
+    if (!base.eof() || !marked) { return 0; }
+
+    // The switches of nodes no longer in the network are dropped.
+    std::set<std::string> nodes;
+    for (const auto& track: folded.tracks) {
+        std::stringstream ss(track.second);
+        std::string field;
+        for (int fx = 0; std::getline(ss, field, ','); fx++) {
+            if ((fx == 2) || (fx == 4)) { nodes.insert(field); }
+        }
+    }
+    std::string tmp = path + ".tmp";
+    std::ofstream os(tmp, std::ofstream::trunc);
+    os << "epoch: " << epoch << '\n';
+    size_t lines = 1;
+    for (const auto& track: folded.tracks) { os << track.second << '\n'; lines++; }
+    for (const auto& sw: folded.switches) {
+        if (nodes.count(sw.first)) { os << sw.second << '\n'; lines++; }
+    }
+    for (const auto& train: folded.trains) { os << train.second << '\n'; lines++; }
+    os.close();
+    if (!os.good() || (std::rename(tmp.c_str(), path.c_str()) != 0)) { return 0; }
+    return lines;
+}
+
+} // namespace
+
+Journal::Journal() :
+    m_epoch(0), m_lines(0), m_baseLines(0), m_foldState(eFoldIdle),
+    m_markEnd(0), m_foldLines(0)
+{
+}
+
+Journal::~Journal()
+{
+    finishFold(true);
+}
+
+void Journal::forget()
+{
+    for (int id: m_edges) { m_edgeMarks[id] = 0; }
+    for (int id: m_switches) { m_switchMarks[id] = 0; }
+    m_edges.clear();
+    m_switches.clear();
+    m_untracked.clear();
+    m_untrained.clear();
+}
+
+void Journal::detach()
+{
+    finishFold(true);
+    m_path.clear();
+    forget();
+}
+
+int Journal::save(const std::string& path)
+{
+    RRSIM_TRACE_SCOPE("journalSave");
+    MemScope mem(eMemIO);
+    finishFold(path != m_path);
+    if (path != m_path) { return writeBase(path); }
+
+    std::ofstream os(journalPath(path), std::ofstream::app);
+    m_lines += writeEdits(os, false);
+    os.close();
+    if (!os.good()) {
+        std::cout << "ERROR: Unable to append to " << journalPath(path) << std::endl;
+        return EIO;
+    }
+    forget();
+    if ((m_foldState == eFoldIdle) &&
+        (m_lines > std::max(kFoldLines, m_baseLines / kFoldShare))) {
+        startFold();
+    }
+    return 0;
+}
+
+// The whole network goes to a new base, one epoch past any base or
+// journal already at the path so that neither is taken for the other.
+int Journal::writeBase(const std::string& path)
+{
+    m_path.clear();
+    long epoch = std::max(epochOf(path), epochOf(journalPath(path))) + 1;
+    std::string tmp = path + ".tmp";
+    std::ofstream os(tmp, std::ofstream::trunc);
+    os << "epoch: " << epoch << '\n';
+    size_t lines = 1;
+    for (const EdgePtr& eptr: sys().sortedEdges()) {
+        os << eptr->serialize();
+        lines++;
+    }
+    lines += writeEdits(os, true);
+    os.close();
+    if (!os.good() || (std::rename(tmp.c_str(), path.c_str()) != 0)) {
+        std::cout << "ERROR: Unable to write " << path << std::endl;
+        return EIO;
+    }
+    std::ofstream journal(journalPath(path), std::ofstream::trunc);
+    journal << "epoch: " << epoch << '\n';
+    journal.close();
+    if (!journal.good()) {
+        std::cout << "ERROR: Unable to write " << journalPath(path) << std::endl;
+        return EIO;
+    }
+    forget();
+    m_path = path;
+    m_epoch = epoch;
+    m_lines = 0;
+    m_baseLines = lines;
+    return 0;
+}
+
+// The lines of the edits since the last save, or of every switch for a
+// base, then those of every train. Returns the number of lines.
+size_t Journal::writeEdits(std::ostream& os, bool all)
+{
+    size_t lines = 0;
+    const EdgeVec& edges = sys().edges();
+    const NodeVec& nodes = sys().nodes();
+    auto writeSwitch = [&](const NodePtr& nptr) {
+        if (!nptr || (nptr->getNodeType() != eJunction)) { return; }
+        os << "switch: " << nptr->name() << ','
+           << ((nptr->getSwitchPos() == eSwitchRight) ? 'R' : 'L') << '\n';
+        lines++;
+    };
+    if (all) {
+        for (int id: sys().nodesOfType(eJunction)) { writeSwitch(nodes[id]); }
+    }
+    else {
+        for (const std::string& name: m_untracked) {
+            os << "untrack: " << name << '\n';
+            lines++;
+        }
+        for (int id: m_edges) {
+            if (((size_t)id < edges.size()) && edges[id]) {
+                os << edges[id]->serialize();
+                lines++;
+            }
+        }
+        for (int id: m_switches) {
+            if ((size_t)id < nodes.size()) { writeSwitch(nodes[id]); }
+        }
+        for (const std::string& name: m_untrained) {
+            os << "untrain: " << name << '\n';
+            lines++;
+        }
+    }
+    const TrainFleet& fleet = sys().fleet();
+    for (const TrainPtr& tptr: sys().trains()) {
+        if (!tptr) continue;
+        int id = tptr->id();
+        os << "train: " << tptr->name() << ',';
+        if (fleet.onTrack(id)) {
+            os << edges[fleet.edgeOf(id)]->name() << ','
+               << ((fleet.endOf(id) == eEndA) ? 'A' : 'B') << ',';
+        }
+        else {
+            os << "-,-,";
+        }
+        os << ((fleet.destOf(id) >= 0) ? edges[fleet.destOf(id)]->name() : "-")
+           << ',' << fleet.lengthOf(id) << '\n';
+        lines++;
+    }
+    return lines;
+}
+
+void Journal::startFold()
+{
+    std::string jpath = journalPath(m_path);
+    long epoch = m_epoch + 1;
+    std::ofstream os(jpath, std::ofstream::app);
+    os << "mark: " << epoch << '\n';
+    os.close();
+    if (!os.good()) { return; }
+    std::ifstream is(jpath, std::ifstream::ate | std::ifstream::binary);
+    m_markEnd = (long)is.tellg();
+    m_lines++;
+
+    m_foldState = eFoldRunning;
+    std::string path = m_path;
+    m_fold = std::thread([this, path, epoch]() {
+        m_foldLines = foldFiles(path, epoch);
+        m_foldState = (m_foldLines > 0) ? eFoldDone : eFoldFailed;
+    });
+}
+
+// Once the new base is in place, the journal starts over at its epoch
+// with the lines written after the mark.
+void Journal::finishFold(bool wait)
+{
+    if (m_foldState == eFoldIdle) { return; }
+    if (!wait && (m_foldState == eFoldRunning)) { return; }
+    m_fold.join();
+    bool folded = (m_foldState == eFoldDone);
+    m_foldState = eFoldIdle;
+    if (!folded) {
+        std::cout << "ERROR: Unable to fold the journal into " << m_path << std::endl;
+        return;
+    }
+    std::string jpath = journalPath(m_path);
+    std::ifstream is(jpath, std::ifstream::binary);
+    is.seekg(m_markEnd);
+    std::string tail((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    is.close();
+    std::string tmp = jpath + ".tmp";
+    std::ofstream os(tmp, std::ofstream::trunc | std::ofstream::binary);
+    os << "epoch: " << (m_epoch + 1) << '\n' << tail;
+    os.close();
+    if (!os.good() || (std::rename(tmp.c_str(), jpath.c_str()) != 0)) {
+        // The old journal still recovers from its mark, but the next
+        // save starts a new base.
+        std::cout << "ERROR: Unable to write " << jpath << std::endl;
+        m_path.clear();
+        return;
+    }
+    m_epoch++;
+    m_lines = (size_t)std::count(tail.begin(), tail.end(), '\n');
+    m_baseLines = m_foldLines;
+}
+
+int Journal::recover(const std::string& path)
+{
+    RRSIM_TRACE_SCOPE("journalRecover");
+    MemScope mem(eMemIO);
+    detach();
+    std::string jpath = journalPath(path);
+    std::ifstream is(jpath);
+    if (!is.good()) { return 0; }
+
+    // The journal of the base's epoch replays whole, the one before only
+    // after the mark of the fold that made the base.
+    long epoch = epochOf(path);
+    long jepoch = epochOf(jpath);
+    std::string mark;
+    if (jepoch + 1 == epoch) { mark = "mark: " + std::to_string(epoch); }
+    else if (jepoch != epoch) {
+        std::cout << "WARNING: " << jpath << " is not of this base, not replayed"
+                  << std::endl;
+        return 0;
+    }
+    Folded folded;
+    std::string line;
+    std::string kept;
+    size_t lines = 0;
+    std::getline(is, line);
+    while (std::getline(is, line)) {
+        if (!mark.empty()) {
+            if (line == mark) { mark.clear(); }
+            continue;
+        }
+        if (line.empty()) continue;
+        if (!folded.add(line)) {
+            std::cout << "ERROR: Unknown journal line \"" << line << "\"" << std::endl;
+            return EFAULT;
+        }
+        kept += line;
+        kept += '\n';
+        lines++;
+    }
+
+    std::stringstream tracks;
+    for (const auto& track: folded.tracks) { tracks << track.second << '\n'; }
+    std::vector<std::string> removed(folded.untracked.begin(), folded.untracked.end());
+    int rc = sys().patch(tracks, removed);
+    if (rc != 0) { return rc; }
+    std::vector<std::string> state;
+    for (const std::string& name: folded.untrained) { state.push_back("untrain: " + name); }
+    for (const auto& sw: folded.switches) { state.push_back(sw.second); }
+    for (const auto& train: folded.trains) { state.push_back(train.second); }
+    try { applyState(state); }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EFAULT;
+    }
+    sys().updateAllSignals();
+
+    // A fold that did not get to cut the journal back is finished here.
+    if (jepoch != epoch) {
+        std::string tmp = jpath + ".tmp";
+        std::ofstream os(tmp, std::ofstream::trunc);
+        os << "epoch: " << epoch << '\n' << kept;
+        os.close();
+        if (!os.good() || (std::rename(tmp.c_str(), jpath.c_str()) != 0)) {
+            std::cout << "ERROR: Unable to write " << jpath << std::endl;
+            return EIO;
+        }
+    }
+    m_path = path;
+    m_epoch = epoch;
+    m_lines = lines;
+    m_baseLines = (size_t)sys().edgeCount();
+    std::cout << "Replayed " << lines << " journal lines" << std::endl;
+    return 0;
+}
+
+bool Journal::isState(const std::string& line)
+{
+    return (line.compare(0, 8, "switch: ") == 0) ||
+           (line.compare(0, 7, "train: ") == 0) ||
+           (line.compare(0, 9, "untrain: ") == 0);
+}
+
+void Journal::applyState(const std::vector<std::string>& lines)
+{
+    std::string kind, key;
+    for (const std::string& line: lines) {
+        if (!splitLine(line, kind, key)) continue;
+        TrainPtr tptr = sys().getTrain(key);
+        if (!tptr || ((kind != "train") && (kind != "untrain"))) continue;
+        if (kind == "untrain") { sys().removeTrain(key); }
+        else { tptr->placeOnTrack(nullptr, nullptr); }
+    }
+    for (const std::string& line: lines) {
+        if (!splitLine(line, kind, key)) continue;
+        if (kind == "switch") {
+            NodePtr nptr = sys().getNode(key);
+            if (nptr && (nptr->getNodeType() == eJunction)) {
+                bool right = (line.compare(line.size() - 2, 2, ",R") == 0);
+                nptr->setSwitchPos(right ? eSwitchRight : eSwitchLeft);
+            }
+        }
+        else if (kind == "train") {
+            std::stringstream ss(line.substr(line.find(": ") + 2));
+            std::string fields[5];
+            for (std::string& field: fields) { std::getline(ss, field, ','); }
+            if (fields[4].empty()) {
+                throw std::runtime_error("Train line is missing fields: " + line);
+            }
+            TrainPtr tptr = sys().getTrain(key);
+            if (!tptr) { tptr = sys().createTrain(key); }
+            sys().fleet().setLength(tptr->id(), std::stod(fields[4]));
+            tptr->restore(sys().getEdge(fields[1]), (fields[2] == "A") ? eEndA : eEndB,
+                          sys().getEdge(fields[3]));
+        }
+    }
+}
+
+} // namespace rrsim
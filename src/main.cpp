@@ -10,7 +10,15 @@
 #include "rrsignal.h"
 #include "train.h"
 #include "system.h"
+#include "stats.h"
+#include "trace.h"
+#include "memstat.h"
+#include "routematrix.h"
+#include "fleetplanner.h"
+#include "branch.h"
 #include "config.h"
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -139,6 +147,51 @@ static int cmdPlaceSignal()
     return 0;
 }
 
+static int cmdRemoveSegment()
+{
+    std::string resp = enterName();
+    if (resp.empty()) { return 0; }
+    EdgePtr eptr = sys().getEdge(resp);
+    if (!eptr) {
+        std::string rnum = nameFromNumber(resp);
+        eptr = sys().getEdge(rnum);
+        if (!eptr) {
+            std::cout << "No such segment \"" << resp << "\"" << std::endl;
+            return EINVAL;
+        }
+    }
+    try {
+        std::string name = eptr->name();
+        eptr.reset();
+        sys().removeEdge(name);
+        sys().updateAllSignals();
+        std::cout << "Removed track segment \"" << name << "\"" << std::endl;
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EBUSY;
+    }
+    return 0;
+}
+
+static int cmdRemoveNode()
+{
+    std::cout << "Enter node name: ";
+    std::string resp;
+    std::getline(std::cin, resp);
+    if (resp.empty()) { return 0; }
+    try {
+        sys().removeNode(resp);
+        sys().updateAllSignals();
+        std::cout << "Removed node \"" << resp << "\"" << std::endl;
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EINVAL;
+    }
+    return 0;
+}
+
 static int cmdSignalAllJunctions()
 {
     try {
@@ -267,6 +320,353 @@ static int cmdRunSimulation()
     return sys().runSimulation();
 }
 
+static int cmdStatistics()
+{
+    std::cout << rrsim::SimStats::instance().toText() << std::endl;
+    std::cout << "Enter [C] to clear, [D] to dump to a file, RETURN to continue: ";
+    std::string resp;
+    std::getline(std::cin, resp);
+    if ((resp == "C") || (resp == "c")) {
+        rrsim::SimStats::instance().reset();
+        std::cout << "Statistics cleared" << std::endl;
+    }
+    else if ((resp == "D") || (resp == "d")) {
+        std::string path;
+        std::cout << "Enter file path (.json for JSON, RETURN to stop dumps): ";
+        std::getline(std::cin, path);
+        if (path.empty()) {
+            sys().setStatsDump(path, 0);
+            std::cout << "Periodic statistics dumps stopped" << std::endl;
+            return 0;
+        }
+        int rc = rrsim::SimStats::instance().dump(path);
+        if (rc) {
+            std::cout << "Unable to write file " << path << std::endl;
+            return rc;
+        }
+        std::cout << "Dump again every N simulation steps (RETURN for never): ";
+        std::getline(std::cin, resp);
+        int period = 0;
+        try { period = std::stoi(resp); } catch (...) { period = 0; }
+        sys().setStatsDump(path, period);
+    }
+    return 0;
+}
+
+static int cmdMemoryUsage()
+{
+    std::cout << rrsim::MemStats::report((long)sys().edgeCount());
+    return 0;
+}
+
+static int cmdRouteMatrix()
+{
+    if (sys().edgeCount() == 0) {
+        std::cout << "There is no track network" << std::endl;
+        return 0;
+    }
+    // Every terminator segment, plus any stations named here.
+    std::vector<EdgePtr> ends = rrsim::RouteMatrix::terminatorEdges();
+    std::string resp;
+    std::cout << "Enter station segment names (RETURN for terminators only): ";
+    std::getline(std::cin, resp);
+    std::stringstream names(resp);
+    std::string name;
+    while (names >> name) {
+        EdgePtr eptr = sys().getEdge(name);
+        if (!eptr) {
+            std::cout << "Track segment " << name << " not found" << std::endl;
+            return ENOENT;
+        }
+        if (std::find(ends.begin(), ends.end(), eptr) == ends.end()) {
+            ends.push_back(eptr);
+        }
+    }
+    std::cout << "Enter number of threads (RETURN for all): ";
+    std::getline(std::cin, resp);
+    unsigned threads = 0;
+    try { threads = (unsigned)std::stoul(resp); } catch (...) { threads = 0; }
+
+    std::string path;
+    std::cout << "Enter CSV file path (RETURN for none): ";
+    std::getline(std::cin, path);
+
+    rrsim::RouteMatrix& matrix = sys().routeMatrix();
+    matrix.compute(ends, threads);
+    std::cout << "Computed routes between " << matrix.size()
+              << " track segments" << std::endl;
+    if (!path.empty()) {
+        std::ofstream ofstr(path, std::ofstream::trunc);
+        if (!ofstr.good()) {
+            std::cout << "Unable to open file " << path << std::endl;
+            return EIO;
+        }
+        matrix.writeCSV(ofstr);
+    }
+    return 0;
+}
+
+static int cmdRerouting()
+{
+    rrsim::TrainFleet& fleet = sys().fleet();
+    std::string resp;
+    std::cout << "Enter number of routes per train (1 for no rerouting): ";
+    std::getline(std::cin, resp);
+    int count;
+    try { count = std::stoi(resp); } catch (...) { return EINVAL; }
+    if (count < 1) { return EINVAL; }
+
+    int patience = 0;
+    if (count > 1) {
+        std::cout << "Enter steps to wait at a red signal before rerouting: ";
+        std::getline(std::cin, resp);
+        try { patience = std::stoi(resp); } catch (...) { return EINVAL; }
+        if (patience < 0) { return EINVAL; }
+    }
+    fleet.setRerouting(count, patience);
+    if (count > 1) {
+        std::cout << "Trains placed from now on keep " << count
+                  << " routes" << std::endl;
+    }
+    else { std::cout << "Rerouting is off" << std::endl; }
+    return 0;
+}
+
+static int cmdPlanFleet()
+{
+    std::string resp;
+    std::cout << "Enter the most steps a train may be late (RETURN for 50): ";
+    std::getline(std::cin, resp);
+    int slack = 50;
+    if (!resp.empty()) {
+        try { slack = std::stoi(resp); } catch (...) { return EINVAL; }
+        if (slack < 0) { return EINVAL; }
+    }
+
+    rrsim::FleetPlanner planner(slack);
+    planner.plan();
+    planner.apply();
+    int planned = 0;
+    for (const rrsim::FleetPlanner::Plan& plan: planner.plans()) {
+        const std::string& name = sys().trains()[plan.train]->name();
+        if (plan.planned) {
+            std::cout << "Train " << name << " departs at step " << plan.depart
+                      << ", arrives at step " << plan.arrive << std::endl;
+            planned++;
+        }
+        else {
+            std::cout << "Train " << name << " could not be planned" << std::endl;
+        }
+    }
+    std::cout << "Planned " << planned << " of " << planner.plans().size()
+              << " trains" << std::endl;
+    return 0;
+}
+
+static int cmdTrainLength()
+{
+    std::string resp;
+    std::cout << "Enter train name: ";
+    std::getline(std::cin, resp);
+    TrainPtr tptr = sys().getTrain(resp);
+    if (!tptr) {
+        std::cout << "No such train: \"" << resp << "\"" << std::endl;
+        return EINVAL;
+    }
+    std::cout << "Enter train length in segment weight (0 for one segment): ";
+    std::getline(std::cin, resp);
+    double length;
+    try { length = std::stod(resp); } catch (...) { return EINVAL; }
+    if (length < 0.0) { return EINVAL; }
+    sys().fleet().setLength(tptr->id(), length);
+    std::cout << "Train " << tptr->name() << " is " << length
+              << " long from its next move" << std::endl;
+    return 0;
+}
+
+static int cmdCheckpoints()
+{
+    std::string path;
+    std::cout << "Enter checkpoint file path (RETURN to stop checkpoints): ";
+    std::getline(std::cin, path);
+    if (path.empty()) {
+        sys().checkpoint().stop();
+        std::cout << "Checkpoints stopped" << std::endl;
+        return 0;
+    }
+    std::string resp;
+    std::cout << "Write a checkpoint every N simulation steps: ";
+    std::getline(std::cin, resp);
+    long period;
+    try { period = std::stol(resp); } catch (...) { return EINVAL; }
+    if (period <= 0) { return EINVAL; }
+    sys().checkpoint().start(path, period);
+    std::cout << "Checkpoints to " << path << " every " << period
+              << " steps while the simulation runs" << std::endl;
+    return 0;
+}
+
+static int cmdWhatIf()
+{
+    if (sys().trains().empty()) {
+        std::cout << "There are no trains" << std::endl;
+        return 0;
+    }
+    std::string resp;
+    std::cout << "Enter number of steps to look ahead: ";
+    std::getline(std::cin, resp);
+    long steps;
+    try { steps = std::stol(resp); } catch (...) { return EINVAL; }
+    if (steps <= 0) { return EINVAL; }
+
+    // The first branch is the future as things stand.
+    std::vector<rrsim::Branch> branches(1);
+    std::vector<std::string> labels(1, "as is");
+    std::cout << "Enter what-ifs, one per line, RETURN to finish:" << std::endl
+              << "    switch <node> <L|R>" << std::endl
+              << "    hold <train> <steps>" << std::endl;
+    while (true) {
+        std::cout << "=> ";
+        std::getline(std::cin, resp);
+        if (resp.empty()) { break; }
+        std::stringstream ss(resp);
+        std::string what, name, arg;
+        ss >> what >> name >> arg;
+        rrsim::Branch branch = branches[0];
+        try {
+            if ((what == "switch") && ((arg == "L") || (arg == "R"))) {
+                rrsim::NodePtr nptr = sys().getNode(name);
+                if (!nptr) { throw std::runtime_error("No such node: " + name); }
+                branch.setSwitch(nptr->id(), (arg == "L") ? rrsim::eSwitchLeft
+                                                          : rrsim::eSwitchRight);
+            }
+            else if (what == "hold") {
+                TrainPtr tptr = sys().getTrain(name);
+                if (!tptr) { throw std::runtime_error("No such train: " + name); }
+                branch.hold(tptr->id(), std::stol(arg));
+            }
+            else {
+                std::cout << "Invalid what-if: \"" << resp << "\"" << std::endl;
+                continue;
+            }
+        }
+        catch (std::exception& ex) {
+            std::cout << "ERROR: " << ex.what() << std::endl;
+            continue;
+        }
+        branches.push_back(branch);
+        labels.push_back(resp);
+    }
+
+    rrsim::Branch start = branches[0];
+    rrsim::Branch::runAll(branches, steps, 0);
+    for (size_t bx = 0; bx < branches.size(); bx++) {
+        const rrsim::Branch& branch = branches[bx];
+        int bound = 0, arrived = 0;
+        long total = 0;
+        for (int id: branch.trains()) {
+            if (branch.destOf(id) < 0) continue;
+            bound++;
+            if (branch.arrivalOf(id) >= 0) {
+                arrived++;
+                total += branch.arrivalOf(id) - start.simStep();
+            }
+        }
+        std::cout << labels[bx] << ": " << arrived << " of " << bound << " trains arrived";
+        if (arrived > 0) {
+            std::stringstream mean;
+            mean << std::fixed << std::setprecision(1) << (double)total / arrived;
+            std::cout << ", in " << mean.str() << " steps on average";
+        }
+        if (branch.collided()) {
+            std::cout << ", collision at step " << branch.simStep() << " ("
+                      << sys().trains()[branch.collidedTrain()]->name() << ")";
+        }
+        std::cout << ", " << branch.ownPages(start) << " of " << branch.pages()
+                  << " pages diverged" << std::endl;
+    }
+    return 0;
+}
+
+static int cmdLoadTimetable()
+{
+    std::string path;
+    std::cout << "Enter timetable file path: ";
+    std::getline(std::cin, path);
+    if (path.empty()) { return 0; }
+    std::ifstream ifstr(path);
+    if (!ifstr.good()) {
+        std::cout << path << " not found" << std::endl;
+        return ENOENT;
+    }
+    try {
+        size_t count = sys().timetable().load(ifstr, sys().simStep());
+        std::cout << "Loaded " << count << " departures, "
+                  << sys().timetable().pending() << " pending" << std::endl;
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EINVAL;
+    }
+    return 0;
+}
+
+static int cmdSoak()
+{
+    if (sys().edgeCount() == 0) {
+        std::cout << "There is no track network" << std::endl;
+        return 0;
+    }
+    std::string resp;
+    std::cout << "Enter trains to spawn per step (e.g. 0.05): ";
+    std::getline(std::cin, resp);
+    double rate;
+    try { rate = std::stod(resp); } catch (...) { return EINVAL; }
+    if (rate <= 0.0) { return EINVAL; }
+
+    std::cout << "Enter number of steps to run: ";
+    std::getline(std::cin, resp);
+    long steps;
+    try { steps = std::stol(resp); } catch (...) { return EINVAL; }
+    if (steps <= 0) { return EINVAL; }
+
+    std::cout << "Report every N steps (RETURN for 1000): ";
+    std::getline(std::cin, resp);
+    long report = 1000;
+    if (!resp.empty()) {
+        try { report = std::stol(resp); } catch (...) { return EINVAL; }
+    }
+
+    std::cout << "Enter station segment names (RETURN for terminators): ";
+    std::getline(std::cin, resp);
+    std::vector<int> ends;
+    std::stringstream names(resp);
+    std::string name;
+    while (names >> name) {
+        EdgePtr eptr = sys().getEdge(name);
+        if (!eptr) {
+            std::cout << "Track segment " << name << " not found" << std::endl;
+            return ENOENT;
+        }
+        ends.push_back(eptr->id());
+    }
+    if (ends.empty()) {
+        for (const EdgePtr& eptr: rrsim::RouteMatrix::terminatorEdges()) {
+            ends.push_back(eptr->id());
+        }
+    }
+    if (ends.size() < 2) {
+        std::cout << "A soak test needs at least two stations" << std::endl;
+        return EINVAL;
+    }
+
+    sys().soak().start(ends, rate, (unsigned)sys().simStep() + 1);
+    int rc = sys().runSoak(steps, report);
+    sys().soak().stop();
+    std::cout << sys().soak().liveTrains() << " soak trains still running" << std::endl;
+    return rc;
+}
+
 static int cmdSaveNetwork()
 {
     std::string path;
@@ -318,6 +718,44 @@ static int cmdLoadNetwork()
 
     int rc = sys().deserialize(ifstr);
     ifstr.close();
+    if (rc == 0) { rc = sys().journal().recover(path); }
+    return rc;
+}
+
+static int cmdJournalSave()
+{
+    std::string path = sys().journal().path();
+    if (path.empty()) {
+        std::cout << "Enter file path: ";
+        std::getline(std::cin, path);
+        if (path.empty()) {
+            std::cout << "No response, quitting..." << std::endl;
+            return 0;
+        }
+    }
+    else {
+        std::cout << "Saving the edits to " << path << ".journal" << std::endl;
+    }
+    return sys().journal().save(path);
+}
+
+static int cmdReloadNetwork()
+{
+    std::string path;
+    std::cout << "Enter file path: ";
+    std::getline(std::cin, path);
+    if (path.empty()) {
+        std::cout << "No response, quitting..." << std::endl;
+        return 0;
+    }
+    std::ifstream ifstr(path);
+    if (!ifstr.good()) {
+        std::cout << path << " not found, quitting..." << std::endl;
+        return ENOENT;
+    }
+
+    int rc = sys().reload(ifstr);
+    ifstr.close();
     return rc;
 }
 
@@ -335,6 +773,10 @@ int runCommandBuild()
             "6. Save track network"                         << std::endl <<
             "7. Load track network"                         << std::endl <<
             "8. Add Signals To All Junctions"               << std::endl <<
+            "9. Remove a track segment"                     << std::endl <<
+            "10. Remove a node"                             << std::endl <<
+            "11. Reload track network"                      << std::endl <<
+            "12. Save track network with journal"           << std::endl <<
             "R/return"                                      << std::endl;
 
     std::string resp;
@@ -389,6 +831,26 @@ int runCommandBuild()
         rc = cmdSignalAllJunctions();
         std::cout << "----------------------------------------------------" << std::endl;
         break;
+    case 9:
+        std::cout << "--------------- Remove Track Segment ---------------" << std::endl;
+        rc = cmdRemoveSegment();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 10:
+        std::cout << "-------------------- Remove Node -------------------" << std::endl;
+        rc = cmdRemoveNode();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 11:
+        std::cout << "--------------- Reload Track Network ---------------" << std::endl;
+        rc = cmdReloadNetwork();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 12:
+        std::cout << "----------------- Journaled Save -------------------" << std::endl;
+        rc = cmdJournalSave();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
     default:
         std::cout << "Invalid entry: \"" << resp << "\"" << std::endl;
         rc = EINVAL;
@@ -411,6 +873,16 @@ int runCommand()
             "4. Place train on a track segment"             << std::endl <<
             "5. [S]tep the train simulation"                << std::endl <<
             "6. [R]un the train simulation"                 << std::endl <<
+            "7. Show simulation statistics"                 << std::endl <<
+            "8. Show memory usage"                          << std::endl <<
+            "9. Compute route matrix"                       << std::endl <<
+            "10. Set train rerouting"                       << std::endl <<
+            "11. Plan fleet schedule"                       << std::endl <<
+            "12. Load timetable"                            << std::endl <<
+            "13. Soak test"                                 << std::endl <<
+            "14. Set train length"                          << std::endl <<
+            "15. Set background checkpoints"                << std::endl <<
+            "16. Compare what-if branches"                  << std::endl <<
             "Q/quit/exit"                                   << std::endl;
 
     std::string resp;
@@ -458,6 +930,56 @@ int runCommand()
         rc = cmdRunSimulation();
         std::cout << "----------------------------------------------------" << std::endl;
         break;
+    case 7:
+        std::cout << "--------------- Simulation Statistics --------------" << std::endl;
+        rc = cmdStatistics();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 8:
+        std::cout << "------------------- Memory Usage -------------------" << std::endl;
+        rc = cmdMemoryUsage();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 9:
+        std::cout << "------------------- Route Matrix -------------------" << std::endl;
+        rc = cmdRouteMatrix();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 10:
+        std::cout << "------------------ Train Rerouting -----------------" << std::endl;
+        rc = cmdRerouting();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 11:
+        std::cout << "---------------- Plan Fleet Schedule ---------------" << std::endl;
+        rc = cmdPlanFleet();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 12:
+        std::cout << "------------------ Load Timetable ------------------" << std::endl;
+        rc = cmdLoadTimetable();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 13:
+        std::cout << "-------------------- Soak Test ---------------------" << std::endl;
+        rc = cmdSoak();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 14:
+        std::cout << "----------------- Set Train Length -----------------" << std::endl;
+        rc = cmdTrainLength();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 15:
+        std::cout << "--------------- Background Checkpoints -------------" << std::endl;
+        rc = cmdCheckpoints();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
+    case 16:
+        std::cout << "---------------- What-If Branches ------------------" << std::endl;
+        rc = cmdWhatIf();
+        std::cout << "----------------------------------------------------" << std::endl;
+        break;
     default:
         std::cout << "Invalid entry: \"" << resp << "\"" << std::endl;
         rc = EINVAL;
@@ -473,6 +995,7 @@ int runCommand()
 // -----------------------------------------------------------------------------
 
 int main(int argc, char **argv) {
+    RRSIM_TRACE_THREAD("main");
     std::cout << "Case Study Implementation -- Railroad Signaling System" << std::endl;
     std::cout << "Version " << cs_signaling_VERSION_MAJOR << "." << cs_signaling_VERSION_MINOR << std::endl;
 
@@ -0,0 +1,219 @@
+// memstat.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the heap allocation accounting, including the
+// replacement global operator new and delete.
+
+#include "memstat.h"
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+namespace rrsim {
+
+#ifdef RRSIM_MEMSTAT
+thread_local eMemTag g_memTag = eMemOther;
+#endif
+
+namespace {
+
+struct TagCounters
+{
+    std::atomic<int64_t>    liveBytes;
+    std::atomic<int64_t>    liveObjects;
+    std::atomic<int64_t>    peakBytes;
+    std::atomic<uint64_t>   totalAllocs;
+    std::atomic<uint64_t>   totalBytes;
+};
+
+// Zero initialized before any dynamic initialization, so allocations
+// made by static constructors are accounted for.
+TagCounters s_counters[eNumMemTags];
+
+// The high water mark of the live bytes of all subsystems together.
+std::atomic<int64_t> s_totalPeak;
+
+// The header keeps the block 16 byte aligned, as malloc does.
+struct alignas(16) BlockHeader
+{
+    uint64_t    size;
+    uint32_t    tag;
+};
+
+const char* tagNames[eNumMemTags] = {
+    "other",
+    "topology",
+    "signals",
+    "trains",
+    "routing",
+    "io",
+};
+
+std::string formatBytes(double bytes)
+{
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    int ux = 0;
+    while ((bytes >= 1024.0) && (ux < 4)) {
+        bytes /= 1024.0;
+        ux++;
+    }
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(ux ? 1 : 0) << bytes << ' ' << units[ux];
+    return ss.str();
+}
+
+} // namespace
+
+bool MemStats::enabled()
+{
+#ifdef RRSIM_MEMSTAT
+    return true;
+#else
+    return false;
+#endif
+}
+
+MemUsage MemStats::usage(eMemTag tag)
+{
+    const TagCounters& c = s_counters[tag];
+    return { c.liveBytes.load(std::memory_order_relaxed),
+             c.liveObjects.load(std::memory_order_relaxed),
+             c.peakBytes.load(std::memory_order_relaxed),
+             c.totalAllocs.load(std::memory_order_relaxed),
+             c.totalBytes.load(std::memory_order_relaxed) };
+}
+
+MemUsage MemStats::total()
+{
+    MemUsage sum = { 0, 0, 0, 0, 0 };
+    for (int ix = 0; ix < eNumMemTags; ix++) {
+        MemUsage u = usage((eMemTag)ix);
+        sum.liveBytes   += u.liveBytes;
+        sum.liveObjects += u.liveObjects;
+        sum.totalAllocs += u.totalAllocs;
+        sum.totalBytes  += u.totalBytes;
+    }
+    sum.peakBytes = s_totalPeak.load(std::memory_order_relaxed);
+    return sum;
+}
+
+const char* MemStats::tagName(eMemTag tag)
+{
+    return tagNames[tag];
+}
+
+std::string MemStats::report(long segments, bool compact)
+{
+    std::stringstream ss;
+    if (!enabled()) {
+        if (compact) { ss << "memory: not accounted" << std::endl; }
+        else {
+            ss << "Memory accounting is off; configure with "
+               << "-DCS_SIGNALING_MEMSTAT=ON to enable it." << std::endl;
+        }
+        return ss.str();
+    }
+    if (compact) {
+        ss << "memory:";
+        for (int ix = 0; ix < eNumMemTags; ix++) {
+            MemUsage u = usage((eMemTag)ix);
+            ss << ' ' << tagNames[ix] << '=' << formatBytes((double)u.liveBytes);
+        }
+        MemUsage t = total();
+        ss << " total=" << formatBytes((double)t.liveBytes);
+        if (segments > 0) {
+            ss << " (" << std::fixed << std::setprecision(1)
+               << (double)t.liveBytes / (double)segments << " B/segment)";
+        }
+        ss << std::endl;
+        return ss.str();
+    }
+
+    ss << std::setw(10) << std::left << "subsystem" << std::right
+       << std::setw(12) << "live"
+       << std::setw(12) << "objects"
+       << std::setw(12) << "peak"
+       << std::setw(14) << "allocations";
+    if (segments > 0) { ss << std::setw(12) << "B/segment"; }
+    ss << std::endl;
+
+    auto line = [&](const char* name, const MemUsage& u) {
+        ss << std::setw(10) << std::left << name << std::right
+           << std::setw(12) << formatBytes((double)u.liveBytes)
+           << std::setw(12) << u.liveObjects
+           << std::setw(12) << formatBytes((double)u.peakBytes)
+           << std::setw(14) << u.totalAllocs;
+        if (segments > 0) {
+            ss << std::setw(12) << std::fixed << std::setprecision(1)
+               << (double)u.liveBytes / (double)segments;
+        }
+        ss << std::endl;
+    };
+    for (int ix = 0; ix < eNumMemTags; ix++) {
+        line(tagNames[ix], usage((eMemTag)ix));
+    }
+    line("total", total());
+    return ss.str();
+}
+
+} // namespace rrsim
+
+// -----------------------------------------------------------------------------
+// Replacement global allocation functions
+// -----------------------------------------------------------------------------
+
+#ifdef RRSIM_MEMSTAT
+
+using rrsim::BlockHeader;
+using rrsim::s_counters;
+using rrsim::s_totalPeak;
+
+// The live bytes of all subsystems together.
+static std::atomic<int64_t> s_totalLive;
+
+void* operator new(std::size_t size)
+{
+    void* raw = std::malloc(sizeof(BlockHeader) + size);
+    if (!raw) { throw std::bad_alloc(); }
+
+    BlockHeader* hdr = static_cast<BlockHeader*>(raw);
+    hdr->size = size;
+    hdr->tag = rrsim::g_memTag;
+
+    auto& c = s_counters[hdr->tag];
+    int64_t live = c.liveBytes.fetch_add((int64_t)size, std::memory_order_relaxed)
+                 + (int64_t)size;
+    c.liveObjects.fetch_add(1, std::memory_order_relaxed);
+    c.totalAllocs.fetch_add(1, std::memory_order_relaxed);
+    c.totalBytes.fetch_add(size, std::memory_order_relaxed);
+    if (live > c.peakBytes.load(std::memory_order_relaxed)) {
+        c.peakBytes.store(live, std::memory_order_relaxed);
+    }
+    int64_t total = s_totalLive.fetch_add((int64_t)size, std::memory_order_relaxed)
+                  + (int64_t)size;
+    int64_t peak = s_totalPeak.load(std::memory_order_relaxed);
+    while ((total > peak) &&
+           !s_totalPeak.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {}
+    return hdr + 1;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (!ptr) { return; }
+    BlockHeader* hdr = static_cast<BlockHeader*>(ptr) - 1;
+    auto& c = s_counters[hdr->tag];
+    c.liveBytes.fetch_sub((int64_t)hdr->size, std::memory_order_relaxed);
+    c.liveObjects.fetch_sub(1, std::memory_order_relaxed);
+    s_totalLive.fetch_sub((int64_t)hdr->size, std::memory_order_relaxed);
+    std::free(hdr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+#endif // RRSIM_MEMSTAT
@@ -0,0 +1,148 @@
+// nametable.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the NameTable and IdIndex classes.
+
+#include "nametable.h"
+
+namespace rrsim {
+
+// -----------------------------------------------------------------------------
+// NameTable
+// -----------------------------------------------------------------------------
+
+NameTable::NameTable() : m_slots(64, kNoName)
+{
+}
+
+// FNV-1a, which is quick for the short names used here.
+uint64_t NameTable::hash(const std::string& str)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char ch: str) {
+        h ^= ch;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+NameID NameTable::find(const std::string& str) const
+{
+    size_t mask = m_slots.size() - 1;
+    uint64_t h = hash(str);
+    for (size_t ix = h & mask; ; ix = (ix + 1) & mask) {
+        NameID id = m_slots[ix];
+        if (id == kNoName) { return kNoName; }
+        if ((m_hashes[id] == h) && (m_strings[id] == str)) { return id; }
+    }
+}
+
+NameID NameTable::intern(const std::string& str)
+{
+    size_t mask = m_slots.size() - 1;
+    uint64_t h = hash(str);
+    size_t ix = h & mask;
+    for (; m_slots[ix] != kNoName; ix = (ix + 1) & mask) {
+        NameID id = m_slots[ix];
+        if ((m_hashes[id] == h) && (m_strings[id] == str)) { return id; }
+    }
+    NameID id = (NameID)m_strings.size();
+    m_strings.push_back(str);
+    m_hashes.push_back(h);
+    m_slots[ix] = id;
+    if (2 * m_strings.size() > m_slots.size()) { grow(); }
+    return id;
+}
+
+void NameTable::grow()
+{
+    std::vector<NameID> slots(2 * m_slots.size(), kNoName);
+    size_t mask = slots.size() - 1;
+    for (NameID id = 0; id < (NameID)m_strings.size(); id++) {
+        size_t ix = m_hashes[id] & mask;
+        while (slots[ix] != kNoName) { ix = (ix + 1) & mask; }
+        slots[ix] = id;
+    }
+    m_slots.swap(slots);
+}
+
+// -----------------------------------------------------------------------------
+// IdIndex
+// -----------------------------------------------------------------------------
+
+IdIndex::IdIndex() : m_slots(64, { kNoName, -1 }), m_count(0)
+{
+}
+
+int IdIndex::find(NameID name) const
+{
+    size_t mask = m_slots.size() - 1;
+    for (size_t ix = hash(name) & mask; ; ix = (ix + 1) & mask) {
+        if (m_slots[ix].name == name) { return m_slots[ix].id; }
+        if (m_slots[ix].name == kNoName) { return -1; }
+    }
+}
+
+bool IdIndex::insert(NameID name, int id)
+{
+    size_t mask = m_slots.size() - 1;
+    size_t ix = hash(name) & mask;
+    for (; m_slots[ix].name != kNoName; ix = (ix + 1) & mask) {
+        if (m_slots[ix].name == name) { return false; }
+    }
+    m_slots[ix] = { name, id };
+    if (2 * ++m_count > m_slots.size()) { rehash(2 * m_slots.size()); }
+    return true;
+}
+
+// Linear probing needs no tombstones: the entries after the hole that
+// would no longer be reachable are shifted back into it.
+bool IdIndex::erase(NameID name)
+{
+    size_t mask = m_slots.size() - 1;
+    size_t ix = hash(name) & mask;
+    for (; m_slots[ix].name != name; ix = (ix + 1) & mask) {
+        if (m_slots[ix].name == kNoName) { return false; }
+    }
+    size_t hole = ix;
+    for (ix = (ix + 1) & mask; m_slots[ix].name != kNoName; ix = (ix + 1) & mask) {
+        size_t home = hash(m_slots[ix].name) & mask;
+        // Move the entry if its home is not between the hole and ix.
+        if (((ix - home) & mask) >= ((ix - hole) & mask)) {
+            m_slots[hole] = m_slots[ix];
+            hole = ix;
+        }
+    }
+    m_slots[hole] = { kNoName, -1 };
+    m_count--;
+    return true;
+}
+
+void IdIndex::clear()
+{
+    m_slots.assign(64, { kNoName, -1 });
+    m_count = 0;
+}
+
+void IdIndex::reserve(size_t count)
+{
+    size_t slots = m_slots.size();
+    while (slots < 2 * count) { slots *= 2; }
+    if (slots > m_slots.size()) { rehash(slots); }
+}
+
+void IdIndex::rehash(size_t slots)
+{
+    std::vector<Slot> old(slots, { kNoName, -1 });
+    old.swap(m_slots);
+    size_t mask = m_slots.size() - 1;
+    for (const Slot& slot: old) {
+        if (slot.name == kNoName) continue;
+        size_t ix = hash(slot.name) & mask;
+        while (m_slots[ix].name != kNoName) { ix = (ix + 1) & mask; }
+        m_slots[ix] = slot;
+    }
+}
+
+} // namespace rrsim
@@ -0,0 +1,152 @@
+// netbuilder.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the NetBuilder class.
+
+#include "netbuilder.h"
+#include "edge.h"
+#include "node.h"
+#include "memstat.h"
+#include "trace.h"
+
+namespace rrsim {
+
+NetBuilder::NetBuilder(size_t edgeHint)
+    : m_errors(0), m_finished(false)
+{
+    m_edges.reserve(edgeHint);
+}
+
+NetBuilder::~NetBuilder()
+{
+    // Never leave edges without nodes in the system, even if finish()
+    // was skipped or threw part way.
+    if (!m_finished) { closeEnds(); }
+}
+
+EdgePtr NetBuilder::addEdge(const std::string& name)
+{
+    MemScope mem(eMemTopology);
+    System& S = sys();
+    EdgePtr eptr = S.addEdge(name.empty() ? S.getUniqueEdgeName() : name);
+    if (!eptr) {
+        error("duplicate edge name " + name);
+        return nullptr;
+    }
+    m_edges.push_back(eptr);
+    return eptr;
+}
+
+NodePtr NetBuilder::newNode()
+{
+    System& S = sys();
+    return S.addNode(S.getUniqueNodeName());
+}
+
+void NetBuilder::connect(const EdgeEnd& s1, const EdgeEnd& s2)
+{
+    MemScope mem(eMemTopology);
+    EdgePtr ept1 = s1.eeEdge.lock();
+    EdgePtr ept2 = s2.eeEdge.lock();
+    if (!ept1 || !ept2) {
+        error("connect with a null edge");
+        return;
+    }
+    // An end cannot be connected to itself, as in connectSegments.
+    if ((ept1 == ept2) && (s1.eeEnd == s2.eeEnd)) {
+        throw std::runtime_error("NetBuilder: end of " + ept1->name()
+                                 + " connected to itself");
+    }
+
+    // As in connectSegments, the end of s2 must be unconnected. It may
+    // still have its own terminator if it was made by createEdge, which
+    // is dropped once the end is connected.
+    NodeSlot rmovNode = ept2->getNode(s2.eeEnd);
+    if (rmovNode.nsNode && (rmovNode.nsNode->getNodeType() != eTerminator)) {
+        error("end of " + ept2->name() + " is occupied");
+        return;
+    }
+
+    NodeSlot cnctNode = ept1->getNode(s1.eeEnd);
+    if (cnctNode.nsNode && (cnctNode.nsNode == rmovNode.nsNode)) {
+        throw std::runtime_error("NetBuilder: end of " + ept1->name()
+                                 + " connected to itself");
+    }
+    if (!cnctNode.nsNode) {
+        cnctNode = NodeSlot(newNode(), eSlot1);
+        cnctNode.nsNode->makeTerminator(s1);
+        ept1->assignNodeSlot(cnctNode, s1.eeEnd);
+    }
+
+    switch (cnctNode.nsNode->getNodeType()) {
+    case eTerminator:
+        cnctNode.nsNode->makeContinuation(s2);
+        ept2->assignNodeSlot(NodeSlot(cnctNode.nsNode, eSlot2), s2.eeEnd);
+        break;
+
+    case eContinuation:
+        cnctNode.nsNode->makeJunction(s2, cnctNode.nsSlot);
+        ept2->assignNodeSlot(NodeSlot(cnctNode.nsNode, eSlot3), s2.eeEnd);
+        break;
+
+    default:
+        error("end of " + ept1->name() + " is a junction");
+        return;
+    }
+    if (rmovNode.nsNode) { sys().dropTerminator(*rmovNode.nsNode); }
+}
+
+eNodeType NetBuilder::endType(const EdgeEnd& ee)
+{
+    EdgePtr eptr = ee.eeEdge.lock();
+    if (!eptr) { return eEmpty; }
+    NodePtr nptr = eptr->getNode(ee.eeEnd).nsNode;
+    return nptr ? nptr->getNodeType() : eTerminator;
+}
+
+void NetBuilder::closeEnds()
+{
+    MemScope mem(eMemTopology);
+    for (EdgePtr& eptr: m_edges) {
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            eEnd ex = (eEnd)ix;
+            if (!eptr->getNode(ex).nsNode) {
+                NodePtr nptr = newNode();
+                nptr->makeTerminator(EdgeEnd(eptr, ex));
+                eptr->assignNodeSlot(NodeSlot(nptr, eSlot1), ex);
+            }
+        }
+    }
+    m_finished = true;
+}
+
+void NetBuilder::finish()
+{
+    RRSIM_TRACE_SCOPE("NetBuilder::finish");
+    closeEnds();
+
+    // Every edge end must be attached to a node slot that refers back
+    // to the same edge end.
+    for (EdgePtr& eptr: m_edges) {
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            NodeSlot ns = eptr->getNode((eEnd)ix);
+            EdgeEnd back = ns.nsNode->getEdgeEnd(ns.nsSlot);
+            if ((back.eeEdge.lock() != eptr) || (back.eeEnd != ix)) {
+                error("inconsistent node " + ns.nsNode->name()
+                      + " at " + eptr->name());
+            }
+        }
+    }
+    if (m_errors) {
+        throw std::runtime_error("NetBuilder: " + std::to_string(m_errors)
+                                 + " error(s), first: " + m_firstError);
+    }
+}
+
+void NetBuilder::error(const std::string& msg)
+{
+    if (m_errors++ == 0) { m_firstError = msg; }
+}
+
+} // namespace rrsim
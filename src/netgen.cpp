@@ -0,0 +1,241 @@
+// netgen.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the NetGenerator class.
+
+#include "netgen.h"
+#include "edge.h"
+#include "node.h"
+#include "system.h"
+#include <algorithm>
+
+namespace rrsim {
+
+// Remove element ix from v by swapping in the last element.
+static void takeAt(std::vector<EdgeEnd>& v, size_t ix)
+{
+    v[ix] = v.back();
+    v.pop_back();
+}
+
+NetGenerator::NetGenerator(const GenOptions& opts)
+    : m_opts(opts), m_rng(opts.seed), m_builder((size_t)opts.segments)
+{
+}
+
+void NetGenerator::build()
+{
+    if      (m_opts.topology == "mainline") { buildMainline(); }
+    else if (m_opts.topology == "ladder")   { buildLadder(); }
+    else if (m_opts.topology == "grid")     { buildGrid(); }
+    else if (m_opts.topology == "tree")     { buildTree(); }
+    else {
+        throw std::runtime_error("Unknown topology: " + m_opts.topology);
+    }
+    m_builder.finish();
+    placeSignals();
+}
+
+EdgePtr NetGenerator::newSegment()
+{
+    EdgePtr eptr = m_builder.addEdge();
+    m_edges.push_back(eptr);
+    return eptr;
+}
+
+// Connect end e1 of segment s1 to end e2 of segment s2. The end of s2
+// must be unconnected; the end of s1 may be unconnected (continuation)
+// or a continuation (junction, with s1 as the common track). Errors
+// are reported when the build is finished.
+void NetGenerator::connect(EdgePtr s1, eEnd e1, EdgePtr s2, eEnd e2)
+{
+    m_builder.connect(EdgeEnd(s1, e1), EdgeEnd(s2, e2));
+}
+
+// Build a chain of count segments, connected B to A.
+std::vector<EdgePtr> NetGenerator::chain(long count)
+{
+    std::vector<EdgePtr> line;
+    line.reserve(count);
+    for (long ix = 0; ix < count; ix++) {
+        EdgePtr eptr = newSegment();
+        if (!line.empty()) {
+            connect(line.back(), eEndB, eptr, eEndA);
+        }
+        line.push_back(eptr);
+    }
+    return line;
+}
+
+// Join node ix of line "from" (between from[ix] and from[ix+1]) to
+// node ix of line "to" with a crossover segment. Trains traveling
+// toward end B on "from" may divert across and continue toward end B
+// on "to".
+void NetGenerator::crossover(std::vector<EdgePtr>& from,
+                             std::vector<EdgePtr>& to, long ix)
+{
+    EdgePtr xing = newSegment();
+    connect(from[ix], eEndB, xing, eEndA);
+    connect(to[ix + 1], eEndA, xing, eEndB);
+}
+
+void NetGenerator::buildMainline()
+{
+    chain(m_opts.segments);
+}
+
+void NetGenerator::buildLadder()
+{
+    long k = std::max(1, m_opts.spacing);
+    long len = std::max(2L, (m_opts.segments * k) / (2 * k + 1));
+    std::vector<EdgePtr> lineA = chain(len);
+    std::vector<EdgePtr> lineB = chain(len);
+    long count = 0;
+    for (long ix = k - 1; ix < len - 1; ix += k) {
+        // Alternate the direction of travel across the ladder.
+        if (count++ % 2 == 0) { crossover(lineA, lineB, ix); }
+        else                  { crossover(lineB, lineA, ix); }
+    }
+}
+
+void NetGenerator::buildGrid()
+{
+    long rows = std::max(2, m_opts.rows);
+    long len = std::max(2L, (2 * m_opts.segments) / (3 * rows - 1));
+    std::vector<std::vector<EdgePtr>> lines;
+    for (long rx = 0; rx < rows; rx++) {
+        lines.push_back(chain(len));
+    }
+    // Stagger the crossovers like a brick wall, so that each node on
+    // a line carries at most one crossover (i.e. at most a junction).
+    for (long rx = 0; rx + 1 < rows; rx++) {
+        for (long ix = rx % 2; ix < len - 1; ix += 2) {
+            if ((ix / 2) % 2 == 0) { crossover(lines[rx], lines[rx + 1], ix); }
+            else                   { crossover(lines[rx + 1], lines[rx], ix); }
+        }
+    }
+}
+
+// A yard fan is a ladder track with a stub siding diverging at each node.
+//
+void NetGenerator::buildFan(const EdgeEnd& lead, std::vector<EdgeEnd>& open)
+{
+    long tracks = 3 + (long)pick(6);
+    long depth = 1 + (long)pick(4);
+    EdgePtr prev = lead.eeEdge.lock();
+    eEnd prevEnd = lead.eeEnd;
+    for (long tx = 0; tx < tracks; tx++) {
+        EdgePtr ladder = newSegment();
+        connect(prev, prevEnd, ladder, eEndA);
+        if (tx > 0) {
+            // The node between prev and ladder is now a continuation, and
+            // becomes a junction with prev as the common track.
+            EdgePtr siding = newSegment();
+            connect(prev, eEndB, siding, eEndA);
+            for (long dx = 1; dx < depth; dx++) {
+                EdgePtr next = newSegment();
+                connect(siding, eEndB, next, eEndA);
+                siding = next;
+            }
+        }
+        prev = ladder;
+        prevEnd = eEndB;
+    }
+    open.push_back(EdgeEnd(prev, eEndB));
+}
+
+void NetGenerator::buildTree()
+{
+    std::vector<EdgeEnd> open;  // Unconnected segment ends.
+    std::vector<EdgeEnd> cont;  // Segment ends at a continuation node.
+
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    EdgePtr root = newSegment();
+    open.push_back(EdgeEnd(root, eEndA));
+    open.push_back(EdgeEnd(root, eEndB));
+
+    while ((long)m_edges.size() < m_opts.segments) {
+        double roll = coin(m_rng);
+
+        if (roll < 0.02) {
+            // Yard fan off an open end.
+            size_t ix = pick(open.size());
+            EdgeEnd lead = open[ix];
+            takeAt(open, ix);
+            buildFan(lead, open);
+        }
+        else if (roll < 0.05 && open.size() > 2) {
+            // Close a loop by joining two open ends of different segments.
+            size_t ix1 = pick(open.size());
+            size_t ix2 = pick(open.size());
+            EdgePtr s1 = open[ix1].eeEdge.lock();
+            EdgePtr s2 = open[ix2].eeEdge.lock();
+            if (s1 == s2) continue;
+            EdgeEnd e1 = open[ix1];
+            EdgeEnd e2 = open[ix2];
+            takeAt(open, std::max(ix1, ix2));
+            takeAt(open, std::min(ix1, ix2));
+            connect(s1, e1.eeEnd, s2, e2.eeEnd);
+            cont.push_back(e1);
+        }
+        else if (roll < 0.25 && !cont.empty()) {
+            // Branch off a continuation, turning it into a junction.
+            size_t ix = pick(cont.size());
+            EdgeEnd at = cont[ix];
+            takeAt(cont, ix);
+            if (m_builder.endType(at) != eContinuation) continue;
+            EdgePtr eptr = newSegment();
+            connect(at.eeEdge.lock(), at.eeEnd, eptr, eEndA);
+            open.push_back(EdgeEnd(eptr, eEndB));
+        }
+        else {
+            // Extend an open end by one segment. There is always at least
+            // one open end, since no step closes the last of them.
+            size_t ix = pick(open.size());
+            EdgeEnd at = open[ix];
+            EdgePtr eptr = newSegment();
+            connect(at.eeEdge.lock(), at.eeEnd, eptr, eEndA);
+            cont.push_back(at);
+            open[ix] = EdgeEnd(eptr, eEndB);
+        }
+    }
+}
+
+void NetGenerator::placeSignals()
+{
+    if (m_opts.signals == "junctions") {
+        // Every segment end that enters a junction, as in the
+        // "Add Signals To All Junctions" command.
+        for (NodePtr node: sys().getAllJunctions()) {
+            for (int ix = 0; ix < eNumSlots; ix++) {
+                EdgeEnd ee = node->getEdgeEnd((eSlot)ix);
+                EdgePtr eptr = ee.eeEdge.lock();
+                if (eptr && !eptr->getSignal(ee.eeEnd)) {
+                    eptr->placeSignalLight(ee.eeEnd);
+                }
+            }
+        }
+    }
+    else if (m_opts.signals == "all") {
+        // Every segment end that leads somewhere.
+        for (EdgePtr eptr: m_edges) {
+            for (int ix = 0; ix < eNumEnds; ix++) {
+                eEnd ex = (eEnd)ix;
+                if (eptr->getNode(ex).nsNode->getNodeType() != eTerminator) {
+                    eptr->placeSignalLight(ex);
+                }
+            }
+        }
+    }
+    else if (m_opts.signals != "none") {
+        throw std::runtime_error("Unknown signal placement: " + m_opts.signals);
+    }
+}
+
+size_t NetGenerator::pick(size_t count)
+{
+    return std::uniform_int_distribution<size_t>(0, count - 1)(m_rng);
+}
+
+} // namespace rrsim
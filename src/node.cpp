@@ -6,13 +6,16 @@
 
 #include "node.h"
 #include "edge.h"
+#include "nodekind.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 
 namespace rrsim {
 
-Node::Node(const std::string& name) : m_name(name), m_switchState(eSwitchNone)
+Node::Node(NameID name, int id)
+    : m_name(name), m_id(id), m_switchState(eSwitchNone),
+      m_type(eEmpty), m_typePos(-1)
 {
     // Initialize edge ends as invalid.
     for (int ix = 0; ix < eNumSlots; ix++) {
@@ -24,7 +27,7 @@ Node::~Node()
 {
 }
 
-eNodeType Node::getNodeType()
+eNodeType Node::probeType()
 {
     if (m_slots[eSlot3].eeEdge.lock()) { return eJunction; }
     if (m_slots[eSlot2].eeEdge.lock()) { return eContinuation; }
@@ -39,6 +42,7 @@ void Node::makeTerminator(const EdgeEnd& track)
                 "Attempt to makeTerminator, but node is not empty");
     }
     m_slots[eSlot1] = track;
+    sys().reindexNode(*this);
 }
 
 void Node::makeContinuation(const EdgeEnd& track)
@@ -48,6 +52,7 @@ void Node::makeContinuation(const EdgeEnd& track)
                 "Attempt to makeContinuation, but node is not a terminator");
     }
     m_slots[eSlot2] = track;
+    sys().reindexNode(*this);
 }
 
 void Node::makeJunction(const EdgeEnd& track, eSlot slot)
@@ -91,52 +96,30 @@ void Node::setEdgeEnd(const EdgeEnd& track, eSlot slot)
         throw std::runtime_error("Invalid slot for setEdgeEnd");
     }
     m_slots[slot] = track;
+    sys().reindexNode(*this);
 }
 
 EdgeEnd Node::getNext(eSlot slot)
 {
-    // Initialize the return value to be empty.
-    EdgeEnd rval = { nullptr, eNumEnds };
-
-    switch (getNodeType()) {
-    default:
-    case eEmpty:
+    eNodeType type = getNodeType();
+    if (type == eEmpty) {
         throw std::runtime_error("Unexpected result in Node::getNext");
-
-    case eTerminator:
-        // Nowhere to go from here (rval stays empty).
-        break;
-
-    case eContinuation:
-        // Continue to the opposite edge.
-        if      (slot == eSlot1) { rval = m_slots[eSlot2]; }
-        else if (slot == eSlot2) { rval = m_slots[eSlot1]; }
-        // Otherwise return empty. TODO throw an exception?
-        break;
-
-    case eJunction:
-        // The switch state determines the next edge.
-        if (m_switchState == eSwitchLeft) {
-            if      (slot == eSlot1) { rval = m_slots[eSlot2]; }
-            else if (slot == eSlot2) { rval = m_slots[eSlot1]; }
-            // Otherwise blocked on the right fork (return empty).
-        }
-        else if (m_switchState == eSwitchRight) {
-            if      (slot == eSlot1) { rval = m_slots[eSlot3]; }
-            else if (slot == eSlot3) { rval = m_slots[eSlot1]; }
-            // Otherwise blocked on the left fork (return empty).
-        }
-        // Otherwise not switched, so nobody is going anywhere.
-        break;
     }
-    return rval;
+    // A terminator, a slot that is not in use, or a junction fork that
+    // is not switched leads nowhere (return empty).
+    eSlot exit = visitNodeKind(type, [&](auto kind) {
+        return (slot < kind.kSlots) ? kind.kExit[m_switchState][slot]
+                                    : eNumSlots;
+    });
+    if (exit == eNumSlots) { return EdgeEnd(); }
+    return m_slots[exit];
 }
 
 void Node::show()
 {
     std::stringstream nstr;
     EdgePtr eptr;
-    nstr << std::setw(12) << std::right << m_name << ':';
+    nstr << std::setw(12) << std::right << name() << ':';
 
     for (int ix = 0; ix < eNumSlots; ix++) {
         eptr = m_slots[ix].eeEdge.lock();
@@ -0,0 +1,85 @@
+// reachability.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the ReachIndex class.
+
+#include "reachability.h"
+#include "system.h"
+#include "node.h"
+#include "nodekind.h"
+#include "transition.h"
+#include <utility>
+
+namespace rrsim {
+
+void ReachIndex::clear()
+{
+    m_parent.clear();
+    m_rank.clear();
+    m_pending.clear();
+}
+
+bool ReachIndex::mayReach(int fromEdge, int toEdge)
+{
+    linkPending();
+    int32_t fromA = find(fromEdge * 2 + eEndA);
+    int32_t fromB = find(fromEdge * 2 + eEndB);
+    int32_t toA = find(toEdge * 2 + eEndA);
+    int32_t toB = find(toEdge * 2 + eEndB);
+    return (fromA == toA) || (fromA == toB) || (fromB == toA) || (fromB == toB);
+}
+
+void ReachIndex::linkPending()
+{
+    const NodeVec& nodes = sys().nodes();
+    for (int id: m_pending) {
+        Node* node = nodes[id].get();
+        if (!node || (node->getNodeType() == eEmpty)) continue;
+        visitNodeKind(node->getNodeType(), [&](auto kind) {
+            for (int sx = 0; sx < kind.kSlots; sx++) {
+                int32_t facing = TransitionTable::facingState(
+                        node->getEdgeEnd((eSlot)sx));
+                for (int jsw = 0; jsw < kNumSwitch; jsw++) {
+                    eSlot exit = kind.kExit[jsw][sx];
+                    if (exit == eNumSlots) continue;
+                    join(facing, TransitionTable::enterState(
+                            node->getEdgeEnd(exit)));
+                }
+            }
+        });
+    }
+    m_pending.clear();
+}
+
+int32_t ReachIndex::find(int32_t state)
+{
+    // States not seen yet are their own component.
+    if ((size_t)state >= m_parent.size()) {
+        size_t old = m_parent.size();
+        m_parent.resize(state + 1);
+        m_rank.resize(state + 1, 0);
+        for (size_t sx = old; sx < m_parent.size(); sx++) {
+            m_parent[sx] = (int32_t)sx;
+        }
+    }
+    // Path halving.
+    while (m_parent[state] != state) {
+        m_parent[state] = m_parent[m_parent[state]];
+        state = m_parent[state];
+    }
+    return state;
+}
+
+void ReachIndex::join(int32_t s1, int32_t s2)
+{
+    if ((s1 < 0) || (s2 < 0)) { return; }
+    s1 = find(s1);
+    s2 = find(s2);
+    if (s1 == s2) { return; }
+    if (m_rank[s1] < m_rank[s2]) { std::swap(s1, s2); }
+    m_parent[s2] = s1;
+    if (m_rank[s1] == m_rank[s2]) { m_rank[s1]++; }
+}
+
+} // namespace rrsim
@@ -0,0 +1,168 @@
+// routematrix.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the RouteMatrix class.
+
+#include "routematrix.h"
+#include "routesearch.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "memstat.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace rrsim {
+
+RouteMatrix::RouteMatrix() : m_version(-1)
+{
+}
+
+EdgeVec RouteMatrix::terminatorEdges()
+{
+    EdgeVec rval;
+    for (const EdgePtr& eptr: sys().sortedEdges()) {
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            NodeSlot ns = eptr->getNode((eEnd)ix);
+            if (ns.nsNode && (ns.nsNode->getNodeType() == eTerminator)) {
+                rval.push_back(eptr);
+                break;
+            }
+        }
+    }
+    return rval;
+}
+
+void RouteMatrix::clear()
+{
+    m_version = -1;
+    m_edges.clear();
+    m_indexOf.clear();
+    m_cost.clear();
+    m_startEnd.clear();
+    m_stepPos.clear();
+    m_stepLen.clear();
+    m_steps.clear();
+}
+
+void RouteMatrix::compute(const EdgeVec& ends, unsigned threads)
+{
+    RRSIM_TRACE_SCOPE("computeRouteMatrix");
+    MemScope mem(eMemRouting);
+    clear();
+    size_t count = ends.size();
+    m_indexOf.assign(sys().edges().size(), -1);
+    for (const EdgePtr& eptr: ends) {
+        m_indexOf[eptr->id()] = (int32_t)m_edges.size();
+        m_edges.push_back(eptr->id());
+    }
+    m_cost.assign(count * count, -1);
+    m_startEnd.assign(count * count, eNumEnds);
+    m_stepPos.assign(count * count, 0);
+    m_stepLen.assign(count * count, 0);
+    m_steps.resize(count);
+
+    // Bring the table up to date before the workers share it.
+    const TransitionTable& table = sys().transitions();
+
+    std::atomic<size_t> nextOrigin(0);
+    auto worker = [&]() {
+        RRSIM_TRACE_THREAD("route matrix");
+        MemScope threadMem(eMemRouting);
+        RouteSearch search(table);
+        std::vector<eJSwitch> steps;
+        for (size_t from; (from = nextOrigin++) < count; ) {
+            search.search(m_edges[from], -1);
+            std::vector<uint8_t>& fromSteps = m_steps[from];
+            for (size_t to = 0; to < count; to++) {
+                if (!search.reached(m_edges[to])) continue;
+                size_t px = from * count + to;
+                m_cost[px] = search.cost(m_edges[to]);
+                m_startEnd[px] = (uint8_t)search.route(m_edges[to], steps);
+                m_stepPos[px] = (uint32_t)fromSteps.size();
+                m_stepLen[px] = (uint32_t)steps.size();
+                fromSteps.insert(fromSteps.end(), steps.begin(), steps.end());
+            }
+        }
+    };
+
+    if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(count, 1));
+    std::vector<std::thread> pool;
+    for (unsigned tx = 1; tx < threads; tx++) { pool.emplace_back(worker); }
+    worker();
+    for (std::thread& thr: pool) { thr.join(); }
+
+    m_version = sys().topologyVersion();
+}
+
+void RouteMatrix::writeCSV(std::ostream& ostr) const
+{
+    const EdgeVec& edges = sys().edges();
+    size_t count = size();
+    ostr << "from,to,cost,toward,switches\n";
+    for (size_t from = 0; from < count; from++) {
+        for (size_t to = 0; to < count; to++) {
+            if (from == to) continue;
+            size_t px = from * count + to;
+            ostr << edges[m_edges[from]]->name() << ','
+                 << edges[m_edges[to]]->name() << ',' << m_cost[px] << ',';
+            if (m_cost[px] >= 0) {
+                ostr << ((m_startEnd[px] == eEndA) ? 'A' : 'B') << ',';
+                const uint8_t* step = &m_steps[from][m_stepPos[px]];
+                for (uint32_t sx = 0; sx < m_stepLen[px]; sx++) {
+                    ostr << ((step[sx] == eSwitchLeft) ? 'L' : 'R');
+                }
+            }
+            else { ostr << ','; }
+            ostr << '\n';
+        }
+    }
+}
+
+bool RouteMatrix::lookup(int fromEdge, int toEdge, eEnd& startEnd,
+                         std::vector<eJSwitch>& steps,
+                         std::vector<int32_t>& path) const
+{
+    if ((m_version != sys().topologyVersion()) ||
+        ((size_t)fromEdge >= m_indexOf.size()) ||
+        ((size_t)toEdge >= m_indexOf.size()) ||
+        (m_indexOf[fromEdge] < 0) || (m_indexOf[toEdge] < 0)) {
+        return false;
+    }
+    size_t px = m_indexOf[fromEdge] * size() + m_indexOf[toEdge];
+    if (m_cost[px] < 0) { return false; }
+
+    startEnd = (eEnd)m_startEnd[px];
+    const uint8_t* step = &m_steps[m_indexOf[fromEdge]][m_stepPos[px]];
+    steps.clear();
+    for (uint32_t sx = 0; sx < m_stepLen[px]; sx++) {
+        steps.push_back((eJSwitch)step[sx]);
+    }
+
+    // Follow the switch positions from the start to recover the states
+    // of the route.
+    const TransitionTable& table = sys().transitions();
+    path.clear();
+    int32_t state = fromEdge * 2 + startEnd;
+    size_t sx = 0;
+    for (int hop = 0; hop < m_cost[px]; hop++) {
+        path.push_back(state);
+        int kx = 0;
+        if ((table.facingType(state) == eJunction) &&
+            (table.facingSlot(state) == eSlot1)) {
+            if (sx >= steps.size()) { return false; }
+            kx = (steps[sx++] == eSwitchLeft) ? 0 : 1;
+        }
+        int32_t next = table.branch(state, kx);
+        if (next < 0) { return false; }
+        if ((next >> 1) == toEdge) { return true; }
+        state = next;
+    }
+    return false;
+}
+
+} // namespace rrsim
@@ -0,0 +1,190 @@
+// routerepair.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the RouteRepair class.
+
+#include "routerepair.h"
+#include "memstat.h"
+#include <algorithm>
+#include <functional>
+
+namespace rrsim {
+
+RouteRepair::RouteRepair() : m_table(nullptr), m_version(-1), m_logPos(0)
+{
+}
+
+void RouteRepair::clear()
+{
+    m_table = nullptr;
+    m_version = -1;
+    m_logPos = 0;
+    m_branch.clear();
+    m_planners.clear();
+}
+
+bool RouteRepair::sync(const TransitionTable& table)
+{
+    m_table = &table;
+    if (table.current(m_version)) { return false; }
+    MemScope mem(eMemRouting);
+
+    bool first = (m_version < 0);
+    size_t states = table.states();
+    size_t known = m_branch.size() / 2;
+    if (states < known) {
+        // Only a reset shrinks the table, start over.
+        m_planners.clear();
+        first = true;
+        known = 0;
+    }
+
+    std::vector<int32_t> changed;
+    auto compare = [&](size_t sx) {
+        int32_t b0 = table.branch((int32_t)sx, 0);
+        int32_t b1 = table.branch((int32_t)sx, 1);
+        if ((sx >= known) || (m_branch[sx * 2] != b0) || (m_branch[sx * 2 + 1] != b1)) {
+            m_branch[sx * 2] = b0;
+            m_branch[sx * 2 + 1] = b1;
+            changed.push_back((int32_t)sx);
+        }
+    };
+    m_branch.resize(states * 2, TransitionTable::kTerminal);
+    if (first || (m_logPos < table.logStart())) {
+        for (size_t sx = 0; sx < states; sx++) { compare(sx); }
+    }
+    else {
+        // New states are all in the log, as they joined their nodes.
+        known = states;
+        for (size_t pos = m_logPos; pos < table.logEnd(); pos++) {
+            compare((size_t)table.logAt(pos));
+        }
+    }
+    m_logPos = table.logEnd();
+    m_version = table.version();
+    if (first) {
+        m_planners.clear();
+        return false;
+    }
+    if (changed.empty()) { return false; }
+
+    // Only the states whose own branches changed can see a different
+    // distance at once, the rest follow as the planners settle.
+    for (auto& entry: m_planners) {
+        Planner& plan = entry.second;
+        plan.g.resize(states, kUnreachable);
+        plan.rhs.resize(states, kUnreachable);
+        for (int32_t state: changed) { update(plan, entry.first, state); }
+        settle(plan, entry.first);
+    }
+    return true;
+}
+
+RouteRepair::Planner& RouteRepair::plannerFor(int target)
+{
+    auto found = m_planners.find(target);
+    if (found != m_planners.end()) { return found->second; }
+
+    MemScope mem(eMemRouting);
+    Planner& plan = m_planners[target];
+    size_t states = m_branch.size() / 2;
+    plan.g.assign(states, kUnreachable);
+    plan.rhs.assign(states, kUnreachable);
+    for (int ix = 0; ix < eNumEnds; ix++) {
+        int32_t state = target * 2 + ix;
+        if ((size_t)state < states) { update(plan, target, state); }
+    }
+    settle(plan, target);
+    return plan;
+}
+
+void RouteRepair::update(Planner& plan, int target, int32_t state)
+{
+    if ((state >> 1) == target) {
+        // A train has arrived once it is on the target segment.
+        plan.rhs[state] = 0;
+    }
+    else {
+        int32_t best = kUnreachable;
+        for (int kx = 0; kx < 2; kx++) {
+            int32_t next = m_branch[state * 2 + kx];
+            if ((next >= 0) && (plan.g[next] + 1 < best)) { best = plan.g[next] + 1; }
+        }
+        plan.rhs[state] = best;
+    }
+    if (plan.g[state] != plan.rhs[state]) {
+        plan.heap.emplace_back(std::min(plan.g[state], plan.rhs[state]), state);
+        std::push_heap(plan.heap.begin(), plan.heap.end(), std::greater<>());
+    }
+}
+
+void RouteRepair::settle(Planner& plan, int target)
+{
+    while (!plan.heap.empty()) {
+        std::pop_heap(plan.heap.begin(), plan.heap.end(), std::greater<>());
+        int32_t key = plan.heap.back().first;
+        int32_t state = plan.heap.back().second;
+        plan.heap.pop_back();
+
+        // Entries are not removed when a state changes, skip the old.
+        if ((plan.g[state] == plan.rhs[state]) ||
+            (key != std::min(plan.g[state], plan.rhs[state]))) {
+            continue;
+        }
+        if (plan.g[state] > plan.rhs[state]) {
+            plan.g[state] = plan.rhs[state];
+        }
+        else {
+            plan.g[state] = kUnreachable;
+            update(plan, target, state);
+        }
+        for (int kx = 0; kx < 2; kx++) {
+            int32_t prev = m_branch[(state ^ 1) * 2 + kx];
+            if (prev >= 0) { update(plan, target, prev ^ 1); }
+        }
+    }
+}
+
+int32_t RouteRepair::distance(int target, int32_t state)
+{
+    if ((size_t)state >= m_branch.size() / 2) { return kUnreachable; }
+    return plannerFor(target).g[state];
+}
+
+bool RouteRepair::route(int target, int32_t state, std::vector<eJSwitch>& steps)
+{
+    steps.clear();
+    if ((size_t)state >= m_branch.size() / 2) { return false; }
+    const Planner& plan = plannerFor(target);
+    if (plan.g[state] >= kUnreachable) { return false; }
+
+    // Walk down the distances, taking the left fork on a tie as the
+    // route search does.
+    while ((state >> 1) != target) {
+        int kx = 0;
+        while ((kx < 2) && ((m_branch[state * 2 + kx] < 0) ||
+                            (plan.g[m_branch[state * 2 + kx]] != plan.g[state] - 1))) {
+            kx++;
+        }
+        if (kx == 2) { return false; }
+        if ((m_table->facingType(state) == eJunction) &&
+            (m_table->facingSlot(state) == eSlot1)) {
+            steps.push_back((kx == 0) ? eSwitchLeft : eSwitchRight);
+        }
+        state = m_branch[state * 2 + kx];
+    }
+    return true;
+}
+
+void RouteRepair::retain(const std::vector<int>& targets)
+{
+    for (auto it = m_planners.begin(); it != m_planners.end(); ) {
+        if (std::find(targets.begin(), targets.end(), it->first) == targets.end()) {
+            it = m_planners.erase(it);
+        }
+        else { ++it; }
+    }
+}
+
+} // namespace rrsim
@@ -0,0 +1,190 @@
+// routesearch.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the RouteSearch class.
+
+#include "routesearch.h"
+#include <algorithm>
+
+namespace rrsim {
+
+RouteSearch::RouteSearch(const TransitionTable& table) : m_table(table)
+{
+}
+
+void RouteSearch::reset()
+{
+    // Only undo what the last search touched.
+    for (int32_t state: m_queue) { m_parent[state] = -2; }
+    for (int32_t state: m_closed) { m_parent[state] = -2; }
+    for (int edge: m_hitEdges) { m_hitFrom[edge] = -1; }
+    m_queue.clear();
+    m_hitEdges.clear();
+    m_closed.clear();
+
+    size_t states = m_table.states();
+    if (m_parent.size() < states) {
+        m_parent.resize(states, -2);
+        m_via.resize(states, 0);
+        m_depth.resize(states, 0);
+        m_hitFrom.resize(states / 2, -1);
+        m_hitVia.resize(states / 2, 0);
+    }
+}
+
+void RouteSearch::visit(int32_t state, int32_t parent, uint8_t via)
+{
+    m_parent[state] = parent;
+    m_via[state] = via;
+    m_depth[state] = (parent < 0) ? 0 : m_depth[parent] + 1;
+    m_queue.push_back(state);
+}
+
+bool RouteSearch::search(int start, int target)
+{
+    reset();
+    visit(start * 2 + eEndA, -1, 0);
+    visit(start * 2 + eEndB, -1, 0);
+    static const std::vector<int32_t> none;
+    return expand(target, -1, none);
+}
+
+bool RouteSearch::expand(int target, int32_t spur,
+                         const std::vector<int32_t>& banned)
+{
+    // The queue doubles as the list of visited states.
+    for (size_t qx = 0; qx < m_queue.size(); qx++) {
+        int32_t front = m_queue[qx];
+        for (int kx = 0; kx < 2; kx++) {
+            int32_t next = m_table.branch(front, kx);
+            if (next < 0) continue;
+            if ((front == spur) &&
+                (std::find(banned.begin(), banned.end(), next) != banned.end())) {
+                continue;
+            }
+            int edge = next >> 1;
+            if (m_hitFrom[edge] < 0) {
+                m_hitFrom[edge] = front;
+                m_hitVia[edge] = (uint8_t)kx;
+                m_hitEdges.push_back(edge);
+            }
+            if (edge == target) { return true; }
+            if (m_parent[next] == -2) { visit(next, front, (uint8_t)kx); }
+        }
+    }
+    return target < 0;
+}
+
+void RouteSearch::makeRoute(int target, const int32_t* root, size_t rootLen,
+                            Route& route) const
+{
+    std::vector<int32_t> path;
+    route.states.assign(root, root + rootLen);
+    RouteSearch::route(target, route.steps, &path);
+    route.states.insert(route.states.end(), path.begin(), path.end());
+    route.states.push_back(m_table.branch(m_hitFrom[target], m_hitVia[target]));
+
+    // The steps again, now over the whole route.
+    route.steps.clear();
+    for (size_t sx = 0; sx + 1 < route.states.size(); sx++) {
+        int32_t state = route.states[sx];
+        if ((m_table.facingType(state) == eJunction) &&
+            (m_table.facingSlot(state) == eSlot1)) {
+            route.steps.push_back((route.states[sx + 1] == m_table.branch(state, 0))
+                                  ? eSwitchLeft : eSwitchRight);
+        }
+    }
+}
+
+int RouteSearch::alternatives(int start, int target, int count,
+                              std::vector<Route>& routes)
+{
+    routes.clear();
+    if ((count < 1) || !search(start, target)) { return 0; }
+    routes.emplace_back();
+    makeRoute(target, nullptr, 0, routes.back());
+
+    std::vector<Route> candidates;
+    std::vector<int32_t> banned;
+    while ((int)routes.size() < count) {
+        // Leave the last route found at each of its states in turn, or
+        // at the start (spur -1) for the other direction of travel.
+        const std::vector<int32_t> last = routes.back().states;
+        for (int spur = -1; spur < (int)last.size() - 1; spur++) {
+            banned.clear();
+            for (const Route& route: routes) {
+                if ((route.states.size() > (size_t)(spur + 1)) &&
+                    std::equal(last.begin(), last.begin() + spur + 1,
+                               route.states.begin())) {
+                    banned.push_back(route.states[spur + 1]);
+                }
+            }
+            reset();
+            for (int sx = 0; sx < spur; sx++) {
+                m_parent[last[sx]] = -3;
+                m_closed.push_back(last[sx]);
+            }
+            if (spur < 0) {
+                for (int32_t state: { start * 2 + eEndA, start * 2 + eEndB }) {
+                    if (std::find(banned.begin(), banned.end(), state) == banned.end()) {
+                        visit(state, -1, 0);
+                    }
+                }
+            }
+            else { visit(last[spur], -1, 0); }
+            if (!expand(target, (spur < 0) ? -1 : last[spur], banned)) continue;
+
+            Route cand;
+            makeRoute(target, last.data(), (spur < 0) ? 0 : spur, cand);
+            auto same = [&](const Route& route) { return route.states == cand.states; };
+            if (std::none_of(routes.begin(), routes.end(), same) &&
+                std::none_of(candidates.begin(), candidates.end(), same)) {
+                candidates.push_back(std::move(cand));
+            }
+        }
+        if (candidates.empty()) { break; }
+
+        // The shortest candidate, the first found among equals.
+        auto best = std::min_element(candidates.begin(), candidates.end(),
+                [](const Route& a, const Route& b) { return a.cost() < b.cost(); });
+        routes.push_back(std::move(*best));
+        candidates.erase(best);
+    }
+    return (int)routes.size();
+}
+
+int RouteSearch::cost(int edge) const
+{
+    return reached(edge) ? m_depth[m_hitFrom[edge]] + 1 : -1;
+}
+
+eEnd RouteSearch::route(int edge, std::vector<eJSwitch>& steps,
+                        std::vector<int32_t>* path) const
+{
+    steps.clear();
+    if (path) { path->clear(); }
+    if (!reached(edge)) { return eNumEnds; }
+
+    // Walk back from the last state before the target. The branch
+    // taken out of a state facing the common track of a junction is
+    // the switch position wanted there.
+    int32_t state = m_hitFrom[edge];
+    uint8_t via = m_hitVia[edge];
+    int32_t first = state;
+    while (state >= 0) {
+        if ((m_table.facingType(state) == eJunction) &&
+            (m_table.facingSlot(state) == eSlot1)) {
+            steps.push_back((via == 0) ? eSwitchLeft : eSwitchRight);
+        }
+        if (path) { path->push_back(state); }
+        via = m_via[state];
+        first = state;
+        state = m_parent[state];
+    }
+    std::reverse(steps.begin(), steps.end());
+    if (path) { std::reverse(path->begin(), path->end()); }
+    return (eEnd)(first & 1);
+}
+
+} // namespace rrsim
@@ -8,14 +8,24 @@
 #include "edge.h"
 #include "node.h"
 #include "train.h"
-#include <set>
+#include "system.h"
+#include "stats.h"
 
 namespace rrsim {
 
-RRsignal::RRsignal(EdgePtr trackSeg, eEnd trackEnd) : m_isRed(true)
+RRsignal::RRsignal(EdgePtr trackSeg, eEnd trackEnd)
+    : m_isRed(true), m_state(trackSeg ? trackSeg->id() * 2 + trackEnd : -1)
 {
-    m_edge.eeEdge = trackSeg;
-    m_edge.eeEnd = trackEnd;
+}
+
+void* RRsignal::operator new(size_t size)
+{
+    return sys().signalArena().allocate(size, alignof(RRsignal));
+}
+
+void RRsignal::operator delete(void* ptr, size_t size)
+{
+    sys().signalArena().deallocate(ptr, size);
 }
 
 RRsignal::~RRsignal()
@@ -24,48 +34,48 @@ RRsignal::~RRsignal()
 
 void RRsignal::updateSignal()
 {
-    m_isRed = true; // Assume the signal is red.
-    EdgePtr eptr = m_edge.eeEdge.lock();
-
-    // Nothing to do if we aren't placed anywhere.
-    if (!eptr) { return; }
+    bool wasRed = m_isRed;
+    m_isRed = checkForRed();
+    if (m_isRed != wasRed) {
+        SimStats::count(eStatSignalFlips);
+        sys().views().signalChanged(m_state, m_isRed);
+    }
+}
 
-    NodeSlot node = eptr->getNode(m_edge.eeEnd);
-    EdgeEnd edge = node.nsNode->getNext(node.nsSlot);
-    eptr = edge.eeEdge.lock();
+bool RRsignal::checkForRed()
+{
+    // Red if we aren't placed anywhere.
+    if (m_state < 0) { return true; }
 
-    // There is no next track segment, nothing more to do.
-    if (!eptr) { return; }
+    const TransitionTable& table = sys().transitions();
+    TrainFleet& fleet = sys().fleet();
+    int32_t state = table.next(m_state);
 
-    // The next segment has a train, nothing more to do.
-    if (eptr->getTrain()) { return; }
-    node = eptr->getNode((edge.eeEnd == eEndA) ? eEndB : eEndA);
+    // There is no next track segment.
+    if (state < 0) { return true; }
 
-    // Avoid infinite loops.
-    std::set<std::string> visitedEdges;
-    visitedEdges.insert(eptr->name());
+    // The next segment has a train.
+    if (fleet.occupant(state >> 1) >= 0) { return true; }
 
     // Now assume we have a green light, unless we find an oncoming train.
-    m_isRed = false;
-
-    while (node.nsNode->getNodeType() != eJunction) {
-        edge = node.nsNode->getNext(node.nsSlot);
-        eptr = edge.eeEdge.lock();
-        if (!eptr) { return; }
-        if (visitedEdges.find(eptr->name()) != visitedEdges.end()) {
-            // The track formed a loop before a junction was seen.
-            return;
-        }
-        visitedEdges.insert(eptr->name());
+    // The walk only crosses continuations, so if the track loops before
+    // a junction is seen it comes back to the first segment. Every
+    // segment of a long train is marked with it, and an oncoming train
+    // has its head nearest to us, so the head is the first of its
+    // segments the walk meets.
+    int first = state >> 1;
+    while (table.facingType(state) != eJunction) {
+        state = table.next(state);
+        if (state < 0) { return false; }
+        if ((state >> 1) == first) { return false; }
 
-        TrainPtr train = eptr->getTrain();
-        if (train && (train->getPosition().eeEnd == edge.eeEnd)) {
+        int train = fleet.occupant(state >> 1);
+        if ((train >= 0) && (fleet.stateOf(train) == (state ^ 1))) {
             // The train is headed toward us.
-            m_isRed = true;
-            return;
+            return true;
         }
-        node = eptr->getNode((edge.eeEnd == eEndA) ? eEndB : eEndA);
     }
+    return false;
 }
 
 } // namespace rrsim
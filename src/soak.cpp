@@ -0,0 +1,118 @@
+// soak.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the SoakMode class.
+
+#include "soak.h"
+#include "system.h"
+#include "edge.h"
+#include "train.h"
+#include "stats.h"
+
+namespace rrsim {
+
+// Tries at finding a free start segment for one spawn.
+static const int kSpawnTries = 8;
+
+SoakMode::SoakMode() : m_rate(0.0), m_credit(0.0)
+{
+}
+
+void SoakMode::start(const std::vector<int>& ends, double rate, unsigned seed)
+{
+    m_ends = ends;
+    m_rate = (ends.size() > 1) ? rate : 0.0;
+    m_credit = 0.0;
+    m_rng.seed(seed);
+}
+
+void SoakMode::stop()
+{
+    m_rate = 0.0;
+}
+
+void SoakMode::clear()
+{
+    stop();
+    m_ends.clear();
+    m_live.clear();
+    m_livePos.clear();
+    m_born.clear();
+}
+
+bool SoakMode::tick(long step)
+{
+    TrainFleet& fleet = sys().fleet();
+    bool changed = false;
+
+    // Retire the trains that have arrived.
+    for (size_t ix = 0; ix < m_live.size(); ) {
+        int id = m_live[ix];
+        if (fleet.onTrack(id) && (fleet.edgeOf(id) != fleet.destOf(id))) {
+            ix++;
+            continue;
+        }
+        if (fleet.onTrack(id)) {
+            SimStats::count(eStatTrainsArrived);
+            SimStats::count(eStatTripSteps, step - m_born[id]);
+        }
+        // This takes the train out of m_live, the last in its place.
+        sys().removeTrain(sys().trains()[id]->name());
+        changed = true;
+    }
+
+    if (active()) {
+        m_credit += m_rate;
+        for ( ; m_credit >= 1.0; m_credit -= 1.0) {
+            size_t before = m_live.size();
+            spawn(step);
+            if (m_live.size() != before) { changed = true; }
+        }
+    }
+    return changed;
+}
+
+void SoakMode::trainRemoved(int train)
+{
+    if (((size_t)train >= m_livePos.size()) || (m_livePos[train] < 0)) { return; }
+    int pos = m_livePos[train];
+    int last = m_live.back();
+    m_live[pos] = last;
+    m_livePos[last] = pos;
+    m_live.pop_back();
+    m_livePos[train] = -1;
+}
+
+void SoakMode::spawn(long step)
+{
+    const EdgeVec& edges = sys().edges();
+    TrainFleet& fleet = sys().fleet();
+    for (int tries = 0; tries < kSpawnTries; tries++) {
+        int from = m_ends[m_rng() % m_ends.size()];
+        if (fleet.occupant(from) >= 0) continue;
+        int to = m_ends[m_rng() % m_ends.size()];
+        if ((to == from) || !edges[from] || !edges[to]) continue;
+
+        TrainPtr tptr = sys().createTrain();
+        try {
+            tptr->placeOnTrack(edges[from], edges[to]);
+        }
+        catch (std::exception&) {
+            // No route between the two, try another pair.
+            sys().removeTrain(tptr->name());
+            continue;
+        }
+        int id = tptr->id();
+        if ((size_t)id >= m_born.size()) { m_born.resize(id + 1, 0); }
+        m_born[id] = step;
+        if ((size_t)id >= m_livePos.size()) { m_livePos.resize(id + 1, -1); }
+        m_livePos[id] = (int)m_live.size();
+        m_live.push_back(id);
+        SimStats::count(eStatTrainsSpawned);
+        return;
+    }
+    SimStats::count(eStatSpawnsMissed);
+}
+
+} // namespace rrsim
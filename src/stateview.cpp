@@ -0,0 +1,137 @@
+// stateview.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the StateView and ViewPublisher classes.
+
+#include "stateview.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include "train.h"
+#include "rrsignal.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+namespace rrsim {
+
+ViewPublisher::ViewPublisher() :
+    m_active(false), m_current(nullptr), m_epoch(1)
+{
+}
+
+ViewPublisher::~ViewPublisher()
+{
+    // No reader outlives the System.
+    delete m_current.load();
+    for (auto& retired: m_retired) { delete retired.first; }
+}
+
+void ViewPublisher::start()
+{
+    m_next = StateView();
+    const TrainFleet& fleet = sys().fleet();
+    for (const EdgePtr& eptr: sys().edges()) {
+        if (!eptr) continue;
+        int id = eptr->id();
+        m_next.m_occupant.write(id) = fleet.occupant(id) + 1;
+        for (int ex = 0; ex < eNumEnds; ex++) {
+            RRsignal* signal = eptr->getSignal((eEnd)ex);
+            if (signal) {
+                m_next.m_aspect.write(id * 2 + ex) =
+                    signal->signalIsRed() ? StateView::eAspectRed : StateView::eAspectGreen;
+            }
+        }
+    }
+    for (const NodePtr& nptr: sys().nodes()) {
+        if (nptr && (nptr->getNodeType() == eJunction)) {
+            m_next.m_switch.write(nptr->id()) = (uint8_t)nptr->getSwitchPos();
+        }
+    }
+    m_active = true;
+    publish(sys().simStep());
+}
+
+void ViewPublisher::stop()
+{
+    m_active = false;
+    m_next = StateView();
+}
+
+void ViewPublisher::endOfStep(long step)
+{
+    if (m_active) { publish(step); }
+}
+
+// A new view sharing every page of the state, and the trains. The view
+// it replaces is retired at a new epoch.
+void ViewPublisher::publish(long step)
+{
+    StatTimer timer(eTimePublish);
+    StateView* view = new StateView(m_next);
+    view->m_step = step;
+    const TrainFleet& fleet = sys().fleet();
+    for (const TrainPtr& tptr: sys().trains()) {
+        if (!tptr) continue;
+        int id = tptr->id();
+        if ((size_t)id >= view->m_trains.size()) { view->m_trains.resize(id + 1); }
+        StateView::TrainPos& pos = view->m_trains[id];
+        pos.name = &tptr->name();
+        pos.state = fleet.stateOf(id);
+        pos.dest = fleet.destOf(id);
+    }
+
+    StateView* old = m_current.exchange(view);
+    if (old) { m_retired.emplace_back(old, m_epoch.fetch_add(1) + 1); }
+    reclaim();
+    SimStats::count(eStatViewsPublished);
+}
+
+// Free the retired views no reader can hold: a reader that took a view
+// read the epoch before the view was retired, so a view retired at R
+// is safe once every reader started at R or later.
+void ViewPublisher::reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+    for (const Slot& slot: m_slots) {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch != kFree) { oldest = std::min(oldest, epoch); }
+    }
+    auto keep = m_retired.begin();
+    for (auto& retired: m_retired) {
+        if (retired.second <= oldest) { delete retired.first; }
+        else { *keep++ = retired; }
+    }
+    m_retired.erase(keep, m_retired.end());
+}
+
+// -----------------------------------------------------------------------------
+// Reader
+// -----------------------------------------------------------------------------
+
+ViewPublisher::Reader::Reader(ViewPublisher& publisher) :
+    m_slot(nullptr), m_view(nullptr)
+{
+    while (true) {
+        uint64_t epoch = publisher.m_epoch.load();
+        for (Slot& slot: publisher.m_slots) {
+            uint64_t expected = kFree;
+            if (slot.epoch.compare_exchange_strong(expected, epoch)) {
+                m_slot = &slot.epoch;
+                break;
+            }
+        }
+        if (m_slot) break;
+        std::this_thread::yield();
+    }
+    m_view = publisher.m_current.load();
+}
+
+ViewPublisher::Reader::~Reader()
+{
+    m_slot->store(kFree);
+}
+
+} // namespace rrsim
@@ -0,0 +1,327 @@
+// stats.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the simulation statistics.
+
+#include "stats.h"
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rrsim {
+
+static const char* counterNames[eNumStatCounters] = {
+    "ticks",
+    "trains_moved",
+    "blocked_by_signal",
+    "blocked_by_switch",
+    "switch_flips",
+    "signal_flips",
+    "reroutes",
+    "route_repairs",
+    "departures",
+    "departures_held",
+    "trains_spawned",
+    "spawns_missed",
+    "trains_arrived",
+    "trip_steps",
+    "checkpoints",
+    "checkpoints_skipped",
+    "views_published",
+};
+
+static const char* counterLabels[eNumStatCounters] = {
+    "Simulation steps",
+    "Trains moved",
+    "Trains blocked by red signal",
+    "Trains blocked by switch",
+    "Junction switch flips",
+    "Signal flips",
+    "Trains rerouted",
+    "Routes repaired",
+    "Timetable departures",
+    "Departures held",
+    "Soak trains spawned",
+    "Soak spawns missed",
+    "Soak trains arrived",
+    "Soak trip steps",
+    "Checkpoints written",
+    "Checkpoints skipped",
+    "Read views published",
+};
+
+static const char* timerNames[eNumStatTimers] = {
+    "tick",
+    "train_step",
+    "signal_update",
+    "route_plan",
+    "checkpoint",
+    "publish",
+};
+
+// -----------------------------------------------------------------------------
+// Histogram
+// -----------------------------------------------------------------------------
+
+int Histogram::bucketOf(uint64_t value)
+{
+    const uint64_t kSub = 1 << kSubBits;
+    const int kHalf = 1 << (kSubBits - 1);
+    if (value < kSub) { return (int)value; }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (kSubBits - 1);
+    int top = (int)(value >> shift);
+    return (int)kSub + (shift - 1) * kHalf + (top - kHalf);
+}
+
+uint64_t Histogram::bucketLow(int index)
+{
+    const int kSub = 1 << kSubBits;
+    const int kHalf = 1 << (kSubBits - 1);
+    if (index < kSub) { return (uint64_t)index; }
+    int shift = (index - kSub) / kHalf + 1;
+    uint64_t top = (uint64_t)((index - kSub) % kHalf + kHalf);
+    return top << shift;
+}
+
+uint64_t Histogram::bucketHigh(int index)
+{
+    const int kSub = 1 << kSubBits;
+    const int kHalf = 1 << (kSubBits - 1);
+    if (index < kSub) { return (uint64_t)index; }
+    int shift = (index - kSub) / kHalf + 1;
+    return bucketLow(index) + ((uint64_t)1 << shift) - 1;
+}
+
+void Histogram::clear()
+{
+    for (int ix = 0; ix < kNumBuckets; ix++) {
+        m_buckets[ix].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    for (int ix = 0; ix < kNumBuckets; ix++) {
+        uint64_t n = other.m_buckets[ix].load(std::memory_order_relaxed);
+        if (n) {
+            m_buckets[ix].store(m_buckets[ix].load(std::memory_order_relaxed) + n,
+                                std::memory_order_relaxed);
+        }
+    }
+    m_count.store(count() + other.count(), std::memory_order_relaxed);
+    m_total.store(total() + other.total(), std::memory_order_relaxed);
+    if (other.max() > max()) {
+        m_max.store(other.max(), std::memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::percentile(double pct) const
+{
+    uint64_t n = count();
+    if (n == 0) { return 0; }
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)n + 0.5);
+    if (rank < 1) { rank = 1; }
+    uint64_t seen = 0;
+    for (int ix = 0; ix < kNumBuckets; ix++) {
+        seen += m_buckets[ix].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Never report more than the largest recorded value.
+            uint64_t high = bucketHigh(ix);
+            return (high < max()) ? high : max();
+        }
+    }
+    return max();
+}
+
+// -----------------------------------------------------------------------------
+// StatBlock
+// -----------------------------------------------------------------------------
+
+void StatBlock::clear()
+{
+    for (int ix = 0; ix < eNumStatCounters; ix++) {
+        counters[ix].store(0, std::memory_order_relaxed);
+    }
+    for (int ix = 0; ix < eNumStatTimers; ix++) {
+        timers[ix].clear();
+    }
+}
+
+void StatBlock::merge(const StatBlock& other)
+{
+    for (int ix = 0; ix < eNumStatCounters; ix++) {
+        counters[ix].store(
+                counters[ix].load(std::memory_order_relaxed) +
+                other.counters[ix].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    }
+    for (int ix = 0; ix < eNumStatTimers; ix++) {
+        timers[ix].merge(other.timers[ix]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// SimStats
+// -----------------------------------------------------------------------------
+
+// Every block ever handed out is owned here. When a thread exits its
+// block goes on the free list, to be picked up by the next thread, so
+// a run that starts a new simulation thread keeps adding to the same
+// totals without growing the registry.
+struct SimStats::Registry
+{
+    std::mutex                              lock;
+    std::vector<std::unique_ptr<StatBlock>> blocks;
+    std::vector<StatBlock*>                 freeList;
+};
+
+// Returns the thread's block to the registry when the thread exits.
+struct StatBlockHandle
+{
+    StatBlock* block = nullptr;
+    ~StatBlockHandle() {
+        if (block) { SimStats::instance().releaseBlock(block); }
+    }
+};
+
+SimStats& SimStats::instance()
+{
+    static SimStats S;
+    return S;
+}
+
+SimStats::SimStats() : m_registry(new Registry)
+{
+}
+
+SimStats::~SimStats()
+{
+    delete m_registry;
+}
+
+StatBlock& SimStats::local()
+{
+    thread_local StatBlockHandle handle;
+    if (!handle.block) {
+        handle.block = instance().acquireBlock();
+    }
+    return *handle.block;
+}
+
+StatBlock* SimStats::acquireBlock()
+{
+    std::lock_guard<std::mutex> guard(m_registry->lock);
+    if (!m_registry->freeList.empty()) {
+        StatBlock* block = m_registry->freeList.back();
+        m_registry->freeList.pop_back();
+        return block;
+    }
+    m_registry->blocks.emplace_back(new StatBlock);
+    return m_registry->blocks.back().get();
+}
+
+void SimStats::releaseBlock(StatBlock* block)
+{
+    std::lock_guard<std::mutex> guard(m_registry->lock);
+    m_registry->freeList.push_back(block);
+}
+
+void SimStats::snapshot(StatBlock& out)
+{
+    out.clear();
+    std::lock_guard<std::mutex> guard(m_registry->lock);
+    for (auto& block: m_registry->blocks) {
+        out.merge(*block);
+    }
+}
+
+void SimStats::reset()
+{
+    std::lock_guard<std::mutex> guard(m_registry->lock);
+    for (auto& block: m_registry->blocks) {
+        block->clear();
+    }
+}
+
+std::string SimStats::toText()
+{
+    std::unique_ptr<StatBlock> snap(new StatBlock);
+    snapshot(*snap);
+
+    std::stringstream ss;
+    for (int ix = 0; ix < eNumStatCounters; ix++) {
+        ss << std::setw(30) << std::left << counterLabels[ix] << ": "
+           << snap->counters[ix].load() << std::endl;
+    }
+    ss << std::endl
+       << std::setw(14) << std::left << "latency (ns)"
+       << std::right
+       << std::setw(10) << "count"
+       << std::setw(10) << "mean"
+       << std::setw(10) << "p50"
+       << std::setw(10) << "p90"
+       << std::setw(10) << "p99"
+       << std::setw(10) << "p99.9"
+       << std::setw(12) << "max" << std::endl;
+    for (int ix = 0; ix < eNumStatTimers; ix++) {
+        const Histogram& h = snap->timers[ix];
+        ss << std::setw(14) << std::left << timerNames[ix]
+           << std::right
+           << std::setw(10) << h.count()
+           << std::setw(10) << (uint64_t)h.mean()
+           << std::setw(10) << h.percentile(50.0)
+           << std::setw(10) << h.percentile(90.0)
+           << std::setw(10) << h.percentile(99.0)
+           << std::setw(10) << h.percentile(99.9)
+           << std::setw(12) << h.max() << std::endl;
+    }
+    return ss.str();
+}
+
+std::string SimStats::toJson()
+{
+    std::unique_ptr<StatBlock> snap(new StatBlock);
+    snapshot(*snap);
+
+    std::stringstream ss;
+    ss << "{\n  \"counters\": {";
+    for (int ix = 0; ix < eNumStatCounters; ix++) {
+        ss << (ix ? ",\n" : "\n") << "    \"" << counterNames[ix] << "\": "
+           << snap->counters[ix].load();
+    }
+    ss << "\n  },\n  \"latency_ns\": {";
+    for (int ix = 0; ix < eNumStatTimers; ix++) {
+        const Histogram& h = snap->timers[ix];
+        ss << (ix ? ",\n" : "\n") << "    \"" << timerNames[ix] << "\": {"
+           << "\"count\": " << h.count()
+           << ", \"mean\": " << (uint64_t)h.mean()
+           << ", \"p50\": " << h.percentile(50.0)
+           << ", \"p90\": " << h.percentile(90.0)
+           << ", \"p99\": " << h.percentile(99.0)
+           << ", \"p999\": " << h.percentile(99.9)
+           << ", \"max\": " << h.max() << "}";
+    }
+    ss << "\n  }\n}\n";
+    return ss.str();
+}
+
+int SimStats::dump(const std::string& path)
+{
+    std::ofstream ofstr(path, std::ofstream::trunc);
+    if (!ofstr.good()) { return ENOENT; }
+    bool json = (path.size() > 5) &&
+                (path.compare(path.size() - 5, 5, ".json") == 0);
+    ofstr << (json ? toJson() : toText());
+    return ofstr.good() ? 0 : EIO;
+}
+
+} // namespace rrsim
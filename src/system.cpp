@@ -9,16 +9,33 @@
 #include "node.h"
 #include "train.h"
 #include "rrsignal.h"
+#include "stats.h"
+#include "trace.h"
+#include "memstat.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace rrsim {
 
 const std::string System::emptyStr;
 
+static const char* kEdgeFormat = "tseg%03ld";
+static const char* kNodeFormat = "node%03ld";
+static const char* kTrainFormat = "train%ld";
+
+// Edits between compactions, at the least.
+static const long kCompactEdits = 1024;
+
 System& System::instance()
 {
     static System S;
@@ -26,6 +43,8 @@ System& System::instance()
 }
 
 System::System()
+    : m_search(m_transitions), m_topoVersion(0), m_edits(0),
+      m_simStep(0), m_verbose(true), m_statsPeriod(0)
 {
 }
 
@@ -35,31 +54,43 @@ System::~System()
 
 void System::resetTrackNetwork()
 {
-    // Clear out the existing network.
-    std::cout << std::endl << "Removing " << m_edgeMap.size() << " edges...";
-    m_edgeMap.clear();
-    std::cout << std::endl << "Removing " << m_nodeMap.size() << " nodes...";
-    m_nodeMap.clear();
-    std::cout << std::endl << "Removing " << m_trainMap.size() << " trains...";
-    m_trainMap.clear();
+    // Clear out the existing network. The objects go back to their
+    // arenas in one pass, not one free at a time.
+    Arena::Release edgeRelease(m_edgeArena);
+    Arena::Release nodeRelease(m_nodeArena);
+    Arena::Release trainRelease(m_trainArena);
+    Arena::Release signalRelease(m_signalArena);
+    std::cout << std::endl << "Removing " << m_edges.count << " edges...";
+    m_edges.clear();
+    std::cout << std::endl << "Removing " << m_nodes.count << " nodes...";
+    m_nodes.clear();
+    for (auto& bucket: m_nodesByType) { bucket.clear(); }
+    std::cout << std::endl << "Removing " << m_trains.count << " trains...";
+    m_trains.clear();
+    m_fleet.clear();
+    m_reach.clear();
+    m_routeMatrix.clear();
+    m_repair.clear();
+    m_timetable.clear();
+    m_soak.clear();
+    m_journal.detach();
+    m_checkpoint.clear();
+    m_transitions.invalidate();
+    touchTopology();
     std::cout << std::endl;
+    m_edgeNames.clear();
+    m_nodeNames.clear();
+    m_trainNames.clear();
+    m_edits = 0;
 }
 
 EdgePtr System::createEdge(const std::string& name)
 {
-    std::string edgeName = name;
-    if (name.empty()) {
-        edgeName = getUniqueEdgeName();
-    }
-    else {
-        // Verify the given edge name is unique.
-        auto iter = m_edgeMap.find(name);
-        if (iter != m_edgeMap.end()) {
-            throw std::runtime_error("createEdge already exists: " + name);
-        }
+    MemScope mem(eMemTopology);
+    EdgePtr rval = addEdge(name.empty() ? getUniqueEdgeName() : name);
+    if (!rval) {
+        throw std::runtime_error("createEdge already exists: " + name);
     }
-    EdgePtr rval = std::make_shared<Edge>(edgeName);
-    m_edgeMap.insert(EdgeItem(rval->name(), rval));
 
     // Place terminator nodes at each end of the edge.
     NodePtr nptrA = createNode();
@@ -75,60 +106,195 @@ EdgePtr System::createEdge(const std::string& name)
 
 EdgePtr System::getEdge(const std::string& name)
 {
-    auto iter = m_edgeMap.find(name);
-    if (iter == m_edgeMap.end()) { return nullptr; }
-    return iter->second;
+    return findObject(m_edges, name);
 }
 
-NodePtr System::createNode(const std::string& name)
+void System::removeEdge(const std::string& name)
 {
-    std::string nodeName = name;
-    if (name.empty()) {
-        nodeName = getUniqueNodeName();
+    EdgePtr eptr = getEdge(name);
+    if (!eptr) {
+        throw std::runtime_error("removeEdge no such segment: " + name);
     }
-    else {
-        // Verify the given node name is unique.
-        auto iter = m_nodeMap.find(name);
-        if (iter != m_nodeMap.end()) {
-            throw std::runtime_error("createNode already exists: " + name);
-        }
+    if (eptr->getTrain()) {
+        throw std::runtime_error("A train is on segment: " + eptr->name());
+    }
+    MemScope mem(eMemTopology);
+    for (int ix = 0; ix < eNumEnds; ix++) { detachEnd(*eptr, (eEnd)ix); }
+    dropEdge(*eptr);
+    noteEdit();
+}
+
+void System::dropEdge(Edge& edge)
+{
+    // Trains bound for the segment have nowhere to go.
+    int id = edge.id();
+    for (int train: m_fleet.boundFor(id)) {
+        m_fleet.setDestination(train, -1);
+        m_fleet.clearRoute(train);
+    }
+    edgeChanged(id);
+    m_journal.edgeRemoved(edge.name());
+    releaseName(m_edgeNames, edge.name(), kEdgeFormat);
+    removeObject(m_edges, id);
+}
+
+NodePtr System::createNode(const std::string& name)
+{
+    MemScope mem(eMemTopology);
+    NodePtr rval = addNode(name.empty() ? getUniqueNodeName() : name);
+    if (!rval) {
+        throw std::runtime_error("createNode already exists: " + name);
     }
-    NodePtr rval = std::make_shared<Node>(nodeName);
-    m_nodeMap.insert(NodeItem(rval->name(), rval));
     return rval;
 }
 
 NodePtr System::getNode(const std::string& name)
 {
-    auto iter = m_nodeMap.find(name);
-    if (iter == m_nodeMap.end()) { return nullptr; }
-    return iter->second;
+    return findObject(m_nodes, name);
+}
+
+void System::removeNode(const std::string& name)
+{
+    NodePtr nptr = getNode(name);
+    if (!nptr) {
+        throw std::runtime_error("removeNode no such node: " + name);
+    }
+    MemScope mem(eMemTopology);
+    // The last slot first, so the others stay where they are. The new
+    // terminators are made while the node still holds its name.
+    for (int sx = eNumSlots; sx-- > 0; ) {
+        EdgeEnd ee = nptr->getEdgeEnd((eSlot)sx);
+        EdgePtr eptr = ee.eeEdge.lock();
+        if (!eptr) continue;
+        NodePtr term = createNode();
+        detachEnd(*eptr, ee.eeEnd);
+        term->makeTerminator(ee);
+        eptr->assignNodeSlot(NodeSlot(term, eSlot1), ee.eeEnd);
+    }
+    noteEdit();
+}
+
+void System::detachEnd(Edge& edge, eEnd end)
+{
+    NodeSlot ns = edge.getNode(end);
+    if (!ns.nsNode) { return; }
+    Node& node = *ns.nsNode;
+    int used = (int)node.getNodeType();
+    if ((used == eJunction) && (ns.nsSlot == eSlot1)) {
+        // Without its common track the forks would meet fork to fork,
+        // which no switch allows. Each fork gets a terminator of its
+        // own, as removeNode does, and the junction goes.
+        for (int sx = eSlot3; sx > eSlot1; sx--) {
+            EdgeEnd ee = node.m_slots[sx];
+            node.m_slots[sx] = EdgeEnd();
+            EdgePtr fork = ee.eeEdge.lock();
+            NodePtr term = createNode();
+            term->makeTerminator(ee);
+            fork->assignNodeSlot(NodeSlot(term, eSlot1), ee.eeEnd);
+        }
+        node.m_slots[eSlot1] = EdgeEnd();
+        node.m_switchState = eSwitchNone;
+        edge.assignNodeSlot(NodeSlot(), end);
+        reindexNode(node);
+        dropNode(node);
+        return;
+    }
+    for (int sx = ns.nsSlot; sx + 1 < used; sx++) {
+        node.m_slots[sx] = node.m_slots[sx + 1];
+        EdgePtr moved = node.m_slots[sx].eeEdge.lock();
+        moved->assignNodeSlot(NodeSlot(ns.nsNode, (eSlot)sx), node.m_slots[sx].eeEnd);
+    }
+    node.m_slots[used - 1] = EdgeEnd();
+    if (used == eJunction) {
+        // The table drops the junction as the node is reindexed.
+        node.m_switchState = eSwitchNone;
+    }
+    edge.assignNodeSlot(NodeSlot(), end);
+    reindexNode(node);
+    if (node.getNodeType() == eEmpty) { dropNode(node); }
+}
+
+void System::dropNode(Node& node)
+{
+    std::vector<int>& empty = m_nodesByType[eEmpty];
+    int last = empty.back();
+    empty[node.m_typePos] = last;
+    m_nodes.items[last]->m_typePos = node.m_typePos;
+    empty.pop_back();
+    releaseName(m_nodeNames, node.name(), kNodeFormat);
+    removeObject(m_nodes, node.id());
+}
+
+void System::dropTerminator(Node& node)
+{
+    node.m_slots[eSlot1] = EdgeEnd();
+    reindexNode(node);
+    dropNode(node);
+}
+
+void System::noteEdit(long count)
+{
+    m_edits += count;
+    if (m_edits >= std::max<long>(kCompactEdits, (long)m_edges.count / 4)) {
+        // The routes of the trains see the edits before the tables
+        // they were planned on are rebuilt.
+        m_fleet.repairRoutes();
+        compact();
+    }
+}
+
+// The reach index only ever adds links, the transition table keeps a
+// log of the edits and reuses junction records, and removed objects
+// leave null entries. Starting these over from the network as it is
+// costs as much as building it, so it is only done after many edits.
+void System::compact()
+{
+    trimTable(m_edges);
+    trimTable(m_nodes);
+    trimTable(m_trains);
+    m_transitions.invalidate();
+    m_reach.clear();
+    for (const NodePtr& nptr: m_nodes.items) {
+        if (nptr) { m_reach.nodeChanged(nptr->id()); }
+    }
+    touchTopology();
+    m_edits = 0;
 }
 
 TrainPtr System::createTrain(const std::string& name)
 {
-    auto iter = m_trainMap.find(name);
-    if (iter != m_trainMap.end()) {
+    MemScope mem(eMemTrains);
+    TrainPtr rval = addObject(m_trains, m_trainArena,
+                              name.empty() ? getUniqueTrainName() : name);
+    if (!rval) {
         throw std::runtime_error("createTrain already exists: " + name);
     }
-    std::string trainName = name;
-    if (name.empty()) {
-        trainName = getUniqueTrainName();
-    }
-    TrainPtr rval = std::make_shared<Train>(trainName);
-    m_trainMap.insert(TrainItem(rval->name(), rval));
+    m_fleet.addTrain(rval->id());
     return rval;
 }
 
 TrainPtr System::getTrain(const std::string& name)
 {
-    auto iter = m_trainMap.find(name);
-    if (iter == m_trainMap.end()) { return nullptr; }
-    return iter->second;
+    return findObject(m_trains, name);
+}
+
+void System::removeTrain(const std::string& name)
+{
+    TrainPtr tptr = getTrain(name);
+    if (!tptr) {
+        throw std::runtime_error("removeTrain no such train: " + name);
+    }
+    tptr->placeOnTrack(nullptr, nullptr);
+    m_fleet.removeTrain(tptr->id());
+    m_soak.trainRemoved(tptr->id());
+    m_journal.trainRemoved(tptr->name());
+    releaseName(m_trainNames, tptr->name(), kTrainFormat);
+    removeObject(m_trains, tptr->id());
 }
 
 int System::connectSegments(const EdgeEnd& s1, const EdgeEnd& s2)
 {
+    MemScope mem(eMemTopology);
     // If either track is null, there is nothing more to do.
     EdgePtr ept1 = s1.eeEdge.lock();
     EdgePtr ept2 = s2.eeEdge.lock();
@@ -145,6 +311,8 @@ int System::connectSegments(const EdgeEnd& s1, const EdgeEnd& s2)
                   << std::endl;
         return EBUSY;
     }
+    // An end cannot be connected to itself.
+    if (cnctNode.nsNode == rmovNode.nsNode) { return EINVAL; }
 
     // Connect to the other track as implied by this track's connection.
     switch (cnctNode.nsNode->getNodeType()) {
@@ -175,51 +343,151 @@ int System::connectSegments(const EdgeEnd& s1, const EdgeEnd& s2)
     default:
         throw std::runtime_error("Unexpected node type in connectEdge");
     }
+
+    // The terminator the other track had is no longer used.
+    dropTerminator(*rmovNode.nsNode);
+    noteEdit();
     return 0;
 }
 
+// One step of the whole system, shared by every way of stepping it.
+void System::tick(bool& moreSteps, const TrainStepFn& afterTrain)
+{
+    StatTimer timer(eTimeTick);
+    RRSIM_TRACE_SCOPE("tick");
+    moreSteps = (m_timetable.pending() > 0) || m_soak.active();
+    // The signals must see the trains placed before any train moves.
+    bool placed = m_soak.tick(m_simStep);
+    if (m_timetable.inject(m_simStep) > 0) { placed = true; }
+    if (placed) { updateAllSignals(); }
+    // Signals only change when a train moves or sets a switch. The
+    // first refresh of a tick also picks up edits made between ticks.
+    bool stale = true;
+    for (const TrainPtr& tptr: sortedTrains()) {
+        bool more, changed;
+        {
+            StatTimer step(eTimeTrainStep);
+            RRSIM_TRACE_SCOPE("trainStep");
+            more = m_fleet.step(tptr->id(), changed);
+        }
+        if (more) { moreSteps = true; }
+        if (changed || stale) {
+            updateAllSignals();
+            stale = false;
+        }
+        if (afterTrain) { afterTrain(tptr, more); }
+    }
+}
+
 int System::stepSimulation()
 {
     try {
-        for (auto iter: m_trainMap) {
-            TrainPtr tptr = iter.second;
-            bool chk = tptr->stepSimulation();
-            updateAllSignals();
+        bool moreSteps;
+        tick(moreSteps, [](const TrainPtr& tptr, bool more) {
             tptr->show();
-            if (!chk) {
+            if (!more) {
                 std::cout << ">>> The Simulation Is Complete : "
                           << tptr->name() << " <<<" << std::endl;
             }
-        }
+        });
     }
     catch (std::exception& ex) {
         std::cout << "ERROR: " << ex.what() << std::endl;
         return EFAULT;
     }
+    endOfStep();
     return 0;
 }
 
+namespace {
+
+// A segment as the run shows it, with what lies beyond each end for
+// every switch position, so that a view is shown without the System.
+struct ViewLine
+{
+    const std::string*  name;
+    int                 edge;
+    int                 node[eNumEnds];     // The junction, or -1.
+    std::string         ends[eNumEnds][eSwitchRight + 1];
+};
+
+std::vector<ViewLine> viewLines(const EdgeVec& edges)
+{
+    std::vector<ViewLine> lines(edges.size());
+    for (size_t ix = 0; ix < edges.size(); ix++) {
+        const EdgePtr& eptr = edges[ix];
+        ViewLine& line = lines[ix];
+        line.name = &eptr->name();
+        line.edge = eptr->id();
+        for (int ex = 0; ex < eNumEnds; ex++) {
+            NodePtr node = eptr->getNode((eEnd)ex).nsNode;
+            bool junction = node && (node->getNodeType() == eJunction);
+            line.node[ex] = junction ? node->id() : -1;
+            for (int sw = eSwitchNone; sw <= eSwitchRight; sw++) {
+                line.ends[ex][sw] = eptr->endText((eEnd)ex, (eJSwitch)sw);
+            }
+        }
+    }
+    return lines;
+}
+
+// The segments as in System::showEdges, in the state of the view.
+void showView(const std::vector<ViewLine>& lines, const StateView& view)
+{
+    for (const ViewLine& line: lines) {
+        int32_t state = line.edge * 2;
+        eJSwitch swA = (line.node[eEndA] < 0) ? eSwitchNone : view.switchOf(line.node[eEndA]);
+        eJSwitch swB = (line.node[eEndB] < 0) ? eSwitchNone : view.switchOf(line.node[eEndB]);
+        std::string msg = line.ends[eEndA][swA];
+        if (view.hasSignal(state + eEndA)) {
+            msg += (view.signalIsRed(state + eEndA) ? "R " : "G ");
+        }
+        else {
+            msg += "_ ";
+        }
+        msg += *line.name;
+        if (view.hasSignal(state + eEndB)) {
+            msg += (view.signalIsRed(state + eEndB) ? " R" : " G");
+        }
+        else {
+            msg += " _";
+        }
+        msg += line.ends[eEndB][swB];
+        int train = view.occupant(line.edge);
+        if ((train >= 0) && ((size_t)train < view.trains().size()) && view.trains()[train].name) {
+            const StateView::TrainPos& pos = view.trains()[train];
+            if ((pos.state >= 0) && ((pos.state & 1) == eEndA)) {
+                msg += "  /[o==o]-[o==o]  ";
+            }
+            else {
+                msg += "   [o==o]-[o==o]\\ ";
+            }
+            msg += *pos.name;
+        }
+        std::cout << msg << std::endl;
+    }
+    std::cout << std::endl
+              << "TOTAL: " << lines.size() << " track segments"
+              << std::endl;
+}
+
+} // namespace
+
+// The simulation steps on a thread of its own and publishes a view
+// after every step. The display runs on another thread and shows the
+// latest view; the main thread waits for the user to halt the run.
 int System::runSimulation()
 {
-    bool haltNow = false;
+    std::atomic<bool> haltNow(false);
+    std::atomic<bool> simDone(false);
+    long startStep = m_simStep;
     auto simLoop = [&]() {
+        RRSIM_TRACE_THREAD("simulation");
         try {
-            int elapsed = 0;
             bool running = true;
             while (running && !haltNow) {
-                running = false;
-                for (auto iter: m_trainMap) {
-                    TrainPtr tptr = iter.second;
-                    bool moresteps = tptr->stepSimulation();
-                    if (moresteps) { running = true; }
-                    updateAllSignals();
-                }
-                // Move up n lines, where n is the number of edges plus three.
-                std::cout << "\x1B[" << (m_edgeMap.size() + 3) << "A";
-                std::cout << "\x1B[G\x1B[0J"; // clear all lines below cursor.
-                showEdges();
-                std::cout << "Simulation step: " << ++elapsed << std::endl;
-                std::cout << "Press ENTER to halt simulation: " << std::flush;
+                tick(running);
+                endOfStep();
                 for (int ix = 0; ix < 2000; ix += 100) {
                     if (!haltNow) {
                         std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -230,33 +498,117 @@ int System::runSimulation()
         catch (std::exception& ex) {
             std::cout << "ERROR: " << ex.what() << std::endl;
         }
+        simDone = true;
+    };
+
+    // The topology stays as it is for the run, so the lines are taken
+    // here and the display reads nothing of the System.
+    std::vector<ViewLine> lines;
+    try {
+        lines = viewLines(sortedEdges());
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EFAULT;
+    }
+    auto display = [&]() {
+        RRSIM_TRACE_THREAD("display");
+        long shown = startStep;
+        bool done = false;
+        while (!done) {
+            done = simDone;
+            {
+                ViewPublisher::Reader reader(m_views);
+                const StateView* view = reader.view();
+                if (view && (view->step() != shown)) {
+                    shown = view->step();
+                    // Move up n lines, where n is the number of edges plus three.
+                    std::cout << "\x1B[" << (lines.size() + 3) << "A";
+                    std::cout << "\x1B[G\x1B[0J"; // clear all lines below cursor.
+                    showView(lines, *view);
+                    std::cout << "Simulation step: " << (shown - startStep) << std::endl;
+                    std::cout << "Press ENTER to halt simulation: " << std::flush;
+                }
+            }
+            if (!done) { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+        }
         if (!haltNow) {
             std::cout << std::endl << std::endl << "Simulation COMPLETE";
             std::cout << std::endl << "Press ENTER to continue: " << std::flush;
         }
     };
 
-    showEdges();
+    m_views.start();
+    {
+        ViewPublisher::Reader reader(m_views);
+        showView(lines, *reader.view());
+    }
     std::cout << "Simulation step: 0" << std::endl;
     std::cout << "Press ENTER to halt simulation: " << std::flush;
 
     std::thread tsim(simLoop);
+    std::thread tdisplay(display);
     std::string resp;
     std::getline(std::cin, resp);
     haltNow = true;
     if (tsim.joinable()) { tsim.join(); }
+    if (tdisplay.joinable()) { tdisplay.join(); }
+    m_views.stop();
 
     return 0;
 }
 
+int System::runSoak(long steps, long report)
+{
+    bool verbose = m_verbose;
+    m_verbose = false;
+    int rc = 0;
+    uint64_t arrivedBefore = 0;
+    try {
+        for (long ix = 0; ix < steps; ix++) {
+            bool moreSteps;
+            tick(moreSteps);
+            endOfStep();
+
+            if ((report > 0) && (((ix + 1) % report) == 0)) {
+                std::unique_ptr<StatBlock> snap(new StatBlock);
+                SimStats::instance().snapshot(*snap);
+                uint64_t arrived = snap->counters[eStatTrainsArrived];
+                uint64_t trips = snap->counters[eStatTripSteps];
+                std::cout << "step " << m_simStep
+                          << ": trains " << m_trains.count
+                          << ", spawned " << snap->counters[eStatTrainsSpawned]
+                          << ", arrived " << arrived
+                          << ", mean trip " << (arrived ? trips / arrived : 0) << " steps"
+                          << ", throughput " << (arrived - arrivedBefore) * 1000 / report
+                          << " per 1000 steps";
+                if (MemStats::enabled()) {
+                    std::cout << ", memory " << MemStats::total().liveBytes << " bytes";
+                }
+                else {
+                    std::cout << ", memory n/a";
+                }
+                std::cout << std::endl;
+                arrivedBefore = arrived;
+            }
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        rc = EFAULT;
+    }
+    m_verbose = verbose;
+    return rc;
+}
+
 int System::showEdges()
 {
     try {
-        for (auto iter: m_edgeMap) {
-            iter.second->show();
+        for (EdgePtr eptr: sortedEdges()) {
+            eptr->show();
         }
         std::cout << std::endl
-                  << "TOTAL: " << m_edgeMap.size() << " track segments"
+                  << "TOTAL: " << m_edges.count << " track segments"
                   << std::endl;
     }
     catch (std::exception& ex) {
@@ -269,8 +621,8 @@ int System::showEdges()
 int System::showNodes()
 {
     try {
-        for (auto iter: m_nodeMap) {
-            iter.second->show();
+        for (NodePtr nptr: sortedNodes()) {
+            nptr->show();
         }
     }
     catch (std::exception& ex) {
@@ -282,8 +634,7 @@ int System::showNodes()
 
 void System::addSignalsToAllJunctions()
 {
-    for (auto iter: m_edgeMap) {
-        EdgePtr eptr = iter.second;
+    for (EdgePtr eptr: sortedEdges()) {
         if (eptr) {
             for (int ix = 0; ix < eNumEnds; ix++) {
                 eEnd ex = (eEnd)ix;
@@ -305,8 +656,10 @@ void System::addSignalsToAllJunctions()
 
 void System::updateAllSignals()
 {
-    for (auto iter: m_edgeMap) {
-        EdgePtr eptr = iter.second;
+    StatTimer timer(eTimeSignalUpdate);
+    RRSIM_TRACE_SCOPE("updateAllSignals");
+    MemScope mem(eMemSignals);
+    for (const EdgePtr& eptr: m_edges.items) {
         if (eptr) {
             for (int ix = 0; ix < eNumEnds; ix++) {
                 RRsignal* sig = eptr->getSignal((eEnd)ix);
@@ -319,23 +672,56 @@ void System::updateAllSignals()
 NodeVec System::getAllJunctions()
 {
     NodeVec rval;
-    for (auto iter: m_nodeMap) {
-        NodePtr nptr = iter.second;
-        if (nptr && (nptr->getNodeType() == eJunction)) {
-            rval.push_back(nptr);
-        }
+    rval.reserve(m_nodesByType[eJunction].size());
+    for (int id: m_nodesByType[eJunction]) {
+        rval.push_back(m_nodes.items[id]);
     }
+    std::sort(rval.begin(), rval.end(), [](const NodePtr& a, const NodePtr& b) {
+        return a->name() < b->name();
+    });
     return rval;
 }
 
+void System::reindexNode(Node& node)
+{
+    touchTopology();
+    m_reach.nodeChanged(node.id());
+    m_transitions.nodeChanged(node.id());
+    if (m_journal.attached() || m_checkpoint.active()) {
+        // The slots the segments have at the node are in their lines,
+        // and a new junction has its switch set without a report.
+        m_journal.switchChanged(node.id());
+        m_checkpoint.nodeChanged(node.id());
+        for (const EdgeEnd& ee: node.m_slots) {
+            EdgePtr eptr = ee.eeEdge.lock();
+            if (!eptr) continue;
+            m_journal.edgeChanged(eptr->id());
+            m_checkpoint.edgeChanged(eptr->id());
+        }
+    }
+    eNodeType type = node.probeType();
+    if (type == node.m_type) { return; }
+
+    // Swap the last node of the old type into this node's place.
+    std::vector<int>& from = m_nodesByType[node.m_type];
+    int last = from.back();
+    from[node.m_typePos] = last;
+    m_nodes.items[last]->m_typePos = node.m_typePos;
+    from.pop_back();
+
+    std::vector<int>& to = m_nodesByType[type];
+    node.m_type = type;
+    node.m_typePos = (int)to.size();
+    to.push_back(node.m_id);
+}
+
 int System::serialize(std::ofstream& ofstr)
 {
+    RRSIM_TRACE_SCOPE("serialize");
+    MemScope mem(eMemIO);
     try {
-        for (auto iter: m_edgeMap) {
-            EdgePtr edge = iter.second;
-            if (edge) {
-                ofstr << edge->serialize();
-            }
+        for (EdgePtr edge: sortedEdges()) {
+            ofstr << edge->serialize();
         }
     }
     catch (std::exception& ex) {
@@ -347,70 +733,533 @@ int System::serialize(std::ofstream& ofstr)
 
 int System::deserialize(std::ifstream& ifstr)
 {
+    RRSIM_TRACE_SCOPE("deserialize");
+    MemScope mem(eMemIO);
     // Clear out the existing network.
     resetTrackNetwork();
 
-    // Load the previously saved network.
+    // Load the previously saved network. A base saved by the journal
+    // also has an epoch, and the switches and trains after the segments.
     std::string segment;
+    std::vector<std::string> state;
     try {
         while (!ifstr.eof()) {
             std::getline(ifstr, segment);
-            if (segment.empty()) continue;
+            if (segment.empty() || (segment.compare(0, 7, "epoch: ") == 0)) continue;
+            if (Journal::isState(segment)) {
+                state.push_back(segment);
+                continue;
+            }
             size_t pos1 = 7;
             if (segment.substr(0, pos1) != "track: ") {
                 throw std::runtime_error("Serialized string preamble missing");
             }
             size_t pos2 = segment.find(',', pos1);
             std::string name = segment.substr(pos1, pos2-pos1);
-            EdgePtr eptr = std::make_shared<Edge>(name);
-            m_edgeMap.insert(EdgeItem(eptr->name(), eptr));
+            MemScope topo(eMemTopology);
+            EdgePtr eptr = addEdge(name);
+            if (!eptr) {
+                throw std::runtime_error("Duplicate track segment " + name);
+            }
             eptr->deserialize(segment);
         }
+        segment.clear();
+        Journal::applyState(state);
         updateAllSignals();
     }
     catch (std::exception& ex) {
         std::cout << "ERROR: " << ex.what() << std::endl;
-        std::cout << "segment: \"" << segment << "\"" << std::endl;
+        if (!segment.empty()) { std::cout << "segment: \"" << segment << "\"" << std::endl; }
         return EFAULT;
     }
     return 0;
 }
 
-std::string System::getUniqueEdgeName()
+namespace {
+
+// One line of a saved network (see Edge::serialize). The fields are
+// kept between lines so reading a large file does not allocate.
+struct TrackLine
+{
+    std::string name;
+    double      weight;
+    std::string node[eNumEnds];
+    int         slot[eNumEnds];
+    bool        signal[eNumEnds];
+    std::string field;
+
+    void parse(const std::string& line);
+};
+
+void TrackLine::parse(const std::string& line)
 {
-    int ix = 1;
-    std::string name = "tseg001";
-    while (m_edgeMap.find(name) != m_edgeMap.end()) {
-        ix++;
-        std::stringstream ns;
-        ns << "tseg" << std::setw(3) << std::setfill('0') << ix;
-        name = ns.str();
+    size_t pos = 7;
+    if (line.compare(0, pos, "track: ") != 0) {
+        throw std::runtime_error("Serialized string preamble missing");
+    }
+    auto next = [&](std::string& out) {
+        if (pos > line.size()) {
+            throw std::runtime_error("Serialized string has too few fields");
+        }
+        size_t comma = std::min(line.find(',', pos), line.size());
+        out.assign(line, pos, comma - pos);
+        pos = comma + 1;
+    };
+    next(name);
+    next(field);
+    weight = std::stod(field);
+    for (int ix = 0; ix < eNumEnds; ix++) {
+        next(node[ix]);
+        next(field);
+        slot[ix] = std::stoi(field);
+        if ((slot[ix] < eSlot1) || (slot[ix] > eSlot3)) {
+            throw std::runtime_error("Invalid slot for " + name);
+        }
+    }
+    for (int ix = 0; ix < eNumEnds; ix++) {
+        next(field);
+        signal[ix] = (field == ((ix == eEndA) ? "sigA:Y" : "sigB:Y"));
     }
-    return name;
 }
-std::string System::getUniqueNodeName()
+
+} // namespace
+
+int System::reload(std::ifstream& ifstr)
+{
+    RRSIM_TRACE_SCOPE("reload");
+    return applyTracks(ifstr, nullptr);
+}
+
+int System::patch(std::istream& istr, const std::vector<std::string>& removed)
+{
+    RRSIM_TRACE_SCOPE("patch");
+    return applyTracks(istr, &removed);
+}
+
+int System::applyTracks(std::istream& istr, const std::vector<std::string>* removals)
 {
-    int ix = 1;
-    std::string name = "node001";
-    while (m_nodeMap.find(name) != m_nodeMap.end()) {
-        ix++;
-        std::stringstream ns;
-        ns << "node" << std::setw(3) << std::setfill('0') << ix;
-        name = ns.str();
+    MemScope mem(eMemIO);
+
+    // Compare each line with the segment of its name as it is read, and
+    // keep only the lines that differ.
+    std::vector<TrackLine> changes;
+    std::vector<EdgePtr> removed;
+    std::vector<std::pair<EdgePtr, int>> rewired;   // With the change.
+    std::vector<std::pair<EdgePtr, int>> retouched;
+    std::vector<int> added;
+    std::vector<char> seen(m_edges.items.size(), 0);
+    std::vector<char> cut(m_edges.items.size(), 0);     // Out of its nodes.
+    std::vector<char> moved(m_edges.items.size(), 0);   // Or reweighed.
+    std::vector<std::string> state;
+    std::string line;
+    TrackLine track;
+    try {
+        std::unordered_set<std::string> newNames;
+        while (std::getline(istr, line)) {
+            if (line.empty() || (line.compare(0, 7, "epoch: ") == 0)) continue;
+            if (Journal::isState(line)) {
+                state.push_back(line);
+                continue;
+            }
+            track.parse(line);
+            EdgePtr eptr = getEdge(track.name);
+            if (!eptr) {
+                if (!newNames.insert(track.name).second) {
+                    throw std::runtime_error("Duplicate track segment " + track.name);
+                }
+                added.push_back((int)changes.size());
+                changes.push_back(track);
+                continue;
+            }
+            int id = eptr->id();
+            if (seen[id]) {
+                throw std::runtime_error("Duplicate track segment " + track.name);
+            }
+            seen[id] = 1;
+            bool same = true;
+            bool signals = true;
+            for (int ix = 0; ix < eNumEnds; ix++) {
+                NodeSlot ns = eptr->getNode((eEnd)ix);
+                if (!ns.nsNode || (ns.nsSlot != track.slot[ix]) ||
+                    (ns.nsNode->name() != track.node[ix])) {
+                    same = false;
+                }
+                if ((eptr->getSignal((eEnd)ix) != nullptr) != track.signal[ix]) {
+                    signals = false;
+                }
+            }
+            bool reweighed = (eptr->weight() != track.weight);
+            if (!same) {
+                rewired.emplace_back(eptr, (int)changes.size());
+                cut[id] = moved[id] = 1;
+            }
+            else if (reweighed || !signals) {
+                retouched.emplace_back(eptr, (int)changes.size());
+                moved[id] = reweighed;
+            }
+            else continue;
+            changes.push_back(track);
+        }
+        line.clear();
+        if (!removals) {
+            for (const EdgePtr& eptr: m_edges.items) {
+                if (eptr && !seen[eptr->id()]) {
+                    removed.push_back(eptr);
+                    cut[eptr->id()] = moved[eptr->id()] = 1;
+                }
+            }
+        }
+        else {
+            // Only the named segments, unless the lines keep them.
+            for (const std::string& name: *removals) {
+                EdgePtr eptr = getEdge(name);
+                if (eptr && !seen[eptr->id()]) {
+                    seen[eptr->id()] = 1;
+                    removed.push_back(eptr);
+                    cut[eptr->id()] = moved[eptr->id()] = 1;
+                }
+            }
+        }
+
+        // The nodes the edits touch must come out with their slots taken
+        // once each, from the first slot up. The segments that stay keep
+        // their slots, so the other nodes are as they were.
+        std::unordered_map<std::string, int> slots;
+        auto keptSlots = [&](Node* node) {
+            int used = 0;
+            for (int sx = 0; sx < eNumSlots; sx++) {
+                EdgePtr other = node->m_slots[sx].eeEdge.lock();
+                if (other && !cut[other->id()]) { used |= 1 << sx; }
+            }
+            return used;
+        };
+        auto oldNodes = [&](const EdgePtr& eptr) {
+            for (int ix = 0; ix < eNumEnds; ix++) {
+                NodeSlot ns = eptr->getNode((eEnd)ix);
+                if (ns.nsNode) { slots.emplace(ns.nsNode->name(), keptSlots(ns.nsNode.get())); }
+            }
+        };
+        for (const EdgePtr& eptr: removed) { oldNodes(eptr); }
+        for (const auto& item: rewired) { oldNodes(item.first); }
+        auto place = [&](const TrackLine& change) {
+            for (int ix = 0; ix < eNumEnds; ix++) {
+                auto found = slots.find(change.node[ix]);
+                if (found == slots.end()) {
+                    NodePtr nptr = getNode(change.node[ix]);
+                    found = slots.emplace(change.node[ix], nptr ? keptSlots(nptr.get()) : 0).first;
+                }
+                int bit = 1 << change.slot[ix];
+                if (found->second & bit) {
+                    throw std::runtime_error("Slot of node " + change.node[ix] +
+                                             " is taken twice");
+                }
+                found->second |= bit;
+            }
+        };
+        for (const auto& item: rewired) { place(changes[item.second]); }
+        for (int cx: added) { place(changes[cx]); }
+        for (const auto& node: slots) {
+            if ((node.second & (node.second + 1)) != 0) {
+                throw std::runtime_error("Slots of node " + node.first +
+                                         " are not in order");
+            }
+        }
     }
-    return name;
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        if (!line.empty()) { std::cout << "segment: \"" << line << "\"" << std::endl; }
+        return EFAULT;
+    }
+    if (changes.empty() && removed.empty() && state.empty()) {
+        std::cout << "The network is unchanged" << std::endl;
+        return 0;
+    }
+
+    MemScope topo(eMemTopology);
+    // Trains with a segment that moves or changes its weight under
+    // them leave the track.
+    int offTrack = 0;
+    for (const TrainPtr& tptr: m_trains.items) {
+        if (!tptr || !m_fleet.onTrack(tptr->id())) continue;
+        int tid = tptr->id();
+        for (size_t cx = 0; cx < m_fleet.consistSize(tid); cx++) {
+            if (moved[m_fleet.consistEdge(tid, cx)]) {
+                tptr->placeOnTrack(nullptr, nullptr);
+                offTrack++;
+                break;
+            }
+        }
+    }
+
+    // Take the ends out of their nodes without moving the other slots,
+    // which the file keeps where they are.
+    std::vector<NodePtr> touched;
+    auto unhook = [&](Edge& edge) {
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            NodeSlot ns = edge.getNode((eEnd)ix);
+            if (!ns.nsNode) continue;
+            ns.nsNode->m_slots[ns.nsSlot] = EdgeEnd();
+            touched.push_back(ns.nsNode);
+            edge.assignNodeSlot(NodeSlot(), (eEnd)ix);
+        }
+    };
+    for (const EdgePtr& eptr: removed) {
+        unhook(*eptr);
+        dropEdge(*eptr);
+    }
+    for (const auto& item: rewired) { unhook(*item.first); }
+    for (int cx: added) { rewired.emplace_back(addEdge(changes[cx].name), cx); }
+    for (const auto& item: rewired) {
+        const TrackLine& change = changes[item.second];
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            NodePtr nptr = getNode(change.node[ix]);
+            if (!nptr) { nptr = createNode(change.node[ix]); }
+            nptr->m_slots[change.slot[ix]] = EdgeEnd(item.first, (eEnd)ix);
+            item.first->assignNodeSlot(NodeSlot(nptr, (eSlot)change.slot[ix]), (eEnd)ix);
+            touched.push_back(nptr);
+        }
+        edgeChanged(item.first->id());
+    }
+
+    // Each node once: a new junction starts switched left, as a loaded
+    // one does.
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (const NodePtr& nptr: touched) {
+        eNodeType type = nptr->probeType();
+        if (type != eJunction) { nptr->m_switchState = eSwitchNone; }
+        else if (nptr->m_switchState == eSwitchNone) { nptr->m_switchState = eSwitchLeft; }
+        reindexNode(*nptr);
+        if (type == eEmpty) { dropNode(*nptr); }
+    }
+
+    size_t changed = rewired.size() + retouched.size() - added.size();
+    rewired.insert(rewired.end(), retouched.begin(), retouched.end());
+    for (const auto& item: rewired) {
+        const TrackLine& change = changes[item.second];
+        Edge& edge = *item.first;
+        if (edge.weight() != change.weight) { edge.setWeight(change.weight); }
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            bool has = (edge.getSignal((eEnd)ix) != nullptr);
+            if (has && !change.signal[ix]) { edge.removeSignalLight((eEnd)ix); }
+            else if (!has && change.signal[ix]) { edge.placeSignalLight((eEnd)ix); }
+        }
+    }
+    int rc = 0;
+    try { Journal::applyState(state); }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        rc = EFAULT;
+    }
+    updateAllSignals();
+    std::cout << "Reloaded: " << added.size() << " added, " << removed.size()
+              << " removed, " << changed << " changed, " << offTrack
+              << " trains taken off the track" << std::endl;
+    noteEdit((long)(removed.size() + rewired.size()));
+    return rc;
 }
-std::string System::getUniqueTrainName()
+
+void System::setStatsDump(const std::string& path, int period)
 {
-    int ix = 1;
-    std::string name = "train1";
-    while (m_trainMap.find(name) != m_trainMap.end()) {
-        ix++;
-        std::stringstream ns;
-        ns << "train" << ix;
-        name = ns.str();
+    m_statsPath = path;
+    m_statsPeriod = path.empty() ? 0 : period;
+}
+
+// Bookkeeping at the end of every simulation step of the whole system.
+void System::endOfStep()
+{
+    SimStats::count(eStatTicks);
+    m_simStep++;
+    if ((m_statsPeriod > 0) && ((m_simStep % m_statsPeriod) == 0)) {
+        if (SimStats::instance().dump(m_statsPath) != 0) {
+            std::cout << "ERROR: Unable to write statistics to "
+                      << m_statsPath << std::endl;
+            m_statsPeriod = 0;
+        }
+    }
+    m_checkpoint.endOfStep(m_simStep);
+    m_views.endOfStep(m_simStep);
+}
+
+// -----------------------------------------------------------------------------
+// Object tables
+// -----------------------------------------------------------------------------
+
+template <typename T>
+void System::Table<T>::clear()
+{
+    sorted.clear();
+    sortedValid = false;
+    byName.clear();
+    items.clear();
+    freeIds.clear();
+    count = 0;
+}
+
+template <typename T>
+std::shared_ptr<T> System::findObject(Table<T>& table, const std::string& name)
+{
+    NameID nid = m_names.find(name);
+    if (nid == kNoName) { return nullptr; }
+    int id = table.byName.find(nid);
+    return (id < 0) ? nullptr : table.items[id];
+}
+
+// Objects are allocated in the arena of their kind, and the shared_ptr
+// control block with them (see arena.h).
+template <typename T>
+std::shared_ptr<T> System::addObject(Table<T>& table, Arena& arena,
+                                     const std::string& name)
+{
+    NameID nid = m_names.intern(name);
+    int id = table.freeIds.empty() ? (int)table.items.size() : table.freeIds.back();
+    if (!table.byName.insert(nid, id)) { return nullptr; }
+    std::shared_ptr<T> item = std::allocate_shared<T>(ArenaAllocator<T>(arena), nid, id);
+    if ((size_t)id == table.items.size()) { table.items.push_back(item); }
+    else {
+        table.items[id] = item;
+        table.freeIds.pop_back();
+    }
+    table.count++;
+    table.sortedValid = false;
+    return item;
+}
+
+// The ID is kept for the next object of the kind, so the dense tables
+// do not grow while objects come and go.
+template <typename T>
+void System::removeObject(Table<T>& table, int id)
+{
+    table.byName.erase(m_names.find(table.items[id]->name()));
+    table.items[id].reset();
+    table.freeIds.push_back(id);
+    table.count--;
+    table.sortedValid = false;
+}
+
+// Drop the null entries at the end, and reuse the lowest IDs first so
+// the table stays dense.
+template <typename T>
+void System::trimTable(Table<T>& table)
+{
+    while (!table.items.empty() && !table.items.back()) { table.items.pop_back(); }
+    size_t size = table.items.size();
+    table.freeIds.erase(std::remove_if(table.freeIds.begin(), table.freeIds.end(),
+                                       [size](int id) { return (size_t)id >= size; }),
+                        table.freeIds.end());
+    std::sort(table.freeIds.begin(), table.freeIds.end(), std::greater<int>());
+}
+
+template <typename T>
+const std::vector<std::shared_ptr<T>>& System::sortedView(Table<T>& table)
+{
+    if (!table.sortedValid) {
+        // Sort the IDs by name, then look the objects up once.
+        std::vector<std::pair<const std::string*, int>> keys;
+        keys.reserve(table.count);
+        for (const auto& item: table.items) {
+            if (item) { keys.emplace_back(&item->name(), item->id()); }
+        }
+        std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+            return *a.first < *b.first;
+        });
+        table.sorted.clear();
+        table.sorted.reserve(keys.size());
+        for (const auto& key: keys) {
+            table.sorted.push_back(table.items[key.second]);
+        }
+        table.sortedValid = true;
+    }
+    return table.sorted;
+}
+
+const EdgeVec& System::sortedEdges()
+{
+    return sortedView(m_edges);
+}
+const NodeVec& System::sortedNodes()
+{
+    return sortedView(m_nodes);
+}
+const TrainVec& System::sortedTrains()
+{
+    return sortedView(m_trains);
+}
+
+EdgePtr System::addEdge(const std::string& name)
+{
+    EdgePtr eptr = addObject(m_edges, m_edgeArena, name);
+    // A reused ID may still have the states of the removed edge.
+    if (eptr) { edgeChanged(eptr->id()); }
+    else      { touchTopology(); }
+    return eptr;
+}
+
+NodePtr System::addNode(const std::string& name)
+{
+    touchTopology();
+    NodePtr nptr = addObject(m_nodes, m_nodeArena, name);
+    if (nptr) {
+        nptr->m_typePos = (int)m_nodesByType[eEmpty].size();
+        m_nodesByType[eEmpty].push_back(nptr->m_id);
+    }
+    return nptr;
+}
+
+void System::NameSeq::clear()
+{
+    next = 1;
+    freed = decltype(freed)();
+}
+
+// The lowest numbered name not yet used. A name given back by a removed
+// object is taken first. Otherwise the search resumes where the last
+// one found a free name, rather than probing from 1 every time.
+template <typename T>
+std::string System::uniqueName(Table<T>& table, NameSeq& seq, const char* format)
+{
+    char name[32];
+    while (!seq.freed.empty()) {
+        snprintf(name, sizeof(name), format, seq.freed.top());
+        seq.freed.pop();
+        NameID nid = m_names.find(name);
+        if ((nid == kNoName) || (table.byName.find(nid) < 0)) { return name; }
+    }
+    for (;; seq.next++) {
+        snprintf(name, sizeof(name), format, seq.next);
+        NameID nid = m_names.find(name);
+        if ((nid == kNoName) || (table.byName.find(nid) < 0)) { break; }
     }
     return name;
 }
 
+// Give back the number of a generated name, if the name is one. Its
+// string is already interned, so reusing it also keeps the name table
+// from growing.
+void System::releaseName(NameSeq& seq, const std::string& name, const char* format)
+{
+    size_t digits = name.find_first_of("0123456789");
+    if ((digits == std::string::npos) ||
+        (name.find_first_not_of("0123456789", digits) != std::string::npos)) {
+        return;
+    }
+    long number = std::strtol(name.c_str() + digits, nullptr, 10);
+    char check[32];
+    snprintf(check, sizeof(check), format, number);
+    if ((name == check) && (number < seq.next)) { seq.freed.push(number); }
+}
+
+std::string System::getUniqueEdgeName()
+{
+    return uniqueName(m_edges, m_edgeNames, kEdgeFormat);
+}
+std::string System::getUniqueNodeName()
+{
+    return uniqueName(m_nodes, m_nodeNames, kNodeFormat);
+}
+std::string System::getUniqueTrainName()
+{
+    return uniqueName(m_trains, m_trainNames, kTrainFormat);
+}
+
 } // namespace rrsim
@@ -0,0 +1,111 @@
+// timetable.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the Timetable class.
+
+#include "timetable.h"
+#include "system.h"
+#include "edge.h"
+#include "train.h"
+#include "stats.h"
+#include "memstat.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace rrsim {
+
+Timetable::Timetable() : m_seq(0)
+{
+}
+
+void Timetable::clear()
+{
+    m_queue = decltype(m_queue)();
+    m_seq = 0;
+}
+
+size_t Timetable::load(std::istream& istr, long now)
+{
+    MemScope mem(eMemTrains);
+    size_t count = 0;
+    std::string line;
+    while (std::getline(istr, line)) {
+        if (line.empty() || (line[0] == '#')) continue;
+        std::stringstream fields(line);
+        std::string train, origin, dest, step, length;
+        std::getline(fields, train, ',');
+        std::getline(fields, origin, ',');
+        std::getline(fields, dest, ',');
+        std::getline(fields, step, ',');
+        std::getline(fields, length);
+
+        EdgePtr from = sys().getEdge(origin);
+        EdgePtr to = sys().getEdge(dest);
+        if (!from || !to) {
+            throw std::runtime_error("Unknown track segment in timetable: " + line);
+        }
+        long when;
+        try { when = std::stol(step); }
+        catch (...) { throw std::runtime_error("Bad departure step in timetable: " + line); }
+        double size = 0.0;
+        if (!length.empty()) {
+            try { size = std::stod(length); }
+            catch (...) { throw std::runtime_error("Bad train length in timetable: " + line); }
+        }
+        add(train, from->id(), to->id(), now + when, size);
+        count++;
+    }
+    return count;
+}
+
+void Timetable::add(const std::string& train, int origin, int dest, long step,
+                    double length)
+{
+    m_queue.push(Departure{step, m_seq++, origin, dest, length, train});
+}
+
+int Timetable::inject(long step)
+{
+    int placed = 0;
+    std::vector<Departure> waiting;
+    while (!m_queue.empty() && (m_queue.top().step <= step)) {
+        Departure dep = m_queue.top();
+        m_queue.pop();
+        if (sys().fleet().occupant(dep.origin) >= 0) {
+            waiting.push_back(dep);
+            continue;
+        }
+
+        const EdgeVec& edges = sys().edges();
+        if (!edges[dep.origin] || !edges[dep.dest]) {
+            std::cout << "ERROR: " << dep.train << " did not depart: "
+                      << "its track segment was removed" << std::endl;
+            continue;
+        }
+        TrainPtr tptr = dep.train.empty() ? nullptr : sys().getTrain(dep.train);
+        if (!tptr) { tptr = sys().createTrain(dep.train); }
+        if (dep.length > 0.0) { sys().fleet().setLength(tptr->id(), dep.length); }
+        try {
+            tptr->placeOnTrack(edges[dep.origin], edges[dep.dest]);
+            SimStats::count(eStatDepartures);
+            placed++;
+        }
+        catch (std::exception& ex) {
+            std::cout << "ERROR: " << tptr->name() << " did not depart: "
+                      << ex.what() << std::endl;
+            tptr->placeOnTrack(nullptr, nullptr);
+        }
+    }
+
+    // Try again next step, ahead of the departures due then.
+    for (Departure& dep: waiting) {
+        dep.step = step + 1;
+        m_queue.push(dep);
+        SimStats::count(eStatDeparturesHeld);
+    }
+    return placed;
+}
+
+} // namespace rrsim
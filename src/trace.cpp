@@ -0,0 +1,162 @@
+// trace.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the trace-event writer. Nothing here is compiled
+// unless tracing is enabled (see trace.h).
+
+#include "trace.h"
+
+#ifdef RRSIM_TRACE
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace rrsim {
+
+// Timestamps are relative to program start. Spans may begin before the
+// Tracer singleton is first used, so this cannot live in the Tracer.
+static const uint64_t s_origin = Tracer::now();
+
+// Events are buffered in memory and appended to the file in batches, so
+// a long run needs a bounded amount of memory. The file uses the JSON
+// array form of the trace-event format, whose closing bracket is
+// written when the program exits.
+//
+struct Tracer::Impl
+{
+    struct Event
+    {
+        const char* name;
+        char        phase;      // 'X' complete span, 'i' instant, 'M' meta.
+        uint64_t    start;
+        uint64_t    duration;
+        unsigned    tid;
+        std::string detail;
+    };
+
+    static const size_t kFlushEvents = 65536;
+
+    std::mutex          lock;
+    std::vector<Event>  events;
+    std::ofstream       ofstr;
+    std::string         path;
+    bool                first = true;
+
+    static unsigned threadID() {
+        static std::atomic<unsigned> nextID(1);
+        thread_local unsigned tid = nextID++;
+        return tid;
+    }
+
+    void push(Event&& ev) {
+        std::lock_guard<std::mutex> guard(lock);
+        events.push_back(std::move(ev));
+        if (events.size() >= kFlushEvents) { write(); }
+    }
+
+    static void quote(std::ostream& os, const std::string& str) {
+        os << '"';
+        for (char ch: str) {
+            if      (ch == '"')  { os << "\\\""; }
+            else if (ch == '\\') { os << "\\\\"; }
+            else if (ch == '\n') { os << "\\n"; }
+            else                 { os << ch; }
+        }
+        os << '"';
+    }
+
+    // Append the buffered events to the file. Called with the lock held.
+    void write() {
+        if (!ofstr.is_open()) {
+            ofstr.open(path, std::ofstream::trunc);
+            if (!ofstr.good()) {
+                std::cout << "ERROR: Unable to open trace file "
+                          << path << std::endl;
+                events.clear();
+                return;
+            }
+            ofstr << "[\n";
+        }
+        ofstr << std::fixed << std::setprecision(3);
+        for (const Event& ev: events) {
+            if (!first) { ofstr << ",\n"; }
+            first = false;
+            ofstr << "{\"name\":";
+            quote(ofstr, ev.phase == 'M' ? "thread_name" : ev.name);
+            ofstr << ",\"ph\":\"" << ev.phase << "\",\"pid\":1,\"tid\":" << ev.tid
+                  << ",\"ts\":" << (double)(ev.start - s_origin) / 1000.0;
+            if (ev.phase == 'X') {
+                ofstr << ",\"dur\":" << (double)ev.duration / 1000.0;
+            }
+            else if (ev.phase == 'i') {
+                ofstr << ",\"s\":\"t\"";
+            }
+            if (ev.phase == 'M') {
+                ofstr << ",\"args\":{\"name\":";
+                quote(ofstr, ev.name);
+                ofstr << "}";
+            }
+            else if (!ev.detail.empty()) {
+                ofstr << ",\"args\":{\"detail\":";
+                quote(ofstr, ev.detail);
+                ofstr << "}";
+            }
+            ofstr << "}";
+        }
+        ofstr.flush();
+        events.clear();
+    }
+};
+
+Tracer& Tracer::instance()
+{
+    static Tracer T;
+    return T;
+}
+
+Tracer::Tracer() : m_impl(new Impl)
+{
+    const char* path = std::getenv("RRSIM_TRACE_FILE");
+    m_impl->path = path ? path : "rrsim_trace.json";
+}
+
+Tracer::~Tracer()
+{
+    flush();
+    if (m_impl->ofstr.is_open()) {
+        m_impl->ofstr << "\n]\n";
+        m_impl->ofstr.close();
+    }
+    delete m_impl;
+}
+
+void Tracer::span(const char* name, uint64_t start, uint64_t end)
+{
+    m_impl->push({ name, 'X', start, end - start, Impl::threadID(), {} });
+}
+
+void Tracer::instant(const char* name, const std::string& detail)
+{
+    m_impl->push({ name, 'i', now(), 0, Impl::threadID(), detail });
+}
+
+void Tracer::threadName(const char* name)
+{
+    m_impl->push({ name, 'M', now(), 0, Impl::threadID(), {} });
+}
+
+void Tracer::flush()
+{
+    std::lock_guard<std::mutex> guard(m_impl->lock);
+    m_impl->write();
+}
+
+} // namespace rrsim
+
+#endif // RRSIM_TRACE
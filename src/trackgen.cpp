@@ -0,0 +1,147 @@
+// trackgen.cpp
+//
+// Author: Kendall Auel
+// Description:
+//     Command line front end of the synthetic track network generator.
+//     The network is built in memory by NetGenerator (see netgen.h) and
+//     written with System::serialize, so every generated file can be
+//     loaded back with "Load track network".
+//
+
+#include "netgen.h"
+#include "system.h"
+#include "edge.h"
+#include "memstat.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+namespace {
+
+struct CmdOptions
+{
+    rrsim::GenOptions   gen;
+    std::string         output;
+    std::string         timetable;
+    long                departures = 0;
+};
+
+void usage(const char* prog)
+{
+    std::cout <<
+        "Usage: " << prog << " [options] -o FILE"                     << std::endl <<
+        "  -t, --topology T   mainline | ladder | grid | tree"        << std::endl <<
+        "  -n, --segments N   approximate number of track segments"   << std::endl <<
+        "  -s, --seed S       random seed (tree topology)"            << std::endl <<
+        "  -g, --signals M    none | junctions | all"                 << std::endl <<
+        "  -k, --spacing K    segments between crossovers (ladder)"   << std::endl <<
+        "  -r, --rows R       parallel lines (grid)"                  << std::endl <<
+        "  -o, --output FILE  network file to write"                  << std::endl <<
+        "  -T, --timetable F  also write a timetable of random trips"  << std::endl <<
+        "  -d, --departures N number of trips in the timetable"       << std::endl;
+}
+
+bool parseArgs(int argc, char** argv, CmdOptions& opts)
+{
+    for (int ix = 1; ix < argc; ix++) {
+        std::string arg = argv[ix];
+        if (arg == "-h" || arg == "--help") { return false; }
+        if (ix + 1 >= argc) {
+            std::cout << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string val = argv[++ix];
+        if      (arg == "-t" || arg == "--topology") { opts.gen.topology = val; }
+        else if (arg == "-n" || arg == "--segments") { opts.gen.segments = std::stol(val); }
+        else if (arg == "-s" || arg == "--seed")     { opts.gen.seed = (unsigned)std::stoul(val); }
+        else if (arg == "-g" || arg == "--signals")  { opts.gen.signals = val; }
+        else if (arg == "-k" || arg == "--spacing")  { opts.gen.spacing = std::stoi(val); }
+        else if (arg == "-r" || arg == "--rows")     { opts.gen.rows = std::stoi(val); }
+        else if (arg == "-o" || arg == "--output")   { opts.output = val; }
+        else if (arg == "-T" || arg == "--timetable") { opts.timetable = val; }
+        else if (arg == "-d" || arg == "--departures") { opts.departures = std::stol(val); }
+        else {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return !opts.output.empty() && (opts.gen.segments > 0);
+}
+
+// Random trips between segments, one departure every other step on
+// average.
+int writeTimetable(const CmdOptions& opts)
+{
+    std::ofstream ofstr(opts.timetable, std::ofstream::trunc);
+    if (!ofstr.good()) {
+        std::cout << "Unable to open file " << opts.timetable << std::endl;
+        return ENOENT;
+    }
+    const rrsim::EdgeVec& edges = sys().sortedEdges();
+    std::mt19937 rng(opts.gen.seed);
+    ofstr << "# train,origin,destination,step" << std::endl;
+    for (long ix = 0; (ix < opts.departures) && (edges.size() > 1); ix++) {
+        size_t from = rng() % edges.size();
+        size_t to = rng() % (edges.size() - 1);
+        if (to >= from) { to++; }
+        ofstr << "TT" << ix << ',' << edges[from]->name() << ','
+              << edges[to]->name() << ',' << (ix * 2 + (long)(rng() % 3)) << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// main -- Entry point
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    CmdOptions opts;
+    try {
+        if (!parseArgs(argc, argv, opts)) {
+            usage(argv[0]);
+            return EINVAL;
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: invalid argument (" << ex.what() << ")" << std::endl;
+        usage(argv[0]);
+        return EINVAL;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    rrsim::NetGenerator gen(opts.gen);
+    try {
+        gen.build();
+    }
+    catch (std::exception& ex) {
+        std::cout << "ERROR: " << ex.what() << std::endl;
+        return EFAULT;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::ofstream ofstr(opts.output, std::ofstream::trunc);
+    if (!ofstr.good()) {
+        std::cout << "Unable to open file " << opts.output << std::endl;
+        return ENOENT;
+    }
+    int rc = sys().serialize(ofstr);
+    ofstr.close();
+    if ((rc == 0) && !opts.timetable.empty()) { rc = writeTimetable(opts); }
+    auto t2 = std::chrono::steady_clock::now();
+
+    using ms = std::chrono::milliseconds;
+    std::cout << opts.gen.topology << ": " << sys().edgeCount() << " segments, "
+              << sys().nodeCount(rrsim::eJunction) << " junctions -> " << opts.output
+              << std::endl
+              << "build " << std::chrono::duration_cast<ms>(t1 - t0).count()
+              << " ms, write " << std::chrono::duration_cast<ms>(t2 - t1).count()
+              << " ms" << std::endl
+              << rrsim::MemStats::report((long)sys().edgeCount(), true);
+    return rc;
+}
@@ -8,33 +8,42 @@
 #include "edge.h"
 #include "node.h"
 #include "rrsignal.h"
+#include "stats.h"
+#include "trace.h"
+#include "memstat.h"
 #include <iostream>
-#include <queue>
-#include <set>
 
 namespace rrsim {
 
 
-Train::Train(const std::string& name) : m_name(name)
+Train::Train(NameID name, int id) : m_name(name), m_id(id)
 {
-    // Initialize edge end to an invalid value.
-    m_edge.eeEnd = eNumEnds;
 }
 
 Train::~Train()
 {
 }
 
+EdgeEnd Train::getPosition()
+{
+    TrainFleet& fleet = sys().fleet();
+    if (!fleet.onTrack(m_id)) { return EdgeEnd(); }
+    return EdgeEnd(sys().edges()[fleet.edgeOf(m_id)], fleet.endOf(m_id));
+}
+
 void Train::placeOnTrack(EdgePtr start, EdgePtr end)
 {
-    EdgePtr eptr = m_edge.eeEdge.lock();
+    TrainFleet& fleet = sys().fleet();
+    // Bring the other trains up to date with any edits first.
+    fleet.repairRoutes();
+    EdgePtr eptr = getPosition().eeEdge.lock();
     if (eptr) {
-        // Remove the train from its current track segment.
-        eptr->setTrain(nullptr);
-        m_edge.eeEdge.reset();
-        m_destination.reset();
+        // Remove the train from its current track segments.
+        fleet.clearPosition(m_id);
+        fleet.setDestination(m_id, -1);
     }
-    while (!m_route.empty()) { m_route.pop(); }
+    fleet.clearRoute(m_id);
+    fleet.setDeparture(m_id, 0);
 
     // Nothing else to do if we aren't going anywhere.
     if (!start || !end) { return; }
@@ -43,162 +52,163 @@ void Train::placeOnTrack(EdgePtr start, EdgePtr end)
         throw std::runtime_error(
                 "A train is already on segment: " + start->name());
     }
-    start->setTrain(shared_from_this());
-    m_edge.eeEdge = start;
-    m_edge.eeEnd = eEndB; // getOptimalRoute determines the final value.
-    m_destination = end;
+    fleet.enter(m_id, start->id());
+    // getOptimalRoute determines the final direction.
+    fleet.setPosition(m_id, start->id(), eEndB);
+    fleet.setDestination(m_id, end->id());
 
     getOptimalRoute();
 }
 
+void Train::restore(EdgePtr edge, eEnd toward, EdgePtr end)
+{
+    placeOnTrack(nullptr, nullptr);
+    TrainFleet& fleet = sys().fleet();
+    fleet.setDestination(m_id, end ? end->id() : -1);
+    if (!edge) { return; }
+    if (edge->getTrain()) {
+        throw std::runtime_error(
+                "A train is already on segment: " + edge->name());
+    }
+    fleet.enter(m_id, edge->id());
+    fleet.setPosition(m_id, edge->id(), toward);
+    if (!end) { return; }
+    std::vector<eJSwitch> steps;
+    if (sys().routeRepair().route(end->id(), fleet.stateOf(m_id), steps)) {
+        fleet.setRoute(m_id, steps);
+    }
+}
+
 bool Train::stepSimulation()
 {
-    EdgePtr eptr = m_edge.eeEdge.lock();
+    TrainFleet& fleet = sys().fleet();
 
     // Nothing to do if we are not on a track segment.
-    if (!eptr) { return false; }
+    if (!fleet.onTrack(m_id)) { return false; }
 
     // Nothing to do if we are at the destination.
-    if (eptr == m_destination.lock()) { return false; }
+    if (fleet.edgeOf(m_id) == fleet.destOf(m_id)) { return false; }
 
-    EdgeEnd next;
+    int32_t state = fleet.stateOf(m_id);
+    EdgePtr eptr = sys().edges()[fleet.edgeOf(m_id)];
+    const TransitionTable& table = sys().transitions();
+    int32_t next = table.next(state);
+    NodePtr node;
     EdgePtr nexp;
     eJSwitch jsw;
 
     // Do not advance the train if the signal is red.
     bool advance = true;
-    RRsignal * light = eptr->getSignal(m_edge.eeEnd);
+    RRsignal * light = eptr->getSignal(fleet.endOf(m_id));
     if (light && light->signalIsRed()) { advance = false; }
 
-    NodeSlot node = eptr->getNode(m_edge.eeEnd);
-    switch (node.nsNode->getNodeType()) {
+    switch (table.facingType(state)) {
     default:
     case eEmpty: // TODO: throw exception?
     case eTerminator: return false;
 
     case eContinuation:
         if (advance) {
-            next = node.nsNode->getEdgeEnd(
-                    (node.nsSlot == eSlot1) ? eSlot2 : eSlot1);
-            nexp = next.eeEdge.lock();
-            if (nexp) {
-                eptr->setTrain(nullptr);
-                if (nexp->getTrain()) {
-                    m_edge.eeEdge.reset();
-                    throw std::runtime_error("Train collision detected!");
-                }
-                m_edge.eeEdge = next.eeEdge;
-                m_edge.eeEnd = (next.eeEnd == eEndA) ? eEndB : eEndA;
-                nexp->setTrain(shared_from_this());
-            }
+            if (next >= 0) { moveTo(next); }
         }
+        else { fleet.blocked(m_id); }
         break;
 
     case eJunction:
-        jsw = node.nsNode->getSwitchPos();
-        if (node.nsSlot == eSlot1) {
-#ifdef SHOW_JUNCTION
-            if (m_route.empty()) { std::cout << "No route for " << eptr->name() << std::endl; }
-            else { std::cout << "Route wants " << ((m_route.top() == eSwitchLeft) ? "left" : "right")
-                             << ", switch is " << ((jsw == eSwitchLeft) ? "left" : "right") << std::endl; }
-#endif
-            if (!m_route.empty() && (m_route.top() != jsw)) {
-                node.nsNode->setSwitchPos(m_route.top());
-#ifdef SHOW_JUNCTION
-                std::cout << "Switch " << eptr->name() << "->"
-                          << node.nsNode->name() << " set to "
-                          << ((jsw == eSwitchRight) ? "right" : "left")
-                          << std::endl;
-#endif
+        node = eptr->getNode(fleet.endOf(m_id)).nsNode;
+        jsw = node->getSwitchPos();
+        switch (table.facingSlot(state)) {
+        case eSlot1:
+            RRSIM_TRACE_INSTANT("junction", name() + " at " + eptr->name()
+                    + ": route wants " + (fleet.routeEmpty(m_id) ? "none" :
+                        (fleet.routeNext(m_id) == eSwitchLeft) ? "left" : "right")
+                    + ", switch is "
+                    + ((jsw == eSwitchLeft) ? "left" : "right"));
+            if (!fleet.routeEmpty(m_id) && (fleet.routeNext(m_id) != jsw)) {
+                node->setSwitchPos(fleet.routeNext(m_id));
+                SimStats::count(eStatSwitchFlips);
+                SimStats::count(eStatBlockedSwitch);
+                RRSIM_TRACE_INSTANT("switch", name() + " set "
+                        + node->name() + " to "
+                        + ((fleet.routeNext(m_id) == eSwitchRight) ? "right" : "left"));
             }
             else if (advance) {
-                next = node.nsNode->getEdgeEnd(
-                        (jsw == eSwitchLeft) ? eSlot2 : eSlot3);
-                nexp = next.eeEdge.lock();
-                if (nexp) {
-                    eptr->setTrain(nullptr);
-                    if (nexp->getTrain()) {
-                        m_edge.eeEdge.reset();
-                        throw std::runtime_error("Train collision detected!");
-                    }
-                    m_edge.eeEdge = next.eeEdge;
-                    m_edge.eeEnd = (next.eeEnd == eEndA) ? eEndB : eEndA;
-                    nexp->setTrain(shared_from_this());
-                    if (!m_route.empty()) { m_route.pop(); }
+                if (next >= 0) {
+                    moveTo(next);
+                    if (!fleet.routeEmpty(m_id)) { fleet.routeAdvance(m_id); }
                 }
             }
-        }
-        else if (node.nsSlot == eSlot2) {
-            next = node.nsNode->getEdgeEnd(eSlot1);
-            nexp = next.eeEdge.lock();
+            else { fleet.blocked(m_id); }
+            break;
+
+        case eSlot2:
             if (jsw != eSwitchLeft) {
                 // Set the junction switch if no train is waiting.
+                SimStats::count(eStatBlockedSwitch);
+                nexp = node->getEdgeEnd(eSlot1).eeEdge.lock();
                 if (nexp && !nexp->getTrain()) {
-                    node.nsNode->setSwitchPos(eSwitchLeft);
-#ifdef SHOW_JUNCTION
-                    std::cout << "Switch " << eptr->name() << "->"
-                              << node.nsNode->name() << " set to left"
-                              << std::endl;
-#endif
+                    node->setSwitchPos(eSwitchLeft);
+                    SimStats::count(eStatSwitchFlips);
+                    RRSIM_TRACE_INSTANT("switch", name() + " set "
+                            + node->name() + " to left");
                 }
             }
             else if (advance) {
-                if (nexp) {
-                    eptr->setTrain(nullptr);
-                    if (nexp->getTrain()) {
-                        m_edge.eeEdge.reset();
-                        throw std::runtime_error("Train collision detected!");
-                    }
-                    m_edge.eeEdge = next.eeEdge;
-                    m_edge.eeEnd = (next.eeEnd == eEndA) ? eEndB : eEndA;
-                    nexp->setTrain(shared_from_this());
-                }
+                if (next >= 0) { moveTo(next); }
             }
-        }
-        else if (node.nsSlot == eSlot3) {
-            next = node.nsNode->getEdgeEnd(eSlot1);
-            nexp = next.eeEdge.lock();
+            else { fleet.blocked(m_id); }
+            break;
+
+        case eSlot3:
             if (jsw != eSwitchRight) {
                 // Set the junction switch if no other train is waiting.
+                SimStats::count(eStatBlockedSwitch);
+                nexp = node->getEdgeEnd(eSlot1).eeEdge.lock();
                 if (nexp && !nexp->getTrain()) {
-                    nexp = node.nsNode->getEdgeEnd(eSlot2).eeEdge.lock();
+                    nexp = node->getEdgeEnd(eSlot2).eeEdge.lock();
                     if (nexp && !nexp->getTrain()) {
-                        node.nsNode->setSwitchPos(eSwitchRight);
-#ifdef SHOW_JUNCTION
-                        std::cout << "Switch " << eptr->name() << "->"
-                                  << node.nsNode->name() << " set to left"
-                                  << std::endl;
-#endif
+                        node->setSwitchPos(eSwitchRight);
+                        SimStats::count(eStatSwitchFlips);
+                        RRSIM_TRACE_INSTANT("switch", name() + " set "
+                                + node->name() + " to right");
                     }
                 }
             }
             else if (advance) {
-                if (nexp) {
-                    eptr->setTrain(nullptr);
-                    if (nexp->getTrain()) {
-                        m_edge.eeEdge.reset();
-                        throw std::runtime_error("Train collision detected!");
-                    }
-                    m_edge.eeEdge = next.eeEdge;
-                    m_edge.eeEnd = (next.eeEnd == eEndA) ? eEndB : eEndA;
-                    nexp->setTrain(shared_from_this());
-                }
+                if (next >= 0) { moveTo(next); }
             }
+            else { fleet.blocked(m_id); }
+            break;
+
+        default:
+            break;
         }
         break;
     }
     return true;
 }
 
+void Train::moveTo(int32_t next)
+{
+    TrainFleet& fleet = sys().fleet();
+    fleet.releaseTail(m_id, next >> 1);
+    if (fleet.occupant(next >> 1) >= 0) {
+        fleet.clearPosition(m_id);
+        throw std::runtime_error("Train collision detected!");
+    }
+    fleet.move(m_id, next);
+}
+
 void Train::show()
 {
-    std::cout << "Train: " << m_name << std::endl;
-    EdgePtr eptr = m_edge.eeEdge.lock();
+    std::cout << "Train: " << name() << std::endl;
+    EdgeEnd pos = getPosition();
+    EdgePtr eptr = pos.eeEdge.lock();
     if (eptr) {
         std::cout << "  Location: track segment \""
                   << eptr->name() << "\"" << std::endl;
         std::cout << "  Direction: toward segment end "
-                  << ((m_edge.eeEnd == eEndA) ? "A" : "B") << std::endl;
+                  << ((pos.eeEnd == eEndA) ? "A" : "B") << std::endl;
     }
 }
 
@@ -206,161 +216,91 @@ void Train::show()
 // Optimal Route Generation (Breadth-first search of track network)
 // -----------------------------------------------------------------------------
 
-struct QNode
-{
-    QNode*      parent;
-    NodeSlot    node;
-    QNode(QNode* p, NodeSlot n) : parent(p), node(n) {}
-};
-
-static std::string getNodeSlotID(NodeSlot node)
-{
-    if (node.nsNode) {
-        return node.nsNode->name() + std::to_string(node.nsSlot);
-    }
-    return "nodeNULL";
-}
-
 // NOTE: The only control the train has on its route is the switch
 //       position at each junction. The end result of the search is
 //       then merely an ordered list of junction switch positions.
 //
 // The optimal route uses a breadth-first search of the track network
-// nodes, looking for any node accessible to the end edge.
+// (see routesearch.h), unless the route matrix already has the route.
 //
 void Train::getOptimalRoute()
 {
-    EdgePtr start = m_edge.eeEdge.lock();
-    EdgePtr end = m_destination.lock();
+    StatTimer timer(eTimeRoutePlan);
+    RRSIM_TRACE_SCOPE("getOptimalRoute");
+    MemScope mem(eMemRouting);
+    TrainFleet& fleet = sys().fleet();
+    EdgePtr start = getPosition().eeEdge.lock();
+    int dest = fleet.destOf(m_id);
+    EdgePtr end = (dest < 0) ? nullptr : sys().edges()[dest];
     if (!start || !end) {
         // Missing end(s), no route is possible.
-        while (!m_route.empty()) { m_route.pop(); }
+        fleet.clearRoute(m_id);
         return;
     }
-    std::queue<QNode*> searchQueue;
-    std::queue<QNode*> poppedQueue;
-    std::set<std::string> visitedSet;
-    NodeSlot node;
-    EdgeEnd edge;
-    EdgePtr eptr;
-
-    // Initialize the BFS search queue with the end nodes of the start edge.
-    searchQueue.push(new QNode(nullptr, start->getNode(eEndA)));
-    visitedSet.insert(getNodeSlotID(searchQueue.back()->node));
-    searchQueue.push(new QNode(nullptr, start->getNode(eEndB)));
-    visitedSet.insert(getNodeSlotID(searchQueue.back()->node));
+    if (!sys().reach().mayReach(start->id(), end->id())) {
+        // No need to search the whole component of the start.
+        throw std::runtime_error("getOptimalRoute failed to reach the end");
+    }
 
-    // Now cycle through the front of the queue looking for the end edge.
-    // If not found, push unvisited adjacent nodes onto the search queue.
-    QNode* found = nullptr;
-    while (!found) {
-        if (searchQueue.empty()) {
-            // ERROR: clear out the popped items and throw an exception.
-            while (!poppedQueue.empty()) {
-                delete poppedQueue.front();
-                poppedQueue.pop();
-            }
+    // The route belongs to the train, the search scratch space to routing.
+    MemScope routeMem(eMemTrains);
+    std::vector<eJSwitch> route;
+    std::vector<int32_t> path;
+    eEnd startEnd;
+    std::vector<Route> routes;
+    if (fleet.routeCount() > 1) {
+        // The first of the alternatives is the route the search finds.
+        if (sys().routeSearch().alternatives(start->id(), end->id(),
+                                             fleet.routeCount(), routes) == 0) {
             throw std::runtime_error("getOptimalRoute failed to reach the end");
         }
-        QNode* front = searchQueue.front();
-        searchQueue.pop();
-        poppedQueue.push(front);
-
-        switch (front->node.nsSlot) {
-        case eSlot1:
-            // Both slot 2 and 3 are adjacent (if not null)
-            edge = front->node.nsNode->getEdgeEnd(eSlot2);
-            eptr = edge.eeEdge.lock();
-            if (eptr) {
-                if (eptr == end) { found = front; }
-                else {
-                    node = eptr->getAdjacent(edge.eeEnd);
-                    std::string ID = getNodeSlotID(node);
-                    if (visitedSet.find(ID) == visitedSet.end()) {
-                        visitedSet.insert(ID);
-                        searchQueue.push(new QNode(front, node));
-                    }
-                }
-            }
-            if (found) break;
-
-            edge = front->node.nsNode->getEdgeEnd(eSlot3);
-            eptr = edge.eeEdge.lock();
-            if (eptr) {
-                if (eptr == end) { found = front; }
-                else {
-                    node = eptr->getAdjacent(edge.eeEnd);
-                    std::string ID = getNodeSlotID(node);
-                    if (visitedSet.find(ID) == visitedSet.end()) {
-                        visitedSet.insert(ID);
-                        searchQueue.push(new QNode(front, node));
-                    }
-                }
-            }
-            break;
-
-        case eSlot2:
-        case eSlot3:
-            // Only slot 1 is adjacent (either continuation, or junction fork).
-            edge = front->node.nsNode->getEdgeEnd(eSlot1);
-            eptr = edge.eeEdge.lock();
-            if (eptr) {
-                if (eptr == end) { found = front; }
-                else {
-                    node = eptr->getAdjacent(edge.eeEnd);
-                    std::string ID = getNodeSlotID(node);
-                    if (visitedSet.find(ID) == visitedSet.end()) {
-                        visitedSet.insert(ID);
-                        searchQueue.push(new QNode(front, node));
-                    }
-                }
-            }
-            break;
-
-        default:
-            // This indicates a bug, don't bother with garbage collection.
-            throw std::runtime_error("Unexpected slot number getOptimalRoute");
+        route = routes[0].steps;
+        path.assign(routes[0].states.begin(), routes[0].states.end() - 1);
+        startEnd = routes[0].startEnd();
+    }
+    else if (!sys().routeMatrix().lookup(start->id(), end->id(), startEnd, route, path)) {
+        RouteSearch& search = sys().routeSearch();
+        if (!search.search(start->id(), end->id())) {
+            throw std::runtime_error("getOptimalRoute failed to reach the end");
         }
+        startEnd = search.route(end->id(), route, &path);
     }
-    // We have a node that is connected to the end edge. Built the route
-    // by pushing junction switch positions onto the route stack.
 
-    // First, clear out anything on the route.
-    while (!m_route.empty()) { m_route.pop(); }
+    // Show the route from the end back to the start.
+    if (sys().verbose()) { showRoute(end, route, path, routes); }
+
+    // Set the route, the initial position and direction.
+    if (routes.empty()) { fleet.setRoute(m_id, route); }
+    else                { fleet.setRoutes(m_id, routes); }
+    fleet.setPosition(m_id, start->id(), startEnd);
+}
 
-    EdgePtr from = end;
+void Train::showRoute(EdgePtr end, const std::vector<eJSwitch>& route,
+                      const std::vector<int32_t>& path,
+                      const std::vector<Route>& routes)
+{
+    const TransitionTable& table = sys().transitions();
+    const EdgeVec& edges = sys().edges();
+    size_t step = route.size();
     std::cout << "Route ends at edge: " << end->name() << std::endl;
-    while (found) {
-        node = found->node;
-        if ((node.nsNode->getNodeType() == eJunction) &&
-            (node.nsSlot == eSlot1)) {
-            eptr = found->node.nsNode->getEdgeEnd(eSlot2).eeEdge.lock();
-            if (eptr == from) {
+    for (size_t px = path.size(); px-- > 0; ) {
+        int32_t state = path[px];
+        if ((table.facingType(state) == eJunction) &&
+            (table.facingSlot(state) == eSlot1)) {
+            if (route[--step] == eSwitchLeft) {
                 std::cout << "         -- via junction switch LEFT" << std::endl;
-                m_route.push(eSwitchLeft);
             }
             else {
                 std::cout << "         -- via junction switch RIGHT" << std::endl;
-                m_route.push(eSwitchRight);
             }
         }
-        edge = node.nsNode->getEdgeEnd(node.nsSlot);
-        from = edge.eeEdge.lock();
-        found = found->parent;
-        if (found) { std::cout << "         from edge: " << from->name() << std::endl; }
-        else       { std::cout << "Starting from edge: " << from->name() << std::endl; }
-    }
-    // Set the initial position and direction.
-    m_edge = edge;
-
-    // Free up the QNode elements.
-    while (!poppedQueue.empty()) {
-        delete poppedQueue.front();
-        poppedQueue.pop();
+        const std::string& from = edges[state >> 1]->name();
+        if (px > 0) { std::cout << "         from edge: " << from << std::endl; }
+        else        { std::cout << "Starting from edge: " << from << std::endl; }
     }
-    while (!searchQueue.empty()) {
-        delete searchQueue.front();
-        searchQueue.pop();
+    for (size_t rx = 1; rx < routes.size(); rx++) {
+        std::cout << "Alternative route " << rx << ": "
+                  << routes[rx].cost() << " segments" << std::endl;
     }
 }
 
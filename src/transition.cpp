@@ -0,0 +1,198 @@
+// transition.cpp
+//
+// Author: Kendall Auel
+//
+// Implementation of the TransitionTable class.
+
+#include "transition.h"
+#include "system.h"
+#include "edge.h"
+#include "node.h"
+#include <algorithm>
+
+namespace rrsim {
+
+int32_t TransitionTable::enterState(const EdgeEnd& edge)
+{
+    EdgePtr eptr = edge.eeEdge.lock();
+    if (!eptr) { return kTerminal; }
+    return eptr->id() * 2 + ((edge.eeEnd == eEndA) ? eEndB : eEndA);
+}
+
+int32_t TransitionTable::facingState(const EdgeEnd& edge)
+{
+    EdgePtr eptr = edge.eeEdge.lock();
+    if (!eptr) { return kTerminal; }
+    return eptr->id() * 2 + edge.eeEnd;
+}
+
+// Patch at most this share of the states, rebuild beyond it.
+static const size_t kPatchShare = 8;
+
+TransitionTable::TransitionTable() : m_version(-1), m_logBase(1)
+{
+}
+
+void TransitionTable::rebuild(long version)
+{
+    size_t states = sys().edges().size() * 2;
+    m_next.assign(states, kTerminal);
+    m_branch.assign(states * 2, kTerminal);
+    m_facing.assign(states, eEmpty);
+    m_junctions.clear();
+    m_junctionOf.assign(sys().nodes().size(), -1);
+    m_freeJunctions.clear();
+
+    addNodes(NodeKind<eTerminator>());
+    addNodes(NodeKind<eContinuation>());
+    addNodes(NodeKind<eJunction>());
+    m_version = version;
+
+    // Readers of the log must start over.
+    m_logBase = logEnd() + 1;
+    m_log.clear();
+    m_dirtyNodes.clear();
+    m_dirtyEdges.clear();
+}
+
+void TransitionTable::update(long version)
+{
+    size_t states = sys().edges().size() * 2;
+    if ((m_version < 0) || (states < m_next.size()) ||
+        (m_dirtyNodes.size() + m_dirtyEdges.size() > states / kPatchShare + 64)) {
+        rebuild(version);
+        return;
+    }
+    m_next.resize(states, kTerminal);
+    m_branch.resize(states * 2, kTerminal);
+    m_facing.resize(states, eEmpty);
+    m_junctionOf.resize(sys().nodes().size(), -1);
+
+    // The states of a changed edge are cleared, and found again from
+    // the nodes at its ends, if it is still there.
+    const EdgeVec& edges = sys().edges();
+    for (int edge: m_dirtyEdges) {
+        for (int ix = 0; ix < eNumEnds; ix++) {
+            int32_t state = edge * 2 + ix;
+            m_next[state] = kTerminal;
+            m_branch[state * 2] = m_branch[state * 2 + 1] = kTerminal;
+            m_facing[state] = eEmpty;
+            m_log.push_back(state);
+            if (edges[edge]) {
+                NodePtr node = edges[edge]->getNode((eEnd)ix).nsNode;
+                if (node) { m_dirtyNodes.push_back(node->id()); }
+            }
+        }
+    }
+
+    std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+    m_dirtyNodes.erase(std::unique(m_dirtyNodes.begin(), m_dirtyNodes.end()),
+                       m_dirtyNodes.end());
+    const NodeVec& nodes = sys().nodes();
+    for (int id: m_dirtyNodes) {
+        if (m_junctionOf[id] >= 0) {
+            m_freeJunctions.push_back(m_junctionOf[id]);
+            m_junctionOf[id] = -1;
+        }
+        Node* node = nodes[id].get();
+        if (!node || (node->getNodeType() == eEmpty)) continue;
+        visitNodeKind(node->getNodeType(), [&](auto kind) { addNode(kind, *node); });
+    }
+    m_dirtyNodes.clear();
+    m_dirtyEdges.clear();
+    m_version = version;
+
+    // A log longer than the table costs its readers more than a fresh
+    // start.
+    if (m_log.size() > states) {
+        m_logBase = logEnd() + 1;
+        m_log.clear();
+    }
+}
+
+template <typename Kind>
+void TransitionTable::addNodes(Kind)
+{
+    const NodeVec& nodes = sys().nodes();
+    for (int id: sys().nodesOfType(Kind::kType)) {
+        addNode(Kind(), *nodes[id]);
+    }
+}
+
+template <typename Kind>
+void TransitionTable::addNode(Kind, Node& node)
+{
+    int32_t facing[Kind::kSlots];
+    int32_t enter[Kind::kSlots];
+    for (int sx = 0; sx < Kind::kSlots; sx++) {
+        EdgeEnd edge = node.getEdgeEnd((eSlot)sx);
+        facing[sx] = facingState(edge);
+        enter[sx] = enterState(edge);
+        if (facing[sx] >= 0) {
+            m_facing[facing[sx]] = (uint8_t)(Kind::kType | (sx << 2));
+            m_branch[facing[sx] * 2] = m_branch[facing[sx] * 2 + 1] = kTerminal;
+            m_log.push_back(facing[sx]);
+        }
+    }
+    for (int sx = 0; sx < Kind::kSlots; sx++) {
+        if (facing[sx] < 0) continue;
+        int kx = 0;
+        eSlot prev = eNumSlots;
+        for (int jsw = 0; jsw < kNumSwitch; jsw++) {
+            eSlot exit = Kind::kExit[jsw][sx];
+            if ((exit != eNumSlots) && (exit != prev)) {
+                m_branch[facing[sx] * 2 + kx++] = enter[exit];
+                prev = exit;
+            }
+        }
+    }
+    if constexpr (Kind::kType == eJunction) {
+        Junction jct;
+        for (int sx = 0; sx < eNumSlots; sx++) {
+            jct.facing[sx] = facing[sx];
+            for (int jsw = 0; jsw < kNumSwitch; jsw++) {
+                eSlot exit = Kind::kExit[jsw][sx];
+                jct.next[jsw][sx] = (exit == eNumSlots) ? kBlocked
+                                                        : enter[exit];
+            }
+        }
+        if (m_freeJunctions.empty()) {
+            m_junctionOf[node.id()] = (int32_t)m_junctions.size();
+            m_junctions.push_back(jct);
+        }
+        else {
+            m_junctionOf[node.id()] = m_freeJunctions.back();
+            m_junctions[m_freeJunctions.back()] = jct;
+            m_freeJunctions.pop_back();
+        }
+        setJunction(jct, node.getSwitchPos());
+    }
+    else {
+        // The switch does not matter.
+        for (int sx = 0; sx < Kind::kSlots; sx++) {
+            eSlot exit = Kind::kExit[eSwitchNone][sx];
+            if (facing[sx] >= 0) {
+                m_next[facing[sx]] = (exit == eNumSlots) ? kTerminal
+                                                         : enter[exit];
+            }
+        }
+    }
+}
+
+void TransitionTable::switchChanged(int node, eJSwitch jsw, long version)
+{
+    if ((m_version != version) || ((size_t)node >= m_junctionOf.size())) {
+        return;
+    }
+    int32_t jx = m_junctionOf[node];
+    if (jx >= 0) { setJunction(m_junctions[jx], jsw); }
+}
+
+void TransitionTable::setJunction(const Junction& jct, eJSwitch jsw)
+{
+    for (int sx = 0; sx < eNumSlots; sx++) {
+        m_next[jct.facing[sx]] = jct.next[jsw][sx];
+    }
+}
+
+} // namespace rrsim